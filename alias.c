@@ -0,0 +1,192 @@
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+
+// ポインタを通した読み書きの別名解析
+//
+// -O1の中間表現で、IR_DEREFとIR_STDEREFがどの大域変数に触れうるかを答える。
+// 中間表現の構築で読み込みをやり直す変数、コード生成で値を覚えておける変数、
+// ループの最適化でレジスタに置ける変数を決めるのに使う。
+//
+// 型: ポインタの型はchar *、int *、long *で、ポインタの値は同じ型の変数の
+// アドレスに整数を足し引きしてしか作れず、型の違うポインタへは代入できない。
+// そのためT *を通した読み書きは型Tの変数にしか触れない。ポインタを指す
+// ポインタの型はないので、ポインタの変数にはどの読み書きも触れない。
+//
+// アドレスの出どころ: ポインタの値を代入とφを通してたどり、すべて関数の中で
+// 取った1つの変数のアドレスそのもの(か0を足し引きしたもの)に着けば、
+// 読み書きはその変数にしか触れない。別の変数のアドレスどうしは重ならない。
+// 大域変数はデータ領域に宣言の順に並び、配列のないこの言語では&a + iで
+// 隣の変数へ進むのが配列の代わりになるので、0でない数を足し引きしたポインタは
+// 同じ型のどの変数も指しうるとする。変数から読んだポインタや呼び出しの値も
+// どこから来たかわからない。関数はパースするたびに生成するので、
+// プログラム全体でアドレスを取らない変数を除くことはできない
+
+#define BASE_UNKNOWN -1 // どの変数を指すかわからない
+#define BASE_NONE -2    // まだ求めていない
+
+// 加減算nがポインタに定数0を足し引きするだけであれば、そのポインタを返す。
+// そうでなければNULLを返す。ポインタに足す整数もA_SCALEでポインタの型に
+// なるので、大きさを掛けた値と、それを畳み込んだ定数はポインタとみなさない
+static struct irinst *ptrarg(struct irinst *n)
+{
+  struct irinst *a, *ptr = NULL, *off = NULL;
+
+  for (int i = 0; i < n->nargs; i++)
+  {
+    a = n->args[i];
+    if (ptrtype(a->type) && a->op != IR_SCALE && a->op != IR_CONST)
+      ptr = a;
+    else
+      off = a;
+  }
+  if (ptr == NULL || off == NULL || off->op != IR_CONST || off->val != 0)
+    return (NULL);
+  return (ptr);
+}
+
+// 値vのポインタの元になった変数のシンボルIDを返す。φは求めた値を使う
+static int basewalk(struct irinst *v)
+{
+  v = ir_resolve(v);
+  switch (v->op)
+  {
+  case IR_PHI:
+    return (v->base);
+  case IR_ADDR:
+    return (v->id);
+  case IR_ADD:
+  case IR_SUB:
+    if ((v = ptrarg(v)) == NULL)
+      return (BASE_UNKNOWN);
+    return (basewalk(v));
+  case IR_STORE:
+    return (basewalk(v->args[0]));
+  }
+  return (BASE_UNKNOWN);
+}
+
+// ポインタの値vが指す変数のシンボルIDを返す。わからなければ-1を返す。
+// 構築中はφの引数がそろっていないので、φを通る値はわからないとする
+int ir_ptrbase(struct irinst *v)
+{
+  int base;
+
+  if (!ptrtype(v->type))
+    return (BASE_UNKNOWN);
+  base = basewalk(v);
+  return (base == BASE_NONE ? BASE_UNKNOWN : base);
+}
+
+// 2つの元の変数の交わり。まだ求めていないものは相手に合わせる
+static int meet(int a, int b)
+{
+  if (a == BASE_NONE)
+    return (b);
+  if (b == BASE_NONE)
+    return (a);
+  return (a == b ? a : BASE_UNKNOWN);
+}
+
+// ポインタを通した読み書きnのポインタの値を返す
+static struct irinst *accessptr(struct irinst *n)
+{
+  return (n->op == IR_DEREF ? n->args[0] : n->args[1]);
+}
+
+// ポインタを通した読み書きnが触れる値の型を返す。void *ではP_VOIDを返す
+static int accesstype(struct irinst *n)
+{
+  return (value_at(accessptr(n)->type));
+}
+
+// 命令nが大域変数idに触れうればtrueを返す。
+// nはIR_DEREF、IR_STDEREF、IR_CALLのどれか。呼び出しはどの変数にも触れうる
+int ir_mayalias(struct irinst *n, int id)
+{
+  int type, base;
+
+  if (n->op == IR_CALL)
+    return (1);
+  type = accesstype(n);
+  if (type != P_VOID && type != Gsym[id].type)
+    return (0);
+  base = ir_ptrbase(accessptr(n));
+  return (base == BASE_UNKNOWN || base == id);
+}
+
+// ポインタを通した2つの読み書きaとbが同じメモリに触れうればtrueを返す
+int ir_accessalias(struct irinst *a, struct irinst *b)
+{
+  int ta = accesstype(a), tb = accesstype(b), ba, bb;
+
+  if (ta != tb && ta != P_VOID && tb != P_VOID)
+    return (0);
+  ba = ir_ptrbase(accessptr(a));
+  bb = ir_ptrbase(accessptr(b));
+  return (ba == BASE_UNKNOWN || bb == BASE_UNKNOWN || ba == bb);
+}
+
+// 読み書きnが関数の読み書きする変数のどれにも触れなければtrueを返す
+int ir_noalias(struct irfunc *fn, struct irinst *n)
+{
+  for (int i = 0; i < fn->nvars; i++)
+    if (ir_mayalias(n, fn->varids[i]))
+      return (0);
+  return (1);
+}
+
+// 関数fnのφのポインタが指す変数を求める。
+// まだ求めていない状態から始め、変わらなくなるまで交わりを取り直す。
+// ループを回るポインタは、入口の値とループで代入し直した値の交わりになる
+void ir_alias(struct irfunc *fn)
+{
+  struct irblock *b;
+  struct irinst *n, **phis;
+  int changed, base, nphis = 0;
+
+  if ((phis = malloc((fn->ninsts + 1) * sizeof(struct irinst *))) == NULL)
+    fatal("メモリが確保できませんでした。ir_alias()");
+  for (b = fn->entry; b; b = b->next)
+    for (n = b->phis; n; n = n->next)
+    {
+      n->base = BASE_NONE;
+      if (ptrtype(n->type))
+        phis[nphis++] = n;
+      else
+        n->base = BASE_UNKNOWN;
+    }
+  do
+  {
+    changed = 0;
+    for (int i = 0; i < nphis; i++)
+    {
+      n = phis[i];
+      base = BASE_NONE;
+      for (int j = 0; j < n->nargs; j++)
+        base = meet(base, basewalk(n->args[j]));
+      if (base != n->base)
+      {
+        n->base = base;
+        changed = 1;
+      }
+    }
+  } while (changed);
+  for (int i = 0; i < nphis; i++)
+    if (phis[i]->base == BASE_NONE)
+      phis[i]->base = BASE_UNKNOWN;
+  free(phis);
+
+  // -ftime-reportでは、ほかの変数と独立とわかった読み書きを数える。
+  // 指す変数が1つにわかったものと、関数の変数のどれにも触れないもの
+  if (!O_timereport)
+    return;
+  for (b = fn->entry; b; b = b->next)
+    for (n = b->head; n; n = n->next)
+      if (n->op == IR_DEREF || n->op == IR_STDEREF)
+      {
+        stats_count(ST_DEREFS, 1);
+        if (ir_ptrbase(accessptr(n)) != BASE_UNKNOWN || ir_noalias(fn, n))
+          stats_count(ST_NOALIAS, 1);
+      }
+}
@@ -0,0 +1,99 @@
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+
+// メモリアリーナ
+//
+// ASTノードやシンボル名など、1回のコンパイルの間だけ生きている
+// メモリはアリーナから確保する。個別には解放せず、
+// 次のコンパイルの開始時にarena_reset()でまとめて巻き戻す。
+// ブロックは解放せずに再利用するため、コンパイルサーバでは
+// 2回目以降のリクエストでmalloc()がほとんど呼ばれない。
+
+#define ARENABLOCK (64 * 1024) // ブロックの標準の大きさ
+#define ARENAALIGN 16          // 確保するメモリの境界
+
+struct arenablock
+{
+  struct arenablock *next; // 次のブロック
+  size_t size;             // data[]の大きさ
+  size_t used;             // data[]の使用済みバイト数
+  char data[];
+};
+
+static struct arenablock *First;   // 最初のブロック
+static struct arenablock *Current; // 確保中のブロック
+static size_t Arenabytes;          // 確保したバイト数の合計
+
+// 新規ブロックをmalloc()してCurrentの後ろにつなぐ
+static struct arenablock *newblock(size_t size)
+{
+  struct arenablock *b;
+
+  if (size < ARENABLOCK)
+    size = ARENABLOCK;
+  if ((b = malloc(sizeof(struct arenablock) + size)) == NULL)
+    fatal("メモリが確保できませんでした。newblock()");
+  b->size = size;
+  b->used = 0;
+  if (Current)
+  {
+    b->next = Current->next;
+    Current->next = b;
+  }
+  else
+  {
+    b->next = NULL;
+    First = b;
+  }
+  return (b);
+}
+
+// アリーナからsizeバイトを確保する
+void *arena_alloc(size_t size)
+{
+  void *p;
+
+  size = (size + ARENAALIGN - 1) & ~(size_t)(ARENAALIGN - 1);
+
+  // 今のブロックに入らなければ、巻き戻し済みの次のブロックか新規ブロックへ移る
+  while (Current == NULL || Current->used + size > Current->size)
+  {
+    if (Current && Current->next)
+    {
+      Current = Current->next;
+      Current->used = 0;
+    }
+    else
+      Current = newblock(size);
+  }
+
+  p = Current->data + Current->used;
+  Current->used += size;
+  Arenabytes += size;
+  return (p);
+}
+
+// 文字列をアリーナへ複製する
+char *arena_strdup(char *s)
+{
+  size_t len = strlen(s) + 1;
+
+  return (memcpy(arena_alloc(len), s, len));
+}
+
+// アリーナから確保したメモリをすべて解放する。
+// ブロックは次のコンパイルで再利用する
+void arena_reset(void)
+{
+  Current = First;
+  if (Current)
+    Current->used = 0;
+  Arenabytes = 0;
+}
+
+// 最後にリセットしてから確保したバイト数を返す
+size_t arena_bytes(void)
+{
+  return (Arenabytes);
+}
@@ -0,0 +1,108 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// ベンチマークのプログラムに共通の関数
+
+#define WORKPATHLEN 256
+
+// 生成した入力、出力、実行ファイルを置く作業ディレクトリを作って返す。
+// ソースツリーを汚さないように、環境変数BENCHDIRがなければ
+// TMPDIR(なければ/tmp)の下にユーザごとのディレクトリを使う
+static inline char *workdir(void)
+{
+  static char dir[WORKPATHLEN];
+  char *tmp;
+
+  if (dir[0])
+    return (dir);
+  if (getenv("BENCHDIR"))
+    snprintf(dir, sizeof(dir), "%s", getenv("BENCHDIR"));
+  else
+  {
+    if ((tmp = getenv("TMPDIR")) == NULL)
+      tmp = "/tmp";
+    snprintf(dir, sizeof(dir), "%s/tinycc-bench-%d", tmp, (int)getuid());
+  }
+  mkdir(dir, 0755);
+  return (dir);
+}
+
+// 単調増加する時計の現在時刻をミリ秒で返す
+static inline double nowms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6);
+}
+
+// argvのコマンドを子プロセスで実行し、そのプロセスIDを返す。
+// outがNULLでなければ標準出力をそこへ向ける。
+// goがNULLでなければ、子プロセスはパイプgo[0]から1バイト読めるまでexecを待つ
+static inline pid_t spawn(char **argv, char *out, int *go)
+{
+  int fd;
+  char c;
+  pid_t pid;
+
+  if ((pid = fork()) == -1)
+  {
+    perror("fork");
+    exit(1);
+  }
+  if (pid == 0)
+  {
+    if (go)
+    {
+      close(go[1]);
+      if (read(go[0], &c, 1) != 1)
+        _exit(127);
+    }
+    if (out != NULL)
+    {
+      if ((fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+        _exit(127);
+      dup2(fd, 1);
+      close(fd);
+    }
+    execvp(argv[0], argv);
+    fprintf(stderr, "%s を実行できません:%s\n", argv[0], strerror(errno));
+    _exit(127);
+  }
+  if (go)
+    close(go[0]);
+  return (pid);
+}
+
+// 子プロセスpidの終了を待ち、waitpid()のステータスを返す。
+// ruがNULLでなければ子プロセスの資源の使用量を入れる
+static inline int reap(pid_t pid, struct rusage *ru)
+{
+  struct rusage r;
+  int status;
+
+  if (wait4(pid, &status, 0, ru ? ru : &r) == -1)
+  {
+    perror("wait4");
+    exit(1);
+  }
+  return (status);
+}
+
+// argvのコマンドを実行して終了を待つ。outがNULLでなければ標準出力をそこへ向ける。
+// ruがNULLでなければ子プロセスの資源の使用量を入れる。
+// 終了ステータスが0でなければ-1を返す
+static inline int runcmd(char **argv, char *out, struct rusage *ru)
+{
+  int status = reap(spawn(argv, out, NULL), ru);
+
+  return (WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1);
+}
@@ -0,0 +1,253 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+// 生成したコードの速さのベンチマーク
+//
+//   codegen [-r 回数] <コンパイラ> <カーネルのディレクトリ> <実行時ライブラリ>
+//
+// カーネルをそれぞれコンパイラ(最適化なしと-O1)と、cc -O0、cc -O2でコンパイルして
+// 実行時ライブラリとリンクし、実行時間と実行した命令数を並べて表示する。
+// コンパイラの仮想機械(--run)で実行したときも同じように測る。
+// 実行時間は何回か走らせたうちの最短の時間で、命令数は
+// perf_event_open()で数える。数えられない環境では n/a と表示する。
+// コンパイラの出力と仮想機械の実行結果はcc -O0のものと比べて確かめる。
+
+#define PATHLEN (WORKPATHLEN + 64)
+
+// カーネルとその内容
+static struct kernel
+{
+  char *name;
+  char *what;
+} Kernels[] = {
+    {"fib", "フィボナッチ数列の繰り返し (加算、コピー)"},
+    {"primes", "試し割りの素数判定 (入れ子のループ、除算)"},
+    {"ptrwalk", "ポインタを通した読み書き (間接参照)"},
+    {"reduce", "積和のリダクション (算術演算、レジスタ)"},
+    {"calls", "小さな関数の呼び出し (呼び出し、入口と出口)"},
+};
+
+#define NBUILDS 5 // 比べる作り方: comp1、cc -O0、cc -O2、comp1 -O1、comp1 --run
+#define OPT 3     // コンパイラの中間表現で最適化する作り方
+#define VM 4      // 仮想機械で実行する作り方
+
+// 結果を表に並べる順
+static int Order[NBUILDS] = {0, OPT, 1, 2, VM};
+
+// 1つの実行ファイルの計測結果
+struct result
+{
+  double ms;      // 最短の実行時間(ミリ秒)
+  long long insn; // 実行した命令数。数えられなければ-1
+};
+
+// 子プロセスのユーザ空間の命令数を数えるカウンタを開く。
+// 子プロセスがexecしたときに数え始める。開けなければ-1を返す
+static int opencounter(pid_t pid)
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+  attr.disabled = 1;
+  attr.enable_on_exec = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0));
+}
+
+// argvのコマンドを実行して終了を待ち、waitpid()のステータスを返す。
+// outがNULLでなければ標準出力をそこへ向ける。
+// insnがNULLでなければ実行した命令数を返す
+static int run(char **argv, char *out, long long *insn)
+{
+  int status, go[2], counter = -1;
+  char c = 0;
+  pid_t pid;
+
+  // 子プロセスはカウンタを開き終わるまでexecを待つ
+  if (pipe(go) == -1)
+  {
+    perror("pipe");
+    exit(1);
+  }
+  pid = spawn(argv, out, go);
+  if (insn)
+    counter = opencounter(pid);
+  if (write(go[1], &c, 1) != 1)
+    perror("write");
+  close(go[1]);
+
+  status = reap(pid, NULL);
+  if (insn)
+  {
+    *insn = -1;
+    if (counter != -1 && read(counter, insn, sizeof(*insn)) != sizeof(*insn))
+      *insn = -1;
+  }
+  if (counter != -1)
+    close(counter);
+  return (status);
+}
+
+// カーネルをb番目の作り方で実行ファイルexeにする。
+// コンパイラではアセンブリをasmfileへ出力する。仮想機械では何もしない
+static void build(int b, char *comp, char *src, char *runtime, char *exe,
+                  char *asmfile)
+{
+  if (b == VM)
+    return;
+  if (b == 0 || b == OPT)
+  {
+    char *compargv[] = {comp, b == OPT ? "-O1" : "-O0", "-o", asmfile, src, NULL};
+    char *ccargv[] = {"cc", "-z", "noexecstack", "-o", exe, asmfile, runtime, NULL};
+    if (run(compargv, NULL, NULL) != 0 || run(ccargv, NULL, NULL) != 0)
+    {
+      fprintf(stderr, "%s をコンパイルできません\n", src);
+      exit(1);
+    }
+    return;
+  }
+
+  // ccには暗黙の関数宣言とvoid main()を許してもらう
+  char *ccargv[] = {"cc", "-std=gnu89", "-w", b == 1 ? "-O0" : "-O2",
+                    "-o", exe, src, runtime, NULL};
+  if (run(ccargv, NULL, NULL) != 0)
+  {
+    fprintf(stderr, "%s を cc でコンパイルできません\n", src);
+    exit(1);
+  }
+}
+
+// argvのコマンドをreps回走らせて計測し、最後の出力をoutへ残す。
+// void main()の終了ステータスは不定なので、シグナルで止まったときだけ失敗とする
+static void measure(char **argv, char *out, int reps, struct result *r)
+{
+  long long insn;
+  double t;
+  int status;
+
+  r->ms = 1e30;
+  r->insn = -1;
+  for (int i = 0; i < reps; i++)
+  {
+    t = nowms();
+    status = run(argv, out, &insn);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) == 127)
+    {
+      fprintf(stderr, "%s が失敗しました\n", argv[0]);
+      exit(1);
+    }
+    t = nowms() - t;
+    if (t < r->ms)
+      r->ms = t;
+    r->insn = insn;
+  }
+}
+
+// 2つのファイルの中身が同じであればtrueを返す
+static int samefile(char *a, char *b)
+{
+  FILE *fa, *fb;
+  int ca, cb;
+
+  if ((fa = fopen(a, "r")) == NULL)
+    return (0);
+  if ((fb = fopen(b, "r")) == NULL)
+  {
+    fclose(fa);
+    return (0);
+  }
+  do
+  {
+    ca = getc(fa);
+    cb = getc(fb);
+  } while (ca == cb && ca != EOF);
+  fclose(fa);
+  fclose(fb);
+  return (ca == cb);
+}
+
+// 命令数を百万単位で書き出す。数えられなければn/a
+static void printinsn(long long insn)
+{
+  if (insn < 0)
+    printf(" %10s", "n/a");
+  else
+    printf(" %10.1f", insn / 1e6);
+}
+
+static void usage(char *prog)
+{
+  fprintf(stderr, "Usage: %s [-r reps] compiler kerneldir runtime.c\n", prog);
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  char src[PATHLEN], asmfile[PATHLEN];
+  char exe[NBUILDS][PATHLEN], out[NBUILDS][PATHLEN];
+  struct result r[NBUILDS];
+  int reps = 3, opt, failed = 0;
+  struct kernel *k;
+
+  while ((opt = getopt(argc, argv, "r:")) != -1)
+  {
+    if (opt != 'r' || (reps = atoi(optarg)) < 1)
+      usage(argv[0]);
+  }
+  if (argc - optind != 3)
+    usage(argv[0]);
+
+  printf("%-8s %10s %10s %10s %10s %10s %7s %10s %10s %10s %10s %10s  %s\n",
+         "kernel", "comp1 ms", "O1 ms", "-O0 ms", "-O2 ms", "vm ms", "/-O0",
+         "comp1 Mi", "O1 Mi", "-O0 Mi", "-O2 Mi", "vm Mi", "check");
+  for (int i = 0; i < sizeof(Kernels) / sizeof(Kernels[0]); i++)
+  {
+    k = &Kernels[i];
+    snprintf(src, sizeof(src), "%s/%s.c", argv[optind + 1], k->name);
+    for (int b = 0; b < NBUILDS; b++)
+    {
+      snprintf(exe[b], PATHLEN, "%s/%s-%d", workdir(), k->name, b);
+      snprintf(out[b], PATHLEN, "%s/%s-%d.out", workdir(), k->name, b);
+      snprintf(asmfile, PATHLEN, "%s/%s-%d.s", workdir(), k->name, b);
+      build(b, argv[optind], src, argv[optind + 2], exe[b], asmfile);
+      char *exeargv[] = {exe[b], NULL};
+      char *vmargv[] = {argv[optind], "--run", src, NULL};
+      measure(b == VM ? vmargv : exeargv, out[b], reps, &r[b]);
+    }
+
+    printf("%-8s", k->name);
+    for (int b = 0; b < NBUILDS; b++)
+      printf(" %10.2f", r[Order[b]].ms);
+    printf(" %6.2fx", r[1].ms > 0 ? r[0].ms / r[1].ms : 0.0);
+    for (int b = 0; b < NBUILDS; b++)
+      printinsn(r[Order[b]].insn);
+    if (samefile(out[0], out[1]) && samefile(out[0], out[2]) &&
+        samefile(out[0], out[OPT]) && samefile(out[0], out[VM]))
+      printf("  ok\n");
+    else
+    {
+      printf("  MISMATCH\n");
+      failed = 1;
+    }
+  }
+
+  printf("\n");
+  for (int i = 0; i < sizeof(Kernels) / sizeof(Kernels[0]); i++)
+    printf("%-8s %s\n", Kernels[i].name, Kernels[i].what);
+  printf("O1: comp1 -O1  Mi: 実行した命令数(百万)  /-O0: comp1のcc -O0に対する実行時間の比\n");
+  return (failed);
+}
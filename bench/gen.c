@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ベンチマーク用の入力の生成器
+//
+//   gen <種類> <大きさ>
+//
+// コンパイラが受け付ける範囲のCのソースを標準出力へ書き出す。
+// 種類ごとにコンパイラの別の部分へ負荷をかける。
+//
+//   globals  大きさの数のグローバル変数と、それぞれを使う文
+//   expr     大きさの数の項を持つ1つの長い式
+//   literals 大きさの数の異なる大きな整数リテラル
+//   nest     大きさの深さまで入れ子にしたif文とwhile文
+//   funcs    大きさの数の小さな関数と、それぞれの呼び出し
+//   bigfunc  大きさの数の文を持つ1つの関数
+
+// グローバル変数をたくさん宣言して使う
+static void globals(int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    printf("long g%d;\n", i);
+  printf("void main()\n{\n  g0 = 1;\n");
+  for (i = 1; i < n; i++)
+    printf("  g%d = g%d + %d;\n", i, i - 1, i);
+  printf("  printint(g%d);\n}\n", n - 1);
+}
+
+// 項がn個ある長い式
+static void expr(int n)
+{
+  char *term[] = {"a", "b * 3", "c", "7", "a * b"};
+  int i;
+
+  printf("long a;\nlong b;\nlong c;\nlong x;\n");
+  printf("void main()\n{\n  a = 1;\n  b = 2;\n  c = 3;\n  x = a");
+  for (i = 1; i < n; i++)
+    printf("%s%s%s", (i % 8) ? "" : "\n   ", (i % 2) ? " + " : " - ",
+           term[i % 5]);
+  printf(";\n  printint(x);\n}\n");
+}
+
+// 異なる大きな整数リテラルをn個使う。
+// ARMではリテラルプールへ置かれる大きさにしておく
+static void literals(int n)
+{
+  int i;
+
+  printf("long x;\nlong y;\n");
+  printf("void main()\n{\n  x = 0;\n");
+  for (i = 0; i < n; i++)
+    printf("  y = %d;\n  x = x + y;\n", 100000 + i * 7);
+  printf("  printint(x);\n}\n");
+}
+
+// 深さnまでif文とwhile文を交互に入れ子にする
+static void nest(int n)
+{
+  int i;
+
+  printf("long g0;\nlong g1;\n");
+  printf("void main()\n{\n  g0 = 0;\n  g1 = %d;\n", n);
+  for (i = 0; i < n; i++)
+  {
+    if (i % 2)
+      printf("  while (g1 > %d) { g1 = g1 - 1;\n", n - i);
+    else
+      printf("  if (g0 < %d) {\n", i + 1);
+  }
+  printf("  g0 = g0 + 1;\n");
+  for (i = 0; i < n; i++)
+    printf("  }\n");
+  printf("  printint(g0);\n}\n");
+}
+
+// 小さな関数をn個定義してそれぞれを呼び出す
+static void funcs(int n)
+{
+  int i;
+
+  printf("long g;\n");
+  for (i = 0; i < n; i++)
+    printf("long f%d() { g = g + %d; if (g > 1000) { g = g - 1000; } return(g); }\n",
+           i, i);
+  printf("void main()\n{\n  g = 0;\n");
+  for (i = 0; i < n; i++)
+    printf("  f%d(%d);\n", i, i);
+  printf("  printint(g);\n}\n");
+}
+
+// n個の文を持つ1つの関数
+static void bigfunc(int n)
+{
+  char *stmt[] = {
+      "a = a + b;",
+      "b = b - 1;",
+      "if (a > b) { c = c + 1; } else { c = c - 1; }",
+      "while (c > 100) { c = c - 7; }",
+      "p = &a; b = *p + c * 2;",
+  };
+  int i;
+
+  printf("long a;\nlong b;\nlong c;\nlong *p;\n");
+  printf("void main()\n{\n  a = 1;\n  b = 2;\n  c = 3;\n");
+  for (i = 0; i < n; i++)
+    printf("  %s\n", stmt[i % 5]);
+  printf("  printint(a);\n}\n");
+}
+
+int main(int argc, char *argv[])
+{
+  char *kind;
+  int n;
+
+  if (argc != 3 || (n = atoi(argv[2])) < 1)
+  {
+    fprintf(stderr, "Usage: %s globals|expr|literals|nest|funcs|bigfunc size\n",
+            argv[0]);
+    exit(1);
+  }
+
+  kind = argv[1];
+  if (!strcmp(kind, "globals"))
+    globals(n);
+  else if (!strcmp(kind, "expr"))
+    expr(n);
+  else if (!strcmp(kind, "literals"))
+    literals(n);
+  else if (!strcmp(kind, "nest"))
+    nest(n);
+  else if (!strcmp(kind, "funcs"))
+    funcs(n);
+  else if (!strcmp(kind, "bigfunc"))
+    bigfunc(n);
+  else
+  {
+    fprintf(stderr, "不明な種類です:%s\n", kind);
+    exit(1);
+  }
+  return (0);
+}
@@ -0,0 +1,32 @@
+long g;
+long n;
+long t;
+long i;
+
+long step()
+{
+  g = g + 3;
+  if (g > 1000)
+  {
+    g = g - 1000;
+  }
+  return (g);
+}
+
+long twice()
+{
+  step(0);
+  return (step(0));
+}
+
+void main()
+{
+  g = 0;
+  n = 0;
+  for (i = 0; i < 6000000; i = i + 1)
+  {
+    t = twice(0);
+    n = n + t;
+  }
+  printint(n);
+}
@@ -0,0 +1,24 @@
+long a;
+long b;
+long t;
+long i;
+long k;
+long sum;
+
+void main()
+{
+  sum = 0;
+  for (k = 0; k < 200000; k = k + 1)
+  {
+    a = 0;
+    b = 1;
+    for (i = 0; i < 90; i = i + 1)
+    {
+      t = a + b;
+      a = b;
+      b = t;
+    }
+    sum = sum + a / 1000000;
+  }
+  printint(sum);
+}
@@ -0,0 +1,31 @@
+long n;
+long d;
+long q;
+long sq;
+long prime;
+long count;
+
+void main()
+{
+  count = 0;
+  for (n = 2; n < 60000; n = n + 1)
+  {
+    prime = 1;
+    d = 2;
+    sq = 4;
+    while (sq <= n)
+    {
+      q = n / d;
+      q = q * d;
+      if (q == n)
+      {
+        prime = 0;
+        sq = n;
+      }
+      d = d + 1;
+      sq = d * d;
+    }
+    count = count + prime;
+  }
+  printint(count);
+}
@@ -0,0 +1,30 @@
+long x;
+long y;
+long z;
+long *p;
+long *q;
+long *r;
+long i;
+
+void main()
+{
+  x = 1;
+  y = 0;
+  z = 0;
+  for (i = 0; i < 10000000; i = i + 1)
+  {
+    p = &x;
+    q = &y;
+    r = q;
+    *q = *r + *p;
+    *p = *p + 1;
+    if (*p > 1000)
+    {
+      *p = 1;
+      r = &z;
+      *r = *r + *q / 1000;
+    }
+  }
+  printint(y);
+  printint(z);
+}
@@ -0,0 +1,22 @@
+long i;
+long c;
+long s1;
+long s2;
+long s3;
+
+void main()
+{
+  s1 = 0;
+  s2 = 0;
+  s3 = 0;
+  for (i = 0; i < 3000000; i = i + 1)
+  {
+    c = i - i / 100 * 100;
+    s1 = s1 + i * 3 - c;
+    s2 = s2 + i * c / 1024 - c * 7;
+    s3 = s3 + c * c - s1 / 4096;
+  }
+  printint(s1);
+  printint(s2);
+  printint(s3);
+}
@@ -0,0 +1,254 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+// コンパイラのベンチマークの実行
+//
+//   run [-u] [-t 閾値%] [-r 回数] <生成器> <コンパイラ> <ベースライン>
+//
+// 生成器で入力の種類と大きさごとにソースを作り、コンパイラを
+// 何回か走らせて、最短の時間、最大の常駐メモリ、出力の大きさを記録する。
+// 結果をベースラインのJSONと比べ、閾値を超えて悪くなったものがあれば
+// 計測し直して確かめ、それでも悪ければ終了ステータスを1にする。
+// -uでは結果でベースラインを書き換える。
+
+#define MAXRESULTS 64
+#define NAMELEN 64
+#define PATHLEN (WORKPATHLEN + NAMELEN + 16)
+#define TIMEFLOOR 1.0  // これより小さい時間の差(ミリ秒)は誤差とみなす
+#define RSSFLOOR 1024  // これより小さい常駐メモリの差(KB)は誤差とみなす
+
+// 入力の種類と、それぞれで試す大きさ
+static struct workload
+{
+  char *kind;
+  int sizes[3];
+} Workloads[] = {
+    {"globals", {250, 500, 1000}},
+    {"expr", {5000, 10000, 20000}},
+    {"nest", {125, 250, 500}},
+    {"funcs", {250, 500, 1000}},
+    {"bigfunc", {5000, 10000, 20000}},
+};
+
+// 1つの入力の計測結果
+struct result
+{
+  char name[NAMELEN];
+  double ms;    // 最短のコンパイル時間(ミリ秒)
+  long rsskb;   // 最大の常駐メモリ(KB)
+  long bytes;   // 出力の大きさ
+};
+
+static struct result Results[MAXRESULTS], Baseline[MAXRESULTS];
+static int Nresults, Nbaseline;
+
+// 生成済みの入力についてコンパイラをreps回走らせ、結果をrへまとめる。
+// これまでの結果より速いか大きければ更新する
+static void compile(char *comp, struct result *r, int reps)
+{
+  char src[PATHLEN], out[PATHLEN];
+  double t;
+  struct rusage ru;
+  struct stat st;
+
+  snprintf(src, sizeof(src), "%s/%s.c", workdir(), r->name);
+  snprintf(out, sizeof(out), "%s/%s.s", workdir(), r->name);
+  char *compargv[] = {comp, "-o", out, src, NULL};
+  for (int i = 0; i < reps; i++)
+  {
+    t = nowms();
+    if (runcmd(compargv, NULL, &ru) == -1)
+    {
+      fprintf(stderr, "%s をコンパイルできません\n", src);
+      exit(1);
+    }
+    t = nowms() - t;
+    if (t < r->ms)
+      r->ms = t;
+    if (ru.ru_maxrss > r->rsskb)
+      r->rsskb = ru.ru_maxrss;
+  }
+  r->bytes = (stat(out, &st) == 0) ? st.st_size : 0;
+}
+
+// 入力を1つ生成し、コンパイラをreps回走らせて計測する
+static void measure(char *gen, char *comp, char *kind, int size, int reps)
+{
+  char src[PATHLEN], sizestr[16];
+  struct result *r = &Results[Nresults++];
+
+  snprintf(r->name, NAMELEN, "%s-%d", kind, size);
+  snprintf(src, sizeof(src), "%s/%s.c", workdir(), r->name);
+  snprintf(sizestr, sizeof(sizestr), "%d", size);
+
+  char *genargv[] = {gen, kind, sizestr, NULL};
+  if (runcmd(genargv, src, NULL) == -1)
+  {
+    fprintf(stderr, "%s を生成できません\n", src);
+    exit(1);
+  }
+
+  r->ms = 1e30;
+  r->rsskb = 0;
+  compile(comp, r, reps);
+}
+
+// ベースラインを読み込む。1行に1つの結果がある形式だけを読む
+static void readbaseline(char *file)
+{
+  struct result *r;
+  char line[256];
+  FILE *f;
+
+  if ((f = fopen(file, "r")) == NULL)
+    return;
+  while (fgets(line, sizeof(line), f) != NULL && Nbaseline < MAXRESULTS)
+  {
+    r = &Baseline[Nbaseline];
+    if (sscanf(line, " {\"name\": \"%63[^\"]\", \"ms\": %lf, \"rss_kb\": %ld, \"bytes\": %ld",
+               r->name, &r->ms, &r->rsskb, &r->bytes) == 4)
+      Nbaseline++;
+  }
+  fclose(f);
+}
+
+// 結果をJSONで書き出す
+static void writeresults(char *file)
+{
+  FILE *f;
+
+  if ((f = fopen(file, "w")) == NULL)
+  {
+    fprintf(stderr, "%s を作成できません:%s\n", file, strerror(errno));
+    exit(1);
+  }
+  fprintf(f, "[\n");
+  for (int i = 0; i < Nresults; i++)
+    fprintf(f, "  {\"name\": \"%s\", \"ms\": %.3f, \"rss_kb\": %ld, \"bytes\": %ld}%s\n",
+            Results[i].name, Results[i].ms, Results[i].rsskb, Results[i].bytes,
+            i + 1 < Nresults ? "," : "");
+  fprintf(f, "]\n");
+  fclose(f);
+}
+
+// ベースラインから名前で結果を探す
+static struct result *findbase(char *name)
+{
+  for (int i = 0; i < Nbaseline; i++)
+    if (!strcmp(Baseline[i].name, name))
+      return (&Baseline[i]);
+  return (NULL);
+}
+
+// 変化率を百分率で返す
+static double pct(double now, double base)
+{
+  return (base > 0 ? 100 * (now - base) / base : 0);
+}
+
+// 結果がベースラインより閾値を超えて悪ければtrueを返す
+static int worse(struct result *r, struct result *b, double threshold)
+{
+  return ((pct(r->ms, b->ms) > threshold && r->ms - b->ms > TIMEFLOOR) ||
+          (pct(r->rsskb, b->rsskb) > threshold && r->rsskb - b->rsskb > RSSFLOOR) ||
+          pct(r->bytes, b->bytes) > threshold);
+}
+
+// 結果をベースラインと比べて表にする。悪化した数を返す。
+// 悪化したものは一時的な揺らぎでないか計測し直して確かめる
+static int compare(char *comp, double threshold, int reps)
+{
+  struct result *r, *b;
+  int regressions = 0;
+  char *status;
+
+  printf("%-16s %10s %8s %10s %8s %10s %8s  %s\n", "input", "ms", "Δ%",
+         "rss KB", "Δ%", "bytes", "Δ%", "status");
+  for (int i = 0; i < Nresults; i++)
+  {
+    r = &Results[i];
+    if ((b = findbase(r->name)) == NULL)
+    {
+      printf("%-16s %10.3f %8s %10ld %8s %10ld %8s  new\n", r->name, r->ms, "",
+             r->rsskb, "", r->bytes, "");
+      continue;
+    }
+
+    status = "ok";
+    if (worse(r, b, threshold))
+      compile(comp, r, reps * 2);
+    if (worse(r, b, threshold))
+    {
+      status = "REGRESSION";
+      regressions++;
+    }
+    printf("%-16s %10.3f %+7.1f%% %10ld %+7.1f%% %10ld %+7.1f%%  %s\n", r->name,
+           r->ms, pct(r->ms, b->ms), r->rsskb, pct(r->rsskb, b->rsskb),
+           r->bytes, pct(r->bytes, b->bytes), status);
+  }
+  return (regressions);
+}
+
+static void usage(char *prog)
+{
+  fprintf(stderr, "Usage: %s [-u] [-t threshold%%] [-r reps] generator compiler baseline.json\n",
+          prog);
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  double threshold = 25;
+  int update = 0, reps = 5, opt, regressions;
+  char results[PATHLEN];
+
+  while ((opt = getopt(argc, argv, "ut:r:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'u':
+      update = 1;
+      break;
+    case 't':
+      threshold = atof(optarg);
+      break;
+    case 'r':
+      if ((reps = atoi(optarg)) < 1)
+        usage(argv[0]);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (argc - optind != 3)
+    usage(argv[0]);
+
+  for (int i = 0; i < sizeof(Workloads) / sizeof(Workloads[0]); i++)
+    for (int j = 0; j < 3; j++)
+      measure(argv[optind], argv[optind + 1], Workloads[i].kind,
+              Workloads[i].sizes[j], reps);
+
+  snprintf(results, sizeof(results), "%s/results.json", workdir());
+  writeresults(results);
+  if (update)
+  {
+    writeresults(argv[optind + 2]);
+    printf("ベースラインを %s に書き出しました\n", argv[optind + 2]);
+    return (0);
+  }
+
+  readbaseline(argv[optind + 2]);
+  regressions = compare(argv[optind + 1], threshold, reps);
+  if (regressions)
+  {
+    printf("%d 個の入力が閾値 %.0f%% を超えて悪化しました\n", regressions, threshold);
+    return (1);
+  }
+  return (0);
+}
@@ -0,0 +1,170 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+// コンパイル時間の伸び方の検査
+//
+//   scaling [-b 上限] [-r 回数] <生成器> <コンパイラ>
+//
+// 入力の次元(シンボル、リテラル、文、入れ子の深さ)ごとに大きさを
+// 倍々に増やしてコンパイル時間を測り、log(時間)とlog(大きさ)の
+// 最小二乗法で伸びの指数を求める。線形であれば1、2乗であれば2になる。
+// 最適化なしと-O1のそれぞれで測り、
+// どれかの指数が上限を超えれば終了ステータスを1にする。
+//
+// 時間からはプロセスの起動などの固定の時間を差し引いておく。
+// 固定の時間に近い計測は揺らぎで指数を大きく狂わせるので、
+// その何倍かに満たない大きさは当てはめに使わない。
+
+#define PATHLEN (WORKPATHLEN + 64)
+#define STEPS 5   // 1つの次元で測る大きさの数
+#define MINFIT 3  // 当てはめに必要な大きさの数
+#define FIXEDX 4  // 固定の時間のこの倍より短い計測は当てはめに使わない
+
+// 入力の次元と、それを伸ばす生成器の種類
+static struct dimension
+{
+  char *name;
+  char *kind;
+  int base; // 最初の大きさ。以後2倍ずつにする
+} Dimensions[] = {
+    {"symbols", "globals", 4000},
+    {"literals", "literals", 4000},
+    {"statements", "bigfunc", 4000},
+    {"nesting", "nest", 2000},
+};
+
+// 測る最適化のレベル
+static char *Levels[] = {"-O0", "-O1"};
+
+// 種類kindで大きさsizeの入力を生成し、最適化のレベルlevelでの
+// reps回のうち最短のコンパイル時間を返す
+static double measure(char *gen, char *comp, char *level, char *kind, int size,
+                      int reps)
+{
+  char src[PATHLEN], out[PATHLEN], sizestr[16];
+  double t, best = 1e30;
+
+  snprintf(src, sizeof(src), "%s/scale-%s-%d.c", workdir(), kind, size);
+  snprintf(out, sizeof(out), "%s/scale-%s-%d.s", workdir(), kind, size);
+  snprintf(sizestr, sizeof(sizestr), "%d", size);
+
+  char *genargv[] = {gen, kind, sizestr, NULL};
+  if (runcmd(genargv, src, NULL) == -1)
+  {
+    fprintf(stderr, "%s を生成できません\n", src);
+    exit(1);
+  }
+
+  char *compargv[] = {comp, level, "-o", out, src, NULL};
+  for (int i = 0; i < reps; i++)
+  {
+    t = nowms();
+    if (runcmd(compargv, NULL, NULL) == -1)
+    {
+      fprintf(stderr, "%s をコンパイルできません\n", src);
+      exit(1);
+    }
+    t = nowms() - t;
+    if (t < best)
+      best = t;
+  }
+  return (best);
+}
+
+// log(y)とlog(x)の最小二乗法の直線の傾きを返す
+static double slope(double *x, double *y, int n)
+{
+  double sx = 0, sy = 0, sxx = 0, sxy = 0, lx, ly;
+
+  for (int i = 0; i < n; i++)
+  {
+    lx = log(x[i]);
+    ly = log(y[i]);
+    sx += lx;
+    sy += ly;
+    sxx += lx * lx;
+    sxy += lx * ly;
+  }
+  return ((n * sxy - sx * sy) / (n * sxx - sx * sx));
+}
+
+static void usage(char *prog)
+{
+  fprintf(stderr, "Usage: %s [-b bound] [-r reps] generator compiler\n", prog);
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  double bound = 1.3, fixed, t, e, x[STEPS], y[STEPS];
+  int reps = 3, opt, failed = 0, size, n;
+  struct dimension *d;
+  char *gen, *comp;
+
+  while ((opt = getopt(argc, argv, "b:r:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'b':
+      bound = atof(optarg);
+      break;
+    case 'r':
+      if ((reps = atoi(optarg)) < 1)
+        usage(argv[0]);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (argc - optind != 2)
+    usage(argv[0]);
+  gen = argv[optind];
+  comp = argv[optind + 1];
+
+  for (int k = 0; k < sizeof(Levels) / sizeof(Levels[0]); k++)
+  {
+    // ほとんど空の入力の時間を固定の時間とする。揺らぎを抑えるため多めに走らせる
+    fixed = measure(gen, comp, Levels[k], "bigfunc", 1, reps * 3);
+    printf("%s 固定の時間 %.3f ms\n", Levels[k], fixed);
+
+    for (int i = 0; i < sizeof(Dimensions) / sizeof(Dimensions[0]); i++)
+    {
+      d = &Dimensions[i];
+      printf("%s %-10s", Levels[k], d->name);
+      n = 0;
+      for (int j = 0; j < STEPS; j++)
+      {
+        size = d->base << j;
+        t = measure(gen, comp, Levels[k], d->kind, size, reps);
+        if (t >= FIXEDX * fixed)
+        {
+          x[n] = size;
+          y[n++] = t - fixed;
+        }
+        printf(" %6d:%8.2fms", size, t);
+        fflush(stdout);
+      }
+      if (n < MINFIT)
+      {
+        printf("  短すぎて測れません\n");
+        continue;
+      }
+      e = slope(x, y, n);
+      printf("  指数 %.2f", e);
+      if (e > bound)
+      {
+        printf("  SUPERLINEAR (上限 %.2f)\n", bound);
+        failed = 1;
+      }
+      else
+        printf("  ok\n");
+    }
+  }
+  return (failed);
+}
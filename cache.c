@@ -0,0 +1,245 @@
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// コンパイル結果のキャッシュ
+//
+// 入力のバイト列、コンパイラのバージョン、バックエンド、
+// コンパイルごとのオプションからハッシュ値を作り、
+// それをファイル名としてキャッシュディレクトリに出力を保存しておく。
+// 同じキーでコンパイルするときは字句解析もせずに保存した出力をコピーする。
+//
+// 書き込みは一時ファイルに書いてからrename()するので、
+// 複数のコンパイラが同時に同じエントリを書いても壊れない。
+// ヒットしたエントリは更新時刻を新しくしておき、
+// 合計サイズが上限を超えれば更新時刻の古い順に削除する(LRU)。
+// ヒットとミスの回数はstatsファイルにflock()を取って数える。
+
+#define CACHEKEYLEN HASHSTRLEN // キーはハッシュ値の16進表記
+
+// 入力のバイト列とコンパイル条件からキャッシュのキーを作る
+static void cachekey(char *src, size_t len, char *key)
+{
+  hash128 h = FNV128BASIS;
+  char flags[TEXTLEN];
+
+  compile_flags(flags, sizeof(flags));
+  h = fnv1a_str(h, COMPILERID);
+  h = fnv1a_str(h, cgtarget());
+  h = fnv1a_str(h, flags);
+  h = fnv1a_str(h, O_assemble ? "object" : "assembly");
+  h = fnv1a(h, src, len);
+  hashstr(h, key);
+}
+
+// キャッシュディレクトリ内のファイルのパスを作る
+static void cachepath(char *buf, int size, char *name)
+{
+  snprintf(buf, size, "%s/%s", O_cachedir, name);
+}
+
+// statsファイルのヒットとミスの回数に加算する。
+// hits、missesがNULLでなければ更新後の値を返す
+static void cachestats(int dhits, int dmisses, long *hits, long *misses)
+{
+  char path[TEXTLEN], buf[64];
+  long h = 0, m = 0;
+  int fd, n;
+
+  cachepath(path, sizeof(path), "stats");
+  if ((fd = open(path, O_RDWR | O_CREAT, 0644)) == -1)
+    return;
+  flock(fd, LOCK_EX);
+  if ((n = read(fd, buf, sizeof(buf) - 1)) > 0)
+  {
+    buf[n] = '\0';
+    sscanf(buf, "hits %ld misses %ld", &h, &m);
+  }
+  h += dhits;
+  m += dmisses;
+  if (dhits || dmisses)
+  {
+    n = snprintf(buf, sizeof(buf), "hits %ld misses %ld\n", h, m);
+    if (ftruncate(fd, 0) == 0)
+      pwrite(fd, buf, n, 0);
+  }
+  flock(fd, LOCK_UN);
+  close(fd);
+  if (hits)
+    *hits = h;
+  if (misses)
+    *misses = m;
+}
+
+// fromの中身をtoへコピーする。toが"-"であれば標準出力へ書く。
+// 失敗すれば-1を返す
+static int copyfile(char *from, char *to)
+{
+  char buf[8192];
+  FILE *in, *out;
+  size_t n;
+  int err = 0;
+
+  if ((in = fopen(from, "r")) == NULL)
+    return (-1);
+  if (!strcmp(to, "-"))
+    out = stdout;
+  else if ((out = fopen(to, "w")) == NULL)
+  {
+    fclose(in);
+    return (-1);
+  }
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+    if (fwrite(buf, 1, n, out) != n)
+      err = -1;
+  fclose(in);
+  if ((out == stdout ? fflush(out) : fclose(out)) != 0)
+    err = -1;
+  return (err);
+}
+
+// キャッシュを引く。ヒットすれば出力をoutfileへコピーして1を返す。
+// ミスであれば0を返し、保存に使うキーをkeyへ残す
+int cache_lookup(char *src, size_t len, char *outfile, char *key)
+{
+  char path[TEXTLEN];
+
+  mkdir(O_cachedir, 0755);
+  cachekey(src, len, key);
+  cachepath(path, sizeof(path), key);
+  if (copyfile(path, outfile) == 0)
+  {
+    // LRUのために更新時刻を新しくする
+    utimensat(AT_FDCWD, path, NULL, 0);
+    cachestats(1, 0, NULL, NULL);
+    return (1);
+  }
+  cachestats(0, 1, NULL, NULL);
+  return (0);
+}
+
+// キャッシュのエントリ
+struct centry
+{
+  char name[CACHEKEYLEN];
+  off_t size;
+  struct timespec mtime;
+};
+
+// qsort()用。更新時刻の古い順に並べる
+static int byage(const void *a, const void *b)
+{
+  const struct centry *x = a, *y = b;
+
+  if (x->mtime.tv_sec != y->mtime.tv_sec)
+    return (x->mtime.tv_sec < y->mtime.tv_sec ? -1 : 1);
+  return ((x->mtime.tv_nsec > y->mtime.tv_nsec) - (x->mtime.tv_nsec < y->mtime.tv_nsec));
+}
+
+// キャッシュのエントリを一覧にする。エントリ数を返す
+static int cacheentries(struct centry **list)
+{
+  struct centry *e = NULL;
+  struct dirent *d;
+  struct stat st;
+  char path[TEXTLEN];
+  int n = 0, max = 0;
+  DIR *dir;
+
+  if ((dir = opendir(O_cachedir)) == NULL)
+    return (0);
+  while ((d = readdir(dir)) != NULL)
+  {
+    if (strlen(d->d_name) != CACHEKEYLEN - 1)
+      continue;
+    cachepath(path, sizeof(path), d->d_name);
+    if (stat(path, &st) == -1)
+      continue;
+    if (n == max)
+    {
+      max = max ? max * 2 : 64;
+      if ((e = realloc(e, max * sizeof(struct centry))) == NULL)
+        fatal("メモリが確保できませんでした。cacheentries()");
+    }
+    strcpy(e[n].name, d->d_name);
+    e[n].size = st.st_size;
+    e[n].mtime = st.st_mtim;
+    n++;
+  }
+  closedir(dir);
+  *list = e;
+  return (n);
+}
+
+// 合計サイズがO_cachesizeを超えていれば古いエントリから削除する
+static void cacheevict(void)
+{
+  struct centry *e;
+  char path[TEXTLEN];
+  off_t total = 0;
+  int n, i;
+
+  n = cacheentries(&e);
+  for (i = 0; i < n; i++)
+    total += e[i].size;
+  if (total > O_cachesize)
+  {
+    qsort(e, n, sizeof(struct centry), byage);
+    for (i = 0; i < n && total > O_cachesize; i++)
+    {
+      cachepath(path, sizeof(path), e[i].name);
+      if (unlink(path) == 0)
+        total -= e[i].size;
+    }
+  }
+  if (n)
+    free(e);
+}
+
+// コンパイルしたoutfileをキーkeyでキャッシュへ保存する
+void cache_store(char *outfile, char *key)
+{
+  char tmp[TEXTLEN], path[TEXTLEN];
+  int fd;
+
+  cachepath(tmp, sizeof(tmp), "tmp.XXXXXX");
+  if ((fd = mkstemp(tmp)) == -1)
+    return;
+  close(fd);
+
+  // 一時ファイルへ書いてからrename()で差し替える
+  cachepath(path, sizeof(path), key);
+  if (copyfile(outfile, tmp) == -1 || rename(tmp, path) == -1)
+  {
+    unlink(tmp);
+    return;
+  }
+  cacheevict();
+}
+
+// キャッシュの統計を出力する
+void cache_report(void)
+{
+  struct centry *e;
+  long hits, misses;
+  off_t total = 0;
+  int n;
+
+  cachestats(0, 0, &hits, &misses);
+  n = cacheentries(&e);
+  for (int i = 0; i < n; i++)
+    total += e[i].size;
+  if (n)
+    free(e);
+  fprintf(stderr, "キャッシュ %s: ヒット %ld  ミス %ld  ヒット率 %.1f%%  "
+                  "エントリ %d  %lld / %lld バイト\n",
+          O_cachedir, hits, misses,
+          hits + misses ? 100.0 * hits / (hits + misses) : 0.0,
+          n, (long long)total, (long long)O_cachesize);
+}
@@ -6,7 +6,7 @@
 // Code Generator for x86-64
 
 // 利用できるレジスタ一覧とその名前
-static int freereg[4];
+static _Thread_local int freereg[4];
 static char *reglist[4] = {
     "%r8",
     "%r9",
@@ -25,6 +25,29 @@ static char *dreglist[4] = {
     "%r10d",
     "%r11d"};
 
+// 上の4つはどれも呼び出し元保存なので、呼び出しをまたいで使う値は
+// 対応する呼び出し先保存レジスタへ移しておく
+static char *csreglist[4] = {
+    "%rbx",
+    "%r12",
+    "%r13",
+    "%r14"};
+
+#define ALLREGS 0xf // 4つのレジスタすべての集合
+
+// コード生成中の関数の状態。
+// 関数の本体はバッファへ書いておき、退避が必要な呼び出し先保存レジスタが
+// 分かったところでプロローグと一緒に書き出す
+static _Thread_local int Funcid;     // コードを生成中の関数のシンボルID
+static _Thread_local int Used;       // 確保したレジスタの集合
+static _Thread_local int Saved;      // 値を移した呼び出し先保存レジスタの集合
+static _Thread_local int Calls;      // 呼び出した関数が壊すレジスタの集合
+static _Thread_local int Leaf;       // 呼び出しのない関数であればtrue
+static _Thread_local FILE *Funcout;  // 本来の出力先
+static _Thread_local FILE *Bodyout;  // 関数の本体のバッファ
+static _Thread_local char *Body;
+static _Thread_local size_t Bodylen;
+
 // すべてのレジスタを利用可能にする
 void freeall_registers(void)
 {
@@ -39,7 +62,12 @@ static int alloc_register(void)
   {
     if (freereg[i])
     {
+      if (O_timereport)
+        stats_count(ST_REGS, 1);
       freereg[i] = 0;
+      Used |= 1 << i;
+      if (O_trace)
+        trace_live(4 - freereg[0] - freereg[1] - freereg[2] - freereg[3]);
       return (i);
     }
   }
@@ -69,27 +97,72 @@ void cgpostamble()
 {
 }
 
-// 関数のプレアンブルを出力
-void cgfuncpreamble(int id)
+// 関数のプレアンブルを出力する。
+// プロローグはポストアンブルで書くので、ここでは本体のバッファを開くだけ。
+// leafがtrueであれば関数は何も呼び出さない
+void cgfuncpreamble(int id, int leaf)
+{
+  // 前の関数がエラーで中断していればバッファが残っている
+  if (Bodyout)
+  {
+    fclose(Bodyout);
+    free(Body);
+  }
+  Funcid = id;
+  Leaf = leaf;
+  Used = Saved = Calls = 0;
+  Funcout = Outfile;
+  if ((Bodyout = Outfile = open_memstream(&Body, &Bodylen)) == NULL)
+    fatal("出力バッファを作成できません");
+}
+
+// 関数のポストアンブルを出力する。本体で使った呼び出し先保存レジスタを
+// 退避するプロローグと、それを戻すエピローグで本体を挟む。
+// 呼び出しでスタックを16バイト境界に揃えるため、退避する数が奇数であれば8バイト空ける。
+// 葉の関数はスタックを使わないので、プロローグもエピローグも書かない。
+// 変数はすべてグローバルで、レジスタを退避することもないので、
+// レッドゾーンに置くものもない
+void cgfuncpostamble(int id)
 {
   char *name = Gsym[id].name;
+  int n = 0;
+
+  cglabel(Gsym[id].endlabel);
+  for (int i = 0; i < 4; i++)
+    if (Saved & (1 << i))
+      n++;
+  if (n & 1)
+    fputs("\taddq\t$8, %rsp\n", Outfile);
+  for (int i = 3; i >= 0; i--)
+    if (Saved & (1 << i))
+      fprintf(Outfile, "\tpopq\t%s\n", csreglist[i]);
+  if (!Leaf)
+    fputs("\tpopq %rbp\n", Outfile);
+  fputs("\tret\n", Outfile);
+  fclose(Bodyout);
+  Bodyout = NULL;
+
+  Outfile = Funcout;
   fprintf(Outfile,
           "\t.text\n"
           "\t.globl\t%s\n"
           "\t.type\t%s, @function\n"
-          "%s:\n"
-          "\tpushq\t%%rbp\n"
-          "\tmovq\t%%rsp, %%rbp\n",
+          "%s:\n",
           name, name, name);
-}
-
-// 関数のポストアンブルを出力
-void cgfuncpostamble(int id)
-{
-  cglabel(Gsym[id].endlabel);
-  fputs("\tpopq %rbp\n"
-        "\tret\n",
-        Outfile);
+  if (!Leaf)
+    fputs("\tpushq\t%rbp\n"
+          "\tmovq\t%rsp, %rbp\n",
+          Outfile);
+  for (int i = 0; i < 4; i++)
+    if (Saved & (1 << i))
+      fprintf(Outfile, "\tpushq\t%s\n", csreglist[i]);
+  if (n & 1)
+    fputs("\tsubq\t$8, %rsp\n", Outfile);
+  fwrite(Body, 1, Bodylen, Outfile);
+  free(Body);
+
+  // この関数を呼ぶと、自分で使ったレジスタと呼び出した関数が壊すレジスタが壊れる
+  Gsym[id].clobber = Used | Calls;
 }
 
 // 整数リテラル値をレジスタに読み込む
@@ -143,6 +216,16 @@ int cgadd(int r1, int r2)
   return (r2);
 }
 
+// 1つ目のレジスタに、2つ目のレジスタに大きさsize(2、4、8)を掛けた値を足して
+// 結果の入ったレジスタ番号を返す。アドレスの計算の形で1命令にする
+int cgaddscaled(int r1, int r2, int size)
+{
+  fprintf(Outfile, "\tleaq\t(%s,%s,%d), %s\n", reglist[r1], reglist[r2], size,
+          reglist[r2]);
+  free_register(r1);
+  return (r2);
+}
+
 // 1つ目のレジスタから2つめのレジスタを引いて
 // 結果の入ったレジスタ番号を返す
 int cgsub(int r1, int r2)
@@ -173,24 +256,74 @@ int cgdiv(int r1, int r2)
   return (r1);
 }
 
+// 関数idを呼び出すと壊れるかもしれないレジスタの集合を返す。
+// 自分自身や、このファイルで定義していない関数はすべて壊すとみなす。
+// 並列コード生成では、先に定義された関数のコード生成が終わるのを待つ
+static int cgclobber(int id)
+{
+  if (id == Funcid)
+    return (ALLREGS);
+  if (O_threads > 1 || O_pipeline)
+    par_waitfunc(id);
+  if (Gsym[id].clobber == -1)
+    return (ALLREGS);
+  return (Gsym[id].clobber);
+}
+
+// 呼び出しの前に、引数のレジスタr以外の使用中のレジスタのうち
+// 呼び出しで壊れるものを呼び出し先保存レジスタへ移す。移したレジスタの集合を返す
+static int savelive(int r, int clobber)
+{
+  int save = 0;
+
+  for (int i = 0; i < 4; i++)
+  {
+    if (i == r || freereg[i] || !(clobber & (1 << i)))
+      continue;
+    fprintf(Outfile, "\tmovq\t%s, %s\n", reglist[i], csreglist[i]);
+    save |= 1 << i;
+  }
+  Saved |= save;
+  return (save);
+}
+
+// 呼び出しの後に、savelive()で移した値を戻す
+static void restorelive(int save)
+{
+  for (int i = 0; i < 4; i++)
+    if (save & (1 << i))
+      fprintf(Outfile, "\tmovq\t%s, %s\n", csreglist[i], reglist[i]);
+}
+
 // printint()に引数を渡して呼び出し
 void cgprintint(int r)
 {
+  int save = savelive(r, ALLREGS);
+
   fprintf(Outfile, "\tmovq\t%s, %%rdi\n", reglist[r]);
   fprintf(Outfile, "\tcall\tprintint\n");
+  restorelive(save);
+  Calls |= ALLREGS;
   free_register(r);
 }
 
 // 引数のレジスタから1つの引数を伴う関数を呼び出す。
-// 結果が入ったレジスタを返す
+// 結果が入ったレジスタを返す。
+// 呼び出しをまたいで使う値のうち、呼び出した関数が壊すものだけを退避する
 int cgcall(int r, int id)
 {
-  // 新規にレジスタを取得
-  int outr = alloc_register();
+  int outr, clobber = cgclobber(id), save = savelive(r, clobber);
+
   fprintf(Outfile, "\tmovq\t%s, %%rdi\n", reglist[r]);
   fprintf(Outfile, "\tcall\t%s\n", Gsym[id].name);
-  fprintf(Outfile, "\tmovq\t%%rax, %s\n", reglist[outr]);
+  restorelive(save);
+
+  // 再帰呼び出しは、この関数が壊す以上のレジスタを壊さない
+  if (id != Funcid)
+    Calls |= clobber;
   free_register(r);
+  outr = alloc_register();
+  fprintf(Outfile, "\tmovq\t%%rax, %s\n", reglist[outr]);
   return (outr);
 }
 
@@ -248,6 +381,35 @@ int cgprimsize(int type)
   return (psize[type]);
 }
 
+// コンパイル結果のキャッシュのキーに使うターゲットの名前を返す
+char *cgtarget(void)
+{
+  return ("x86-64");
+}
+
+// 関数のコードが他の関数のコード生成に依存しなければtrueを返す。
+// x86-64ではすべての状態が関数内で閉じている
+int cgfunclocal(void)
+{
+  return (1);
+}
+
+// シンボルidを参照する関数のコードが依存する、バックエンド固有の値を返す。
+// x86-64ではシンボルを名前で参照するので、関数が壊すレジスタの集合だけ
+int cgsymdep(int id)
+{
+  if (Gsym[id].stype == S_FUNCTION)
+    return (Gsym[id].clobber);
+  return (0);
+}
+
+// ノードopを含む関数を葉の関数として生成できればtrueを返す。
+// idはA_IDENT、A_ADDR、A_FUNCCALLのシンボルID。x86-64では呼び出しだけが葉にしない
+int cgleafop(int op, int id)
+{
+  return (op != A_FUNCCALL);
+}
+
 // グローバルシンボルを生成
 void cgglobsym(int id)
 {
@@ -298,13 +460,13 @@ int cgcompare_and_set(int ASTop, int r1, int r2)
 // ラベルを生成
 void cglabel(int l)
 {
-  fprintf(Outfile, "L%d:\n", l);
+  fprintf(Outfile, "%s:\n", genlabelname(l));
 }
 
 // ラベルへのジャンプを生成
 void cgjump(int l)
 {
-  fprintf(Outfile, "\tjmp\tL%d\n", l);
+  fprintf(Outfile, "\tjmp\t%s\n", genlabelname(l));
 }
 
 // ひっくり返したジャンプ命令のリスト
@@ -320,11 +482,34 @@ int cgcompare_and_jump(int ASTop, int r1, int r2, int label)
     fatal("cgcompare_and_set()内での不正なAST操作");
 
   fprintf(Outfile, "\tcmpq\t%s, %s\n", reglist[r2], reglist[r1]);
-  fprintf(Outfile, "\t%s\tL%d\n", invcmplist[ASTop - A_EQ], label);
+  fprintf(Outfile, "\t%s\t%s\n", invcmplist[ASTop - A_EQ], genlabelname(label));
   freeall_registers();
   return (NOREG);
 }
 
+// 条件付き転送命令のリスト
+// ASTの並び: A_EQ, A_NE, A_LT, A_GT, A_LE, A_GE
+static char *cmovlist[] =
+    {"cmove", "cmovne", "cmovl", "cmovg", "cmovle", "cmovge"};
+
+// 2つのレジスタを比較して真であればtregの値をfregへ移す。
+// 分岐せずにどちらかの値を選ぶ。結果の入ったfregを返す
+int cgselect(int ASTop, int r1, int r2, int treg, int freg)
+{
+
+  // AST操作の範囲をチェック
+  if (ASTop < A_EQ || ASTop > A_GE)
+    fatal("cgselect()内での不正なAST操作");
+
+  fprintf(Outfile, "\tcmpq\t%s, %s\n", reglist[r2], reglist[r1]);
+  fprintf(Outfile, "\t%s\t%s, %s\n", cmovlist[ASTop - A_EQ],
+          reglist[treg], reglist[freg]);
+  free_register(r1);
+  free_register(r2);
+  free_register(treg);
+  return (freg);
+}
+
 // レジスタの値を拡張前から拡張後の新しい型へと拡張する
 // 値を格納したレジスタを返す
 int cgwiden(int r, int oldtype, int newtype)
@@ -333,6 +518,43 @@ int cgwiden(int r, int oldtype, int newtype)
   return (r);
 }
 
+// レジスタrの値を型typeの関数の値としてcgreturn()と同じように変換し、
+// レジスタdstへ移す。dstは空いているかrであること。dstを返す
+int cgmovereg(int r, int dst, int type)
+{
+  switch (type)
+  {
+  case P_CHAR:
+    fprintf(Outfile, "\tmovzbl\t%s, %s\n", breglist[r], dreglist[dst]);
+    break;
+  case P_INT:
+    fprintf(Outfile, "\tmovl\t%s, %s\n", dreglist[r], dreglist[dst]);
+    break;
+  case P_LONG:
+    if (r != dst)
+      fprintf(Outfile, "\tmovq\t%s, %s\n", reglist[r], reglist[dst]);
+    break;
+  default:
+    fatald("cgmovereg:関数の型が不正です", type);
+  }
+  if (r != dst)
+  {
+    free_register(r);
+    cgclaimreg(dst);
+  }
+  return (dst);
+}
+
+// 空いているレジスタrを確保する。rを返す
+int cgclaimreg(int r)
+{
+  if (!freereg[r])
+    fatald("レジスタの確保に失敗しました", r);
+  freereg[r] = 0;
+  Used |= 1 << r;
+  return (r);
+}
+
 // 関数から値を返すコードを生成
 void cgreturn(int reg, int id)
 {
@@ -404,3 +626,50 @@ int cgstorderef(int r1, int r2, int type)
   }
   return (r1);
 }
+
+// ループの間だけ大域変数を置く、変数用のレジスタ。
+// ループの中には呼び出しがないので、プールに使わない呼び出し元保存の
+// レジスタを退避せずに使える
+#define NVARREGS 3
+static char *varreglist[NVARREGS] = {"%rsi", "%rdi", "%rcx"};
+
+// 変数用のレジスタの数を返す
+int cgvarregs(void)
+{
+  return (NVARREGS);
+}
+
+// 変数idの値を変数用のレジスタslotへ読み込む
+void cgvarload(int slot, int id)
+{
+  fprintf(Outfile, "\tmovq\t%s(%%rip), %s\n", Gsym[id].name, varreglist[slot]);
+}
+
+// 変数用のレジスタslotの値を変数idへ書き戻す
+void cgvarstore(int slot, int id)
+{
+  fprintf(Outfile, "\tmovq\t%s, %s(%%rip)\n", varreglist[slot], Gsym[id].name);
+}
+
+// 変数用のレジスタslotの値をレジスタに入れて、そのレジスタを返す
+int cgloadvarreg(int slot)
+{
+  int r = alloc_register();
+
+  fprintf(Outfile, "\tmovq\t%s, %s\n", varreglist[slot], reglist[r]);
+  return (r);
+}
+
+// レジスタrの値を変数用のレジスタslotへ入れる。rを返す
+int cgstorvarreg(int r, int slot)
+{
+  fprintf(Outfile, "\tmovq\t%s, %s\n", reglist[r], varreglist[slot]);
+  return (r);
+}
+
+// 変数用のレジスタslotへ定数valを足す。足せなければfalseを返す
+int cgaddvarreg(int slot, int val)
+{
+  fprintf(Outfile, "\taddq\t$%d, %s\n", val, varreglist[slot]);
+  return (1);
+}
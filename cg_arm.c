@@ -2,12 +2,20 @@
 #include "defs.h"
 #include "data.h"
 #include "decl.h"
+#include <stdarg.h>
 
-// Raspberry PiでのARMv6対応コードジェネレータ
+// Raspberry PiでのARMv6対応コードジェネレータ。
+// -DARMV7でコンパイルするとARMv7の命令も使う
 
-// 利用可能なレジスタとその名前
-static int freereg[4];
-static char *reglist[4] = {"r4", "r5", "r6", "r7"};
+// 利用可能なレジスタとその名前。
+// r4からr7はどれも呼び出し先保存なので、使ったものを関数の入口で退避すれば
+// 呼び出しをまたいでも値は壊れない。何も呼び出さない葉の関数では
+// 退避しなくてよい呼び出し元保存のレジスタを使い、スタックに触れない
+static _Thread_local int freereg[4];
+static char *savedregs[4] = {"r4", "r5", "r6", "r7"};
+static char *leafregs[4] = {"r0", "r1", "r2", "r12"};
+static _Thread_local char **reglist = savedregs; // 関数で使うほう
+static _Thread_local int Used; // 関数の中で確保したレジスタの集合
 
 // すべてのレジスタを利用可能にする
 void freeall_registers(void)
@@ -23,7 +31,12 @@ static int alloc_register(void)
   {
     if (freereg[i])
     {
+      if (O_timereport)
+        stats_count(ST_REGS, 1);
       freereg[i] = 0;
+      Used |= 1 << i;
+      if (O_trace)
+        trace_live(4 - freereg[0] - freereg[1] - freereg[2] - freereg[3]);
       return (i);
     }
   }
@@ -40,91 +53,323 @@ static void free_register(int reg)
   freereg[reg] = 1;
 }
 
-// メモリに大きな整数リテラルを保存する必要が有る。
-// それらのリストを持っておき、ポストアンブルでの出力に備える
-#define MAXINTS 1024
-int Intlist[MAXINTS];
-static int Intslot = 0;
+// 出力したコードのおおよその大きさ。関数の先頭からのバイト数で、
+// 出力の1行を1命令の4バイトとして数える。ラベルや疑似命令も数えるので多めになる
+static _Thread_local int Pc;
+
+// 大きな整数リテラルはコードの近くのリテラルプールに置き、
+// PC相対のldrで読み込む。ldrが届くのは前後4KBまでなので、
+// プールは関数ごとに関数の後ろへ書き出し、大きな関数では
+// 最初に参照してからPOOLRANGEバイトを超える前に、
+// 分岐で飛び越えるプールを途中に書き出す。
+// 同じ値はプールに1つだけ置く。プールに同じ値があるかはハッシュ表で調べ、
+// 表の要素はプールの位置+1で、0は空き。
+// ARMv7ではmovwとmovtで即値を組み立てるのでプールは使わない
+#define POOLMAX 256    // 1つのプールに置く値の数
+#define POOLHASH 512   // ハッシュ表の大きさ。POOLMAXの2倍の2の累乗
+#define POOLRANGE 2048 // プールを最初に参照してから書き出すまでのバイト数の上限
+static _Thread_local int Pool[POOLMAX];
+static _Thread_local int Poolhash[POOLHASH];
+static _Thread_local int Npool;      // プールにある値の数
+static _Thread_local int Poolid;     // 関数の中で何番目のプールか
+static _Thread_local int Poolfirst;  // プールを最初に参照したときのPc
+static _Thread_local int Flushing;   // プールを書き出し中であればtrue
+static _Thread_local int Funcid;     // コードを生成中の関数のシンボルID
+
+static void flushpool(int branch);
+
+// アセンブリを1行以上出力する。
+// 前の命令までにプールが遠くなりすぎていれば先に書き出す
+static void emit(char *fmt, ...)
+{
+  va_list ap;
+
+  if (Npool && !Flushing && Pc - Poolfirst > POOLRANGE)
+    flushpool(1);
+  for (char *p = fmt; *p; p++)
+    if (*p == '\n')
+      Pc += 4;
+  va_start(ap, fmt);
+  vfprintf(Outfile, fmt, ap);
+  va_end(ap);
+}
+
+// 今のプールのラベル名を返す。返す文字列は次の呼び出しで上書きされる
+static char *poollabel(void)
+{
+  static _Thread_local char buf[TEXTLEN + 32];
 
-// .L3ラベルからの大きな整数リテラルのオフセットを決める。
-// 整数がリストになければ加える。
-static void set_int_offset(int val)
+  snprintf(buf, sizeof(buf), ".Lpool.%s.%d", Gsym[Funcid].name, Poolid);
+  return (buf);
+}
+
+// プールを書き出して空にする。branchがtrueであれば関数の途中なので
+// プールを分岐で飛び越える
+static void flushpool(int branch)
 {
-  int offset = -1;
+  if (Npool == 0)
+    return;
+  Flushing = 1;
+  if (branch)
+    emit("\tb\t%se\n", poollabel());
+  emit("\t.align\t2\n%s:\n", poollabel());
+  for (int i = 0; i < Npool; i++)
+    emit("\t.word\t%d\n", Pool[i]);
+  if (branch)
+    emit("%se:\n", poollabel());
+  memset(Poolhash, 0, sizeof(Poolhash));
+  Npool = 0;
+  Poolid++;
+  Flushing = 0;
+}
 
-  // すでにリストにないか確認
-  for (int i = 0; i < Intslot; i++)
+#ifndef ARMV7
+// 大きな整数リテラルのプールの先頭からのオフセットを返す。
+// プールになければ加える。プールが遠いか一杯であれば新しいプールにする
+static int pooloffset(int val)
+{
+  int h;
+
+  if (Npool && Pc - Poolfirst > POOLRANGE)
+    flushpool(1);
+
+  // すでにプールにないか確認
+  for (h = ((unsigned)val * 2654435761u) >> 23; Poolhash[h] != 0;
+       h = (h + 1) & (POOLHASH - 1))
   {
-    if (Intlist[i] == val)
-    {
-      offset = 4 * i;
-      break;
-    }
+    if (Pool[Poolhash[h] - 1] == val)
+      return (4 * (Poolhash[h] - 1));
+  }
+
+  // なければ加える。一杯であれば新しいプールに加える
+  if (Npool == POOLMAX)
+  {
+    flushpool(1);
+    return (pooloffset(val));
   }
+  if (Npool == 0)
+    Poolfirst = Pc;
+  Pool[Npool++] = val;
+  Poolhash[h] = Npool;
+  return (4 * (Npool - 1));
+}
+#endif
+
+// グローバル変数はこのファイルの.dataセクションへ宣言順に並べ、
+// 先頭の.Ldataからの位置をGsym[].posnに入れておく。
+// 関数の入口で.Ldataのアドレスをr10へ読み込み、変数へはr10からの
+// オフセットで読み書きする。オフセットがldrの即値に入らないときは
+// 上位の部分をr3へ加えて使い、同じ値であれば使い回す。
+// 葉の関数ではr10を退避しないように、.Ldataのアドレスをr3へ読み込む。
+// そのため遠い変数を使う関数は葉にしない
+static int Dataoff;              // 次の変数の.Ldataからの位置
+static _Thread_local int R3base; // r3に入っているr10からの位置。-1は不明
+static _Thread_local char *Base; // .Ldataのアドレスを入れるレジスタ
+static _Thread_local int Usebase; // 関数で.Ldataのアドレスを使えばtrue
+
+// dstへsrcとoffの和を入れる。offは加算の即値に入る8ビットずつに分ける
+static void addimm(char *dst, char *src, int off)
+{
+  int pos, chunk;
 
-  // リストになければ加える
-  if (offset == -1)
+  if (off == 0)
+  {
+    emit("\tmov\t%s, %s\n", dst, src);
+    return;
+  }
+  while (off)
   {
-    offset = 4 * Intslot;
-    if (Intslot == MAXINTS)
-      fatal("set_int_offset():intスロットが足りません");
-    Intlist[Intslot++] = val;
+    for (pos = 0; !(off & (3 << pos)); pos += 2)
+      ;
+    chunk = off & (0xff << pos);
+    emit("\tadd\t%s, %s, #%d\n", dst, src, chunk);
+    src = dst;
+    off -= chunk;
   }
-  // このオフセットでL3を読み込む
-  fprintf(Outfile, "\tldr\tr3, .L3+%d\n", offset);
+}
+
+// 変数idを読み書きするldrやstrのアドレスの書き方を返す。
+// 返す文字列は次の呼び出しで上書きされる
+static char *varaddr(int id)
+{
+  static _Thread_local char buf[32];
+  int off = Gsym[id].posn, hi = off & ~0xfff;
+
+  Usebase = 1;
+  if (hi == 0)
+    snprintf(buf, sizeof(buf), "[%s, #%d]", Base, off);
+  else
+  {
+    if (R3base != hi)
+    {
+      addimm("r3", "r10", hi);
+      R3base = hi;
+    }
+    snprintf(buf, sizeof(buf), "[r3, #%d]", off & 0xfff);
+  }
+  return (buf);
 }
 
 // アセンブリのプレアンブルを出力
 void cgpreamble()
 {
   freeall_registers();
-  fputs("\t.text\n", Outfile);
+  Dataoff = 0;
+  emit("\t.data\n"
+       ".Ldata:\n"
+       "\t.text\n");
 }
 
-// アセンブリのポストアンブルを出力
+// アセンブリのポストアンブルを出力。
+// グローバル変数はcgglobsym()で置いてあるので、書き出すものはない
 void cgpostamble()
 {
+}
 
-  // グローバル変数を書き出す
-  fprintf(Outfile, ".L2:\n");
-  for (int i = 0; i < Globs; i++)
-  {
-    if (Gsym[i].stype == S_VARIABLE)
-      fprintf(Outfile, "\t.word %s\n", Gsym[i].name);
-  }
+// ループの間だけ大域変数を置く、変数用のレジスタ。
+// どれも呼び出し先保存なので、使ったものは関数の入口で退避する
+#define NVARREGS 2
+static char *varreglist[NVARREGS] = {"r8", "r9"};
+static _Thread_local int Varused; // 関数の中で使った変数用のレジスタの集合
 
-  // 整数リテラルを書き出す
-  fprintf(Outfile, ".L3:\n");
-  for (int i = 0; i < Intslot; i++)
-  {
-    fprintf(Outfile, "\t.word %d\n", Intlist[i]);
-  }
+// 退避する変数用のレジスタのリストを返す。
+// 返す文字列は次の呼び出しで上書きされる
+static char *varsavelist(void)
+{
+  static _Thread_local char buf[16];
+  int n = 0;
+
+  buf[0] = '\0';
+  for (int i = 0; i < NVARREGS; i++)
+    if (Varused & (1 << i))
+      n += snprintf(buf + n, sizeof(buf) - n, "%s%s", n ? ", " : "",
+                    varreglist[i]);
+  return (buf);
 }
 
-// 関数プレアンブルを書き出す
-void cgfuncpreamble(int id)
+// 関数の入口で退避するレジスタのpushとpopのリストを返す。
+// 返す文字列は次の呼び出しで上書きされる
+static char *savelist(void)
+{
+  static _Thread_local char buf[64];
+  int n = 0;
+
+  for (int i = 0; i < 4; i++)
+    if (Used & (1 << i))
+      n += snprintf(buf + n, sizeof(buf) - n, "%s, ", savedregs[i]);
+  if (Varused)
+    n += snprintf(buf + n, sizeof(buf) - n, "%s, ", varsavelist());
+  snprintf(buf + n, sizeof(buf) - n, "r10, fp");
+  return (buf);
+}
+
+// 退避するレジスタの数
+static int nsaved(void)
+{
+  return ((Used & 1) + (Used >> 1 & 1) + (Used >> 2 & 1) + (Used >> 3 & 1) +
+          (Varused & 1) + (Varused >> 1 & 1));
+}
+
+// 関数の本体を書き終えるまでの本来の出力先と、本体のバッファ
+static _Thread_local FILE *Funcout;
+static _Thread_local FILE *Bodyout;
+static _Thread_local char *Body;
+static _Thread_local size_t Bodylen;
+static _Thread_local int Leaf; // 葉の関数であればtrue
+
+// 関数プレアンブルを書き出す。leafがtrueであれば関数は
+// 何も呼び出さず、遠い変数も使わない。
+// r4からr7のうち退避するものや.Ldataのアドレスが要るかは本体を
+// 生成するまで分からないので、本体はバッファへ書いておき、
+// フレームを作る命令はポストアンブルで書く
+void cgfuncpreamble(int id, int leaf)
 {
   char *name = Gsym[id].name;
-  fprintf(Outfile,
-          "\t.text\n"
-          "\t.globl\t%s\n"
-          "\t.type\t%s, \%%function\n"
-          "%s:\n"
-          "\tpush\t{fp, lr}\n"
-          "\tadd\tfp, sp, #4\n"
-          "\tsub\tsp, sp, #8\n"
-          "\tstr\tr0, [fp, #-8]\n",
-          name, name, name);
-}
-
-// 関数ポストアンブルを書き出す
+
+  // 前の関数がエラーで中断していればプールとバッファが残っている
+  if (Npool)
+    memset(Poolhash, 0, sizeof(Poolhash));
+  if (Bodyout)
+  {
+    fclose(Bodyout);
+    free(Body);
+  }
+  Funcid = id;
+  Npool = Poolid = Pc = 0;
+  R3base = -1;
+  Used = Usebase = Varused = 0;
+  Leaf = leaf;
+  reglist = leaf ? leafregs : savedregs;
+  Base = leaf ? "r3" : "r10";
+
+  // ARMv6では.Ldataのアドレスを関数の直前に置いて読み込む
+#ifdef ARMV7
+  emit("\t.text\n");
+#else
+  emit("\t.text\n"
+       "\t.align\t2\n"
+       ".Lbase.%s:\n"
+       "\t.word\t.Ldata\n",
+       name);
+#endif
+  emit("\t.globl\t%s\n"
+       "\t.type\t%s, \%%function\n"
+       "%s:\n",
+       name, name, name);
+
+  // プールまでの距離は本体の中で測るので、Pcは後から書くプロローグを数えなくてよい
+  Funcout = Outfile;
+  if ((Bodyout = Outfile = open_memstream(&Body, &Bodylen)) == NULL)
+    fatal("出力バッファを作成できません");
+}
+
+// 関数ポストアンブルを書き出す。使ったレジスタとr10、fp、lrを退避して
+// フレームを作る命令と、.Ldataのアドレスを読み込む命令を書いてから本体を続ける。
+// fpは退避したlrを指す。スタックを8バイト境界に揃えるため、
+// 退避する数が偶数であれば引数の場所の他に4バイト空ける。
+// 葉の関数はフレームを作らず、bx lrで戻る。変数用のレジスタを使えばそれだけ退避する
 void cgfuncpostamble(int id)
 {
+  int n = nsaved();
+
   cglabel(Gsym[id].endlabel);
-  fputs("\tsub\tsp, fp, #4\n"
-        "\tpop\t{fp, pc}\n"
-        "\t.align\t2\n",
-        Outfile);
+  if (Leaf && Varused)
+    emit("\tpop\t{%s}\n", varsavelist());
+  if (Leaf)
+    emit("\tbx\tlr\n"
+         "\t.align\t2\n");
+  else
+    emit("\tsub\tsp, fp, #%d\n"
+         "\tpop\t{%s, pc}\n"
+         "\t.align\t2\n",
+         4 * n + 8, savelist());
+  fclose(Bodyout);
+  Bodyout = NULL;
+
+  Outfile = Funcout;
+  if (Leaf && Varused)
+    fprintf(Outfile, "\tpush\t{%s}\n", varsavelist());
+  if (!Leaf)
+    fprintf(Outfile,
+            "\tpush\t{%s, lr}\n"
+            "\tadd\tfp, sp, #%d\n"
+            "\tsub\tsp, sp, #%d\n"
+            "\tstr\tr0, [fp, #-%d]\n",
+            savelist(), 4 * n + 8, n & 1 ? 8 : 12, 4 * n + 16);
+  if (Usebase)
+#ifdef ARMV7
+    fprintf(Outfile,
+            "\tmovw\t%s, #:lower16:.Ldata\n"
+            "\tmovt\t%s, #:upper16:.Ldata\n",
+            Base, Base);
+#else
+    fprintf(Outfile, "\tldr\t%s, .Lbase.%s\n", Base, Gsym[id].name);
+#endif
+  fwrite(Body, 1, Bodylen, Outfile);
+  free(Body);
+
+  // 残りのリテラルは関数の後ろに置く。ここへは実行が来ないので飛び越えなくてよい
+  flushpool(0);
 }
 
 // 整数リテラル値をレジスタに読み込ませる。
@@ -136,32 +381,23 @@ int cgloadint(int value, int type)
 
   // リテラル地が小さければ1命令で実行
   if (value <= 1000)
-    fprintf(Outfile, "\tmov\t%s, #%d\n", reglist[r], value);
+    emit("\tmov\t%s, #%d\n", reglist[r], value);
   else
   {
-    set_int_offset(value);
-    fprintf(Outfile, "\tldr\t%s, [r3]\n", reglist[r]);
+#ifdef ARMV7
+    // 下位16ビットと、0でなければ上位16ビットを即値で入れる
+    emit("\tmovw\t%s, #%d\n", reglist[r], value & 0xffff);
+    if ((unsigned)value >> 16)
+      emit("\tmovt\t%s, #%d\n", reglist[r], (unsigned)value >> 16);
+#else
+    // プールから値を直接読み込む
+    int off = pooloffset(value);
+    emit("\tldr\t%s, %s+%d\n", reglist[r], poollabel(), off);
+#endif
   }
   return (r);
 }
 
-// .L2ラベルからの変数のオフセットを決める。
-// 効率的ではないコード。
-static void set_var_offset(int id)
-{
-  int offset = 0;
-  // シンボルテーブルをidについて走査する。
-  // Find S_VARIABLEsを見つけて変数にたどり着くまで4を加算
-
-  for (int i = 0; i < id; i++)
-  {
-    if (Gsym[i].stype == S_VARIABLE)
-      offset += 4;
-  }
-  // このオフセットでr3を読み込む
-  fprintf(Outfile, "\tldr\tr3, .L2+%d\n", offset);
-}
-
 // 変数の値をレジスタへ読み込む。
 // レジスタ番号を返す。
 int cgloadglob(int id)
@@ -169,20 +405,17 @@ int cgloadglob(int id)
   // 新規にレジスタを取得
   int r = alloc_register();
 
-  // 変数へのオフセットを取得
-  set_var_offset(id);
-
   switch (Gsym[id].type)
   {
   case P_CHAR:
-    fprintf(Outfile, "\tldrb\t%s, [r3]\n", reglist[r]);
+    emit("\tldrb\t%s, %s\n", reglist[r], varaddr(id));
     break;
   case P_INT:
   case P_LONG:
   case P_CHARPTR:
   case P_INTPTR:
   case P_LONGPTR:
-    fprintf(Outfile, "\tldr\t%s, [r3]\n", reglist[r]);
+    emit("\tldr\t%s, %s\n", reglist[r], varaddr(id));
     break;
   default:
     fatald("cgloadglob 型が不正です:", Gsym[id].type);
@@ -193,17 +426,27 @@ int cgloadglob(int id)
 // 2つのレジスタを加算して結果が入ったレジスタ番号を返す。
 int cgadd(int r1, int r2)
 {
-  fprintf(Outfile, "\tadd\t%s, %s, %s\n", reglist[r2], reglist[r1],
+  emit("\tadd\t%s, %s, %s\n", reglist[r2], reglist[r1],
           reglist[r2]);
   free_register(r1);
   return (r2);
 }
 
+// 1つ目のレジスタに、2つ目のレジスタに大きさsize(2、4、8)を掛けた値を足す。
+// 第2オペランドのシフトで1命令にする
+int cgaddscaled(int r1, int r2, int size)
+{
+  emit("\tadd\t%s, %s, %s, lsl #%d\n", reglist[r2], reglist[r1], reglist[r2],
+       size == 2 ? 1 : size == 4 ? 2 : 3);
+  free_register(r1);
+  return (r2);
+}
+
 // 1つ目のレジスタから2つ目のレジスタを減算する。
 // 結果が入ったレジスタ番号を返す。
 int cgsub(int r1, int r2)
 {
-  fprintf(Outfile, "\tsub\t%s, %s, %s\n", reglist[r1], reglist[r1],
+  emit("\tsub\t%s, %s, %s\n", reglist[r1], reglist[r1],
           reglist[r2]);
   free_register(r2);
   return (r1);
@@ -212,7 +455,7 @@ int cgsub(int r1, int r2)
 // 2つのレジスタをかけ合わせて結果が入ったレジスタ番号を返す。
 int cgmul(int r1, int r2)
 {
-  fprintf(Outfile, "\tmul\t%s, %s, %s\n", reglist[r2], reglist[r1],
+  emit("\tmul\t%s, %s, %s\n", reglist[r2], reglist[r1],
           reglist[r2]);
   free_register(r1);
   return (r2);
@@ -225,10 +468,11 @@ int cgdiv(int r1, int r2)
 
   // 割り算を行うには: r1 は被除数、r2 は除数が入る。
   // 商はr1に入る
-  fprintf(Outfile, "\tmov\tr0, %s\n", reglist[r1]);
-  fprintf(Outfile, "\tmov\tr1, %s\n", reglist[r2]);
-  fprintf(Outfile, "\tbl\t__aeabi_idiv\n");
-  fprintf(Outfile, "\tmov\t%s, r0\n", reglist[r1]);
+  emit("\tmov\tr0, %s\n", reglist[r1]);
+  emit("\tmov\tr1, %s\n", reglist[r2]);
+  emit("\tbl\t__aeabi_idiv\n");
+  R3base = -1;
+  emit("\tmov\t%s, r0\n", reglist[r1]);
   free_register(r2);
   return (r1);
 }
@@ -236,9 +480,10 @@ int cgdiv(int r1, int r2)
 // 与えられた引数でprintint()を呼び出す
 void cgprintint(int r)
 {
-  fprintf(Outfile, "\tmov\tr0, %s\n", reglist[r]);
-  fprintf(Outfile, "\tbl\tprintint\n");
-  fprintf(Outfile, "\tnop\n");
+  emit("\tmov\tr0, %s\n", reglist[r]);
+  emit("\tbl\tprintint\n");
+  R3base = -1;
+  emit("\tnop\n");
   free_register(r);
 }
 
@@ -246,36 +491,33 @@ void cgprintint(int r)
 // 結果が入ったレジスタを返す。
 int cgcall(int r, int id)
 {
-  fprintf(Outfile, "\tmov\tr0, %s\n", reglist[r]);
-  fprintf(Outfile, "\tbl\t%s\n", Gsym[id].name);
-  fprintf(Outfile, "\tmov\t%s, r0\n", reglist[r]);
+  emit("\tmov\tr0, %s\n", reglist[r]);
+  emit("\tbl\t%s\n", Gsym[id].name);
+  R3base = -1;
+  emit("\tmov\t%s, r0\n", reglist[r]);
   return (r);
 }
 
 // 定数量レジスタを左へシフト
 int cgshlconst(int r, int val)
 {
-  fprintf(Outfile, "\tlsl\t%s, %s, #%d\n", reglist[r], reglist[r], val);
+  emit("\tlsl\t%s, %s, #%d\n", reglist[r], reglist[r], val);
   return (r);
 }
 // レジスタの値を変数に保存
 int cgstorglob(int r, int id)
 {
-
-  // 変数へのオフセットを取得
-  set_var_offset(id);
-
   switch (Gsym[id].type)
   {
   case P_CHAR:
-    fprintf(Outfile, "\tstrb\t%s, [r3]\n", reglist[r]);
+    emit("\tstrb\t%s, %s\n", reglist[r], varaddr(id));
     break;
   case P_INT:
   case P_LONG:
   case P_CHARPTR:
   case P_INTPTR:
   case P_LONGPTR:
-    fprintf(Outfile, "\tstr\t%s, [r3]\n", reglist[r]);
+    emit("\tstr\t%s, %s\n", reglist[r], varaddr(id));
     break;
   default:
     fatald("cgloadglob:型が不正です", Gsym[id].type);
@@ -285,7 +527,7 @@ int cgstorglob(int r, int id)
 
 // 型サイズの配列がP_XXXの形で並んでいる。
 // 0 はサイズなし。
-static int psize[] = {0, 0, 1, 4, 4, 4, 4, 4};
+static int psize[] = {0, 0, 1, 4, 4, 4, 4, 4, 4};
 
 // P_XXXの方の値を引数に、基本型のサイズをバイトで返す。
 int cgprimsize(int type)
@@ -296,6 +538,48 @@ int cgprimsize(int type)
   return (psize[type]);
 }
 
+// コンパイル結果のキャッシュのキーに使うターゲットの名前を返す
+char *cgtarget(void)
+{
+#ifdef ARMV7
+  return ("armv7");
+#else
+  return ("armv6");
+#endif
+}
+
+// 関数のコードが他の関数のコード生成に依存しなければtrueを返す。
+// リテラルプールは関数ごとなので、残りはパースの時点で決まる
+// .Ldataからの変数の位置だけで、これはcgsymdep()でインクリメンタルモードに知らせる
+int cgfunclocal(void)
+{
+  return (1);
+}
+
+// シンボルidを参照する関数のコードが依存する、バックエンド固有の値を返す。
+// ARMでは.Ldataからの変数の位置
+int cgsymdep(int id)
+{
+  return (Gsym[id].posn);
+}
+
+// ノードopを含む関数を葉の関数として生成できればtrueを返す。
+// idはA_IDENT、A_ADDR、A_FUNCCALLのシンボルID。
+// ARMでは除算も__aeabi_idivの呼び出しになり、
+// ldrの即値に入らない位置の変数にはr3が要る
+int cgleafop(int op, int id)
+{
+  switch (op)
+  {
+  case A_FUNCCALL:
+  case A_DIVIDE:
+    return (0);
+  case A_IDENT:
+    return (Gsym[id].posn <= 0xfff);
+  }
+  return (1);
+}
+
 // グローバルシンボルを生成
 void cgglobsym(int id)
 {
@@ -303,20 +587,25 @@ void cgglobsym(int id)
   // 型のサイズを取得
   typesize = cgprimsize(Gsym[id].type);
 
-  fprintf(Outfile, "\t.data\n"
-                   "\t.globl\t%s\n",
-          Gsym[id].name);
+  emit("\t.data\n"
+       "\t.globl\t%s\n",
+       Gsym[id].name);
   switch (typesize)
   {
   case 1:
-    fprintf(Outfile, "%s:\t.byte\t0\n", Gsym[id].name);
+    emit("%s:\t.byte\t0\n", Gsym[id].name);
     break;
   case 4:
-    fprintf(Outfile, "%s:\t.long\t0\n", Gsym[id].name);
+    Dataoff = (Dataoff + 3) & ~3;
+    emit("\t.align\t2\n"
+         "%s:\t.long\t0\n",
+         Gsym[id].name);
     break;
   default:
     fatald("cgglobsym: 型サイズが不明です", typesize);
   }
+  Gsym[id].posn = Dataoff;
+  Dataoff += typesize;
 }
 
 // 比較命令のリスト
@@ -337,10 +626,10 @@ int cgcompare_and_set(int ASTop, int r1, int r2)
   if (ASTop < A_EQ || ASTop > A_GE)
     fatal("cgcompare_and_set()不正なAST操作です");
 
-  fprintf(Outfile, "\tcmp\t%s, %s\n", reglist[r1], reglist[r2]);
-  fprintf(Outfile, "\t%s\t%s, #1\n", cmplist[ASTop - A_EQ], reglist[r2]);
-  fprintf(Outfile, "\t%s\t%s, #0\n", invcmplist[ASTop - A_EQ], reglist[r2]);
-  fprintf(Outfile, "\tuxtb\t%s, %s\n", reglist[r2], reglist[r2]);
+  emit("\tcmp\t%s, %s\n", reglist[r1], reglist[r2]);
+  emit("\t%s\t%s, #1\n", cmplist[ASTop - A_EQ], reglist[r2]);
+  emit("\t%s\t%s, #0\n", invcmplist[ASTop - A_EQ], reglist[r2]);
+  emit("\tuxtb\t%s, %s\n", reglist[r2], reglist[r2]);
   free_register(r1);
   return (r2);
 }
@@ -348,13 +637,14 @@ int cgcompare_and_set(int ASTop, int r1, int r2)
 // ラベルを生成
 void cglabel(int l)
 {
-  fprintf(Outfile, "L%d:\n", l);
+  R3base = -1;
+  emit("%s:\n", genlabelname(l));
 }
 
 // ラベルへのジャンプを生成
 void cgjump(int l)
 {
-  fprintf(Outfile, "\tb\tL%d\n", l);
+  emit("\tb\t%s\n", genlabelname(l));
 }
 
 // 反転分岐命令のリスト
@@ -369,12 +659,30 @@ int cgcompare_and_jump(int ASTop, int r1, int r2, int label)
   if (ASTop < A_EQ || ASTop > A_GE)
     fatal("cgcompare_and_set()不正なAST操作です");
 
-  fprintf(Outfile, "\tcmp\t%s, %s\n", reglist[r1], reglist[r2]);
-  fprintf(Outfile, "\t%s\tL%d\n", brlist[ASTop - A_EQ], label);
+  emit("\tcmp\t%s, %s\n", reglist[r1], reglist[r2]);
+  emit("\t%s\t%s\n", brlist[ASTop - A_EQ], genlabelname(label));
   freeall_registers();
   return (NOREG);
 }
 
+// 2つのレジスタを比較して真であればtregの値をfregへ移す。
+// 条件付きのmovで分岐せずにどちらかの値を選ぶ。結果の入ったfregを返す
+int cgselect(int ASTop, int r1, int r2, int treg, int freg)
+{
+
+  // AST操作の範囲をチェック
+  if (ASTop < A_EQ || ASTop > A_GE)
+    fatal("cgselect()不正なAST操作です");
+
+  emit("\tcmp\t%s, %s\n", reglist[r1], reglist[r2]);
+  emit("\t%s\t%s, %s\n", cmplist[ASTop - A_EQ], reglist[freg],
+       reglist[treg]);
+  free_register(r1);
+  free_register(r2);
+  free_register(treg);
+  return (freg);
+}
+
 // 拡張前から拡張後へレジスタの値を拡張する。
 // 新しい値が入ったレジスタを返す。
 // this new value
@@ -384,10 +692,31 @@ int cgwiden(int r, int oldtype, int newtype)
   return (r);
 }
 
+// レジスタrの値を関数の値としてレジスタdstへ移す。
+// cgreturn()と同じく値は変換しない。dstは空いているかrであること。dstを返す
+int cgmovereg(int r, int dst, int type)
+{
+  if (r == dst)
+    return (dst);
+  emit("\tmov\t%s, %s\n", reglist[dst], reglist[r]);
+  free_register(r);
+  return (cgclaimreg(dst));
+}
+
+// 空いているレジスタrを確保する。rを返す
+int cgclaimreg(int r)
+{
+  if (!freereg[r])
+    fatald("レジスタの確保に失敗しました", r);
+  freereg[r] = 0;
+  Used |= 1 << r;
+  return (r);
+}
+
 // 関数から値を返すコードを生成
 void cgreturn(int reg, int id)
 {
-  fprintf(Outfile, "\tmov\tr0, %s\n", reglist[reg]);
+  emit("\tmov\tr0, %s\n", reglist[reg]);
   cgjump(Gsym[id].endlabel);
 }
 
@@ -398,9 +727,8 @@ int cgaddress(int id)
   // Get a new register
   int r = alloc_register();
 
-  // Get the offset to the variable
-  set_var_offset(id);
-  fprintf(Outfile, "\tmov\t%s, r3\n", reglist[r]);
+  Usebase = 1;
+  addimm(reglist[r], Base, Gsym[id].posn);
   return (r);
 }
 
@@ -411,11 +739,11 @@ int cgderef(int r, int type)
   switch (type)
   {
   case P_CHARPTR:
-    fprintf(Outfile, "\tldrb\t%s, [%s]\n", reglist[r], reglist[r]);
+    emit("\tldrb\t%s, [%s]\n", reglist[r], reglist[r]);
     break;
   case P_INTPTR:
   case P_LONGPTR:
-    fprintf(Outfile, "\tldr\t%s, [%s]\n", reglist[r], reglist[r]);
+    emit("\tldr\t%s, [%s]\n", reglist[r], reglist[r]);
     break;
   }
   return (r);
@@ -427,14 +755,63 @@ int cgstorderef(int r1, int r2, int type)
   switch (type)
   {
   case P_CHAR:
-    fprintf(Outfile, "\tstrb\t%s, [%s]\n", reglist[r1], reglist[r2]);
+    emit("\tstrb\t%s, [%s]\n", reglist[r1], reglist[r2]);
     break;
   case P_INT:
   case P_LONG:
-    fprintf(Outfile, "\tstr\t%s, [%s]\n", reglist[r1], reglist[r2]);
+    emit("\tstr\t%s, [%s]\n", reglist[r1], reglist[r2]);
     break;
   default:
     fatald("cgstoderefできない型です:", type);
   }
   return (r1);
 }
+
+// 変数用のレジスタの数を返す
+int cgvarregs(void)
+{
+  return (NVARREGS);
+}
+
+// 変数idの値を変数用のレジスタslotへ読み込む
+void cgvarload(int slot, int id)
+{
+  Varused |= 1 << slot;
+  emit("\tldr\t%s, %s\n", varreglist[slot], varaddr(id));
+}
+
+// 変数用のレジスタslotの値を変数idへ書き戻す
+void cgvarstore(int slot, int id)
+{
+  emit("\tstr\t%s, %s\n", varreglist[slot], varaddr(id));
+}
+
+// 変数用のレジスタslotの値をレジスタに入れて、そのレジスタを返す
+int cgloadvarreg(int slot)
+{
+  int r = alloc_register();
+
+  emit("\tmov\t%s, %s\n", reglist[r], varreglist[slot]);
+  return (r);
+}
+
+// レジスタrの値を変数用のレジスタslotへ入れる。rを返す
+int cgstorvarreg(int r, int slot)
+{
+  Varused |= 1 << slot;
+  emit("\tmov\t%s, %s\n", varreglist[slot], reglist[r]);
+  return (r);
+}
+
+// 変数用のレジスタslotへ定数valを足す。
+// 加算の即値に入る8ビットの値でなければ足さずにfalseを返す
+int cgaddvarreg(int slot, int val)
+{
+  if (val >= 0 && val <= 255)
+    emit("\tadd\t%s, %s, #%d\n", varreglist[slot], varreglist[slot], val);
+  else if (val < 0 && val >= -255)
+    emit("\tsub\t%s, %s, #%d\n", varreglist[slot], varreglist[slot], -val);
+  else
+    return (0);
+  return (1);
+}
@@ -9,9 +9,25 @@ extern_ int Putback;    // スキャナによる文字の差し戻し
 extern_ int Functionid; // 現在の関数のシンボルID
 extern_ int Globs;      // グローバルシンボルスロットの次の空いている位置
 extern_ FILE *Infile;   // 入出力ファイル
-extern_ FILE *Outfile;
+extern_ _Thread_local FILE *Outfile; // コード生成スレッドごとの出力先
+extern_ FILE *Errfile;    // 診断メッセージの出力先
+extern_ jmp_buf *Fatalenv; // fatal()の戻り先。NULLであればexit()する
 extern_ struct token Token;             // 最後にスキャンしたトークン
 extern_ char Text[TEXTLEN + 1];         // 最後にスキャンした識別子
 extern_ struct symtable Gsym[NSYMBOLS]; // グローバルシンボルテーブル
 
-extern_ int O_dumpAST;
+extern_ int O_dumpAST;  // -T: ASTツリーを出力
+extern_ int O_timings;  // -t: ファイルごとのコンパイル時間を出力
+extern_ int O_threads;  // -p: 関数単位のコード生成スレッド数
+extern_ int O_pipeline; // -P: パース、コード生成、書き出しをパイプライン化
+extern_ char *O_cachedir; // --cache: コンパイル結果のキャッシュディレクトリ
+extern_ long O_cachesize; // --cache-size: キャッシュの合計サイズの上限(バイト)
+extern_ int O_incremental; // --incremental: 変わっていない関数の出力を再利用
+extern_ char *O_outfile;  // -o: 入力が1つのときの出力ファイル。"-"は標準出力
+extern_ int O_assemble;   // -c: アセンブラへ流し込んでオブジェクトファイルを作る
+extern_ int O_timereport; // -ftime-report: 1で表、2でJSONの計測結果を出力
+extern_ int O_trace;      // --trace: タイムラインをトレースファイルへ書き出す
+extern_ int O_run;        // --run: アセンブリを出力せずに仮想機械で実行する
+extern_ int O_optimize;   // -O1: 中間表現で最適化してからコードを生成する
+extern_ int O_dumpIR;     // -fdump-ir: 最適化した中間表現を出力
+extern_ int Streamout;    // 出力がパイプなどであれば関数ごとにフラッシュする
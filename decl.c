@@ -69,7 +69,10 @@ void var_declaration(int type)
   // 既知の識別子として登録
   // アセンブリでその場所を生成
   id = addglob(Text, type, S_VARIABLE, 0);
-  genglobsym(id);
+  if (O_run)
+    vm_global(id);
+  else
+    genglobsym(id);
   // 後続のセミコロンを取得
   semi();
 }
@@ -87,6 +90,8 @@ struct ASTnode *function_declaration(int type)
   // エンドラベルのラベルidを取得、
   // 関数をシンボルテーブルに追加、
   // グローバルのFuncionidに関数のシンボルidをセット
+  if (O_incremental)
+    inc_startfunc(Text, type);
   endlabel = genlabel();
   nameslot = addglob(Text, type, S_FUNCTION, endlabel);
   Functionid = nameslot;
@@ -116,11 +121,45 @@ struct ASTnode *function_declaration(int type)
   return (mkastunary(A_FUNCTION, type, tree, nameslot));
 }
 
+// パースした関数の木で、-O1では副作用のない関数の定数での呼び出しを
+// 値に置き換え、小さな関数の呼び出しを展開する。
+// -O1と-fdump-irでは中間表現を作って最適化しておく。
+// --traceではパースとは別に、それぞれの処理のスパンを記録する
+static void optimize_function(struct ASTnode *tree)
+{
+  double start = 0;
+
+  if (O_optimize)
+  {
+    if (O_trace)
+      start = trace_now();
+    eval_function(tree);
+    if (O_trace)
+    {
+      trace_span("eval", "eval", start, NULL);
+      start = trace_now();
+    }
+    inline_function(tree);
+    if (O_trace)
+      trace_span("inline", "inline", start, NULL);
+  }
+  if (O_optimize || O_dumpIR)
+  {
+    if (O_trace)
+      start = trace_now();
+    ir_function(tree);
+    if (O_trace)
+      trace_span("ir", "ir", start, NULL);
+  }
+}
+
 // 変数化関数の1つ以上のグローバル宣言をパースする。
 void global_declarations(void)
 {
   struct ASTnode *tree;
   int type;
+  char name[TEXTLEN + 1];
+  double start = 0;
 
   while (1)
   {
@@ -128,26 +167,58 @@ void global_declarations(void)
     // 型と識別子の後ろを見て関数宣言の'('か、
     // 変数宣言の','または';'か確認する。
     // Textはident()の呼び出しにより中身が入っている。
+    // --traceでは宣言の名前でスパンを記録する
+    if (O_trace)
+      start = trace_now();
     type = parse_type();
     ident();
+    if (O_trace)
+      strcpy(name, Text);
     if (Token.token == T_LPAREN)
     {
 
       // 関数宣言をパースして
       // アセンブリコードを生成する。
+      // --runではバイトコードへ翻訳し、
+      // 並列コード生成やパイプラインではワーカーへ渡し、
+      // インクリメンタルモードでは前回の出力を再利用する
       tree = function_declaration(type);
+      if (O_trace)
+        trace_span("parse", "parse", start, NULL);
+      optimize_function(tree);
       if (O_dumpAST)
       {
         dumpAST(tree, NOLABEL, 0);
         fprintf(stdout, "\n\n");
       }
-      genAST(tree, NOREG, 0);
+      if (O_dumpIR)
+        ir_dump(tree->v.id);
+      if (O_run)
+        vm_function(tree);
+      else if (O_incremental)
+        inc_function(tree);
+      else if (O_threads > 1 || O_pipeline)
+        par_function(tree);
+      else
+        genfunction(tree, 0);
+
+      // パイプへの出力では関数ができるたびに読み手へ渡す
+      if (Streamout && O_threads == 1 && !O_pipeline)
+        fflush(Outfile);
     }
     else
     {
 
       // グローバルの変数宣言をパースする
       var_declaration(type);
+      if (O_trace)
+        trace_span("parse", "parse", start, NULL);
+    }
+
+    if (O_trace)
+    {
+      trace_span("decl", name, start, NULL);
+      trace_arena();
     }
 
     // EOFについたら終了
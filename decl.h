@@ -1,4 +1,18 @@
+// alias.c
+int ir_ptrbase(struct irinst *v);
+int ir_mayalias(struct irinst *n, int id);
+int ir_accessalias(struct irinst *a, struct irinst *b);
+int ir_noalias(struct irfunc *fn, struct irinst *n);
+void ir_alias(struct irfunc *fn);
+
+// arena.c
+void *arena_alloc(size_t size);
+char *arena_strdup(char *s);
+void arena_reset(void);
+size_t arena_bytes(void);
+
 // scan.c
+void scan_reset(void);
 void reject_token(struct token *t);
 int scan(struct token *t);
 
@@ -14,6 +28,10 @@ void dumpAST(struct ASTnode *n, int label, int parentASTop);
 
 // gen.c
 int genlabel(void);
+char *genlabelname(int l);
+int genlabelcount(struct ASTnode *n);
+int genreservelabels(int count);
+void genfunction(struct ASTnode *n, int labelbase);
 int genAST(struct ASTnode *n, int reg, int parentASTop);
 void genpreamble();
 void genpostamble();
@@ -21,17 +39,20 @@ void genfreeregs();
 void genprintint(int reg);
 void genglobsym(int id);
 int genprimsize(int type);
+int genscale(int reg, int size);
+int genleaf(struct ASTnode *n);
 void genreturn(int reg, int id);
 
 // cg.c
 void freeall_registers(void);
 void cgpreamble();
 void cgpostamble();
-void cgfuncpreamble(int id);
+void cgfuncpreamble(int id, int leaf);
 void cgfuncpostamble(int id);
 int cgloadint(int value, int type);
 int cgloadglob(int id);
 int cgadd(int r1, int r2);
+int cgaddscaled(int r1, int r2, int size);
 int cgsub(int r1, int r2);
 int cgmul(int r1, int r2);
 int cgdiv(int r1, int r2);
@@ -42,14 +63,27 @@ int cgstorglob(int r, int id);
 void cgglobsym(int id);
 int cgcompare_and_set(int ASTop, int r1, int r2);
 int cgcompare_and_jump(int ASTop, int r1, int r2, int label);
+int cgselect(int ASTop, int r1, int r2, int treg, int freg);
 void cglabel(int l);
 void cgjump(int l);
 int cgwiden(int r, int oldtype, int newtype);
 int cgprimsize(int type);
+int cgfunclocal(void);
+int cgsymdep(int id);
+int cgleafop(int op, int id);
+int cgmovereg(int r, int dst, int type);
+int cgclaimreg(int r);
+char *cgtarget(void);
 void cgreturn(int reg, int id);
 int cgaddress(int id);
 int cgderef(int r, int type);
 int cgstorderef(int r1, int r2, int type);
+int cgvarregs(void);
+void cgvarload(int slot, int id);
+void cgvarstore(int slot, int id);
+int cgloadvarreg(int slot);
+int cgstorvarreg(int r, int slot);
+int cgaddvarreg(int slot, int val);
 
 // expr.c
 struct ASTnode *funccall(void);
@@ -70,8 +104,14 @@ void fatal(char *s);
 void fatals(char *s1, char *s2);
 void fatald(char *s, int d);
 void fatalc(char *s, int c);
+hash128 fnv1a(hash128 h, void *buf, size_t len);
+hash128 fnv1a_str(hash128 h, char *s);
+void hashstr(hash128 h, char *buf);
+char *slurp(char *file, size_t *len);
+FILE *openbuf(char *buf, size_t len);
 
 // sym.c
+void clearglobs(void);
 int findglob(char *s);
 int addglob(char *name, int type, int stype, int endlabel);
 
@@ -80,8 +120,105 @@ void var_declaration(int type);
 struct ASTnode *function_declaration(int type);
 void global_declarations(void);
 
+// main.c
+void compile(FILE *in, FILE *out);
+void compile_file(char *infile, char *outfile);
+void reset_options(void);
+int compile_option(char *arg);
+void compile_flags(char *buf, int size);
+
+// driver.c
+double now(void);
+char *outname(char *infile, int nfiles);
+FILE *openout(char *outfile, pid_t *pid);
+int closeout(FILE *f, pid_t pid);
+int compile_files(char **files, int nfiles, int jobs);
+
+// par.c
+void par_begin(int nthreads);
+void par_function(struct ASTnode *tree);
+void par_waitfunc(int id);
+void par_end(void);
+
+// server.c
+int server(char *path);
+int client(char *path, char **files, int nfiles, int bench);
+
+// cache.c
+int cache_lookup(char *src, size_t len, char *outfile, char *key);
+void cache_store(char *outfile, char *key);
+void cache_report(void);
+
+// incr.c
+void inc_load(char *dbfile);
+void inc_save(char *dbfile);
+void inc_startfunc(char *name, int type);
+void inc_token(struct token *t);
+void inc_ref(int id);
+void inc_value(int id, long value);
+void inc_inline(int id);
+void inc_function(struct ASTnode *tree);
+
+// stats.c
+void stats_enter(int ph);
+void stats_leave(void);
+void stats_count(int c, long n);
+void stats_probe(int probes);
+void stats_begin(void);
+FILE *stats_wrap(FILE *out);
+void stats_report(char *file, int json);
+
+// trace.c
+double trace_now(void);
+void trace_span(char *cat, char *name, double start, char *detail);
+void trace_thread(char *name);
+void trace_arena(void);
+void trace_live(int live);
+void trace_regsample(void);
+FILE *trace_wrap(FILE *out);
+void trace_flush(char *file);
+int trace_open(char *file);
+
+// interp.c
+void vm_global(int id);
+void vm_function(struct ASTnode *n);
+int vm_runfile(char *infile);
+
+// eval.c
+void eval_function(struct ASTnode *tree);
+
+// inline.c
+void inline_function(struct ASTnode *tree);
+
+// ir.c
+struct irinst *ir_resolve(struct irinst *v);
+struct irinst *ir_storedval(struct irinst *n);
+void ir_resolveargs(struct irfunc *fn);
+void ir_setentry(struct irblock *b, int var, struct irinst *val);
+struct irinst *ir_newinst(struct irfunc *fn, int op, int type);
+struct irinst *ir_const(struct irfunc *fn, long val, int type);
+void ir_unlink(struct irinst *n);
+void ir_removeedge(struct irblock *from, struct irblock *to);
+struct irblock *ir_newblock(struct irfunc *fn);
+void ir_append(struct irblock *b, struct irinst *n);
+void ir_insertterm(struct irblock *b, struct irinst *n);
+void ir_function(struct ASTnode *tree);
+int ir_labelcount(int id);
+void ir_dump(int id);
+
+// opt.c
+int ir_dominates(struct irblock *a, struct irblock *b);
+void ir_optimize(struct irfunc *fn);
+
+// loop.c
+void ir_promote(struct irfunc *fn, struct irblock **order, int count);
+
+// irgen.c
+void ir_genbody(int id);
+
 // types.c
 int parse_type(void);
 int pointer_to(int type);
 int value_at(int type);
+int ptrtype(int type);
 struct ASTnode *modify_type(struct ASTnode *tree, int rtype, int op);
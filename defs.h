@@ -2,10 +2,24 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <setjmp.h>
+#include <sys/types.h>
 
 // 構造体とenum定義
+#define VERSION "tinycc 0.19" // コンパイラのバージョン
+// コンパイラのソースのハッシュ。Makefileが-DBUILDIDで渡す。
+// キャッシュと差分コンパイルは、作り直したコンパイラの前の出力を使わない
+#ifndef BUILDID
+#define BUILDID "unknown"
+#endif
+#define COMPILERID VERSION " " BUILDID // 出力を作ったコンパイラ
 #define TEXTLEN 512   //  入力のシンボルの長さ
-#define NSYMBOLS 1024 //  シンボルテーブルのエントリ数
+#define NSYMBOLS 65536 //  シンボルテーブルのエントリ数
+
+// 128ビットのハッシュ値。FNV-1aで計算する
+typedef unsigned __int128 hash128;
+#define FNV128BASIS (((hash128)0x6c62272e07bb0142ULL << 64) + 0x62b821756295c58dULL)
+#define HASHSTRLEN 33 // 16進表記とNUL文字
 
 // トークン
 enum
@@ -77,8 +91,36 @@ enum
   A_FUNCCALL,
   A_DEREF,
   A_ADDR,
-  A_SCALE
+  A_SCALE,
+  A_INLINE,
+  A_LEAVE
+
+};
 
+// -ftime-reportで時間を計るフェーズ
+enum
+{
+  PH_SCAN,
+  PH_PARSE,
+  PH_TYPES,
+  PH_GEN,
+  PH_WRITE,
+  PH_MAX
+};
+
+// -ftime-reportのカウンタ
+enum
+{
+  ST_TOKENS,
+  ST_NODES,
+  ST_FINDGLOB,
+  ST_PROBES,
+  ST_REGS,
+  ST_LABELS,
+  ST_BYTES,
+  ST_DEREFS,
+  ST_NOALIAS,
+  ST_MAX
 };
 
 // primitive types
@@ -113,6 +155,9 @@ struct ASTnode
 };
 
 #define NOREG -1 // AST生成関数が返すレジスタがないときに使う
+// 展開した関数の値を入れるレジスタ。展開するのは使用中のレジスタが
+// ないときに計算される呼び出しだけなので、最初のレジスタが空いている
+#define INLINE_REG 0
 // 構造上の型
 #define NOLABEL 0 // genAST()に渡すラベルがないときに使う
 enum
@@ -128,4 +173,159 @@ struct symtable
   int type;     // シンボルのprimitive type
   int stype;    // シンボルの構造上の型
   int endlabel; // S_FUNCTIONのため、エンドラベル
+  int posn;     // S_VARIABLEのため、バックエンドが決めるデータ領域での位置
+  struct ASTnode *pure; // S_FUNCTIONのため、副作用のない関数であればその本体
+  int clobber;  // S_FUNCTIONのため、呼び出すと壊れるかもしれないレジスタの集合。-1は不明
+  struct ASTnode *inl;  // S_FUNCTIONのため、呼び出しへ展開できる関数であればその本体
+  struct irfunc *ir;    // S_FUNCTIONのため、-O1で作った中間表現
+};
+
+// 中間表現の命令
+enum
+{
+  IR_CONST = 1, // 定数
+  IR_ADDR,      // 大域変数のアドレス
+  IR_LOAD,      // 大域変数の読み込み
+  IR_STORE,     // 大域変数への保存
+  IR_ADD,
+  IR_SUB,
+  IR_MUL,
+  IR_DIV,
+  IR_EQ, // 比較はA_EQからA_GEと同じ並び
+  IR_NE,
+  IR_LT,
+  IR_GT,
+  IR_LE,
+  IR_GE,
+  IR_WIDEN,   // 型の拡張
+  IR_SCALE,   // ポインタに足す値のスケール
+  IR_DEREF,   // ポインタの指す値の読み込み
+  IR_STDEREF, // ポインタの指す先への保存
+  IR_CALL,    // 関数呼び出し
+  IR_PHI,     // 先行ブロックごとの値の合流
+  IR_EVAL,    // 値を捨てる式の文
+  IR_PROMOTE, // 変数を変数用のレジスタへ読み込む
+  IR_DEMOTE,  // 変数用のレジスタの値を変数へ書き戻す
+  IR_HOIST,   // ループで変わらない値を変数用のレジスタへ入れる
+  IR_LEAVE,   // 展開した本体からの値
+  IR_RET,     // 関数から値を返す
+  IR_BR,      // 条件分岐
+  IR_JMP      // 無条件分岐
+};
+
+// 中間表現の命令のフラグ
+#define IRF_ROOT 1    // 文の木の根。生成はここから始める
+#define IRF_EFFECT 2  // 木の中に副作用がある
+#define IRF_EXACT 4   // IR_STORE: 保存した値がそのまま変数の値になる
+#define IRF_INLINE 8  // IR_PHI: 展開した呼び出しの値。INLINE_REGにある
+#define IRF_LIVE 16   // 不要命令の削除で使う
+
+// 中間表現の命令。値を作る命令はその値も表す
+struct irinst
+{
+  int op;                // IR_*
+  int type;              // 値の型
+  int id;                // シンボルID。IR_PHIでは変数か、展開して呼んだ関数の
+  int var;               // 変数の関数内での番号。IR_LOAD, IR_STORE, IR_PHI,
+                         // IR_PROMOTE, IR_DEMOTE
+  long val;              // IR_CONSTの値、IR_WIDENの元の型、IR_SCALEの大きさ、
+                         // IR_DEREFのポインタの型、IR_STDEREFの値の型、
+                         // IR_PROMOTE、IR_DEMOTE、IR_HOISTのレジスタの番号
+  int num;               // 値の番号
+  int stmt;              // 属する文の木の番号。0はどの木にも属さない
+  int flags;             // IRF_*
+  int nargs;             // 引数の数
+  struct irinst **args;  // 引数。IR_PHIでは先行ブロックの順
+  struct irinst *abuf[2];
+  struct irblock *block; // 属するブロック
+  struct irinst *prev;   // ブロックの中の命令の列
+  struct irinst *next;
+  struct irinst *repl;   // 置き換えた先の値
+  struct irinst *leader; // 値番号付けで同じ値とわかった最初の命令
+  int lat;               // 疎な条件付き定数伝播の束の値
+  long cval;             // その定数
+  int hvar;              // コード生成: この値を持っていそうな変数
+  int done;              // コード生成: 副作用のある命令を生成した
+  int hslot;             // コード生成: ループの間この値を置いた変数用のレジスタ。
+                         // -1は置いていない
+  int base;              // 別名解析: φのポインタが指す変数のシンボルID。
+                         // -1はわからない、-2はまだ求めていない
+};
+
+// 変数の定義。ブロックごとの連結リスト
+struct irdef
+{
+  int var;            // 変数の関数内での番号
+  int stamp;          // 定義したときのブロックの書き換えの回数
+  struct irinst *val; // 値
+  struct irdef *next;
+  struct irdef **list; // 属するリストの先頭の場所
+  struct irdef *hnext; // 定義を探す表の同じ枠の列
+};
+
+// ループの間、変数用のレジスタに置く変数か、ループで変わらない値か、
+// ループの変数から計算するポインタ。ブロックごとの連結リスト
+struct irpromo
+{
+  int var;            // 変数の関数内での番号。値を置くときは-1
+  struct irinst *val; // 前ブロックで計算した値。ポインタでは元のポインタ
+  int slot;           // 変数用のレジスタの番号
+  int written;        // ループの中で保存する
+  int iv;             // ポインタを計算するループの変数の番号。ほかは-1
+  long size;          // ループの変数に掛ける大きさ。引くときは負
+  struct irpromo *next;
+};
+
+// 中間表現の基本ブロック
+struct irblock
+{
+  int num;                  // 作った順の番号
+  struct irinst *phis;      // φ命令の列
+  struct irinst *head;      // 命令の列。終端命令は最後
+  struct irinst *tail;
+  struct irblock **preds;   // 先行ブロック
+  int npreds;
+  int maxpreds;
+  struct irblock *succs[2]; // 後続ブロック。IR_BRでは真と偽の順
+  int nsuccs;
+  int sealed;               // 先行ブロックがすべてわかっている
+  int clobbers;             // 構築中: 変数を書き換えうる命令の数
+  struct irinst **clobs;    // 構築中: 変数を書き換えうる命令の並び
+  int maxclobs;             // clobsの大きさ
+  int lastcall;             // 構築中: 最後の呼び出しの後のclobbersの値
+  struct irdef *defs;       // 構築中: ブロックの中の変数の定義
+  struct irdef *entry;      // 入口での変数の値
+  struct irdef *incomplete; // 構築中: 封じる前に作ったφ
+  struct irblock *next;     // 配置の順
+  struct irblock *allnext;  // 作った順
+  int exec;                 // 実行されうる
+  char *execin;             // 先行ブロックからの辺が実行されうる
+  int rpo;                  // 逆後順の番号
+  struct irblock *idom;     // 直接支配ブロック
+  struct irblock *child;    // 支配木
+  struct irblock *sibling;
+  int pre;                  // 支配木の前順と後順の番号
+  int post;
+  int loop;                 // ループの最適化: 属するループの印
+  int depth;                // ループの最適化: ループの入れ子の深さ
+  struct irpromo *promo;    // 変数用のレジスタに置いている変数
+  int label;                // コード生成: ラベル
+  int jumped;               // コード生成: 分岐で飛んでくる
+  int lowered;              // コード生成: 生成した
+  struct irinst **exitval;  // コード生成: 出口で変数が持っている値
+};
+
+// 中間表現の関数
+struct irfunc
+{
+  int id;                // 関数のシンボルID
+  struct irblock *entry; // 入口のブロック。配置の先頭
+  struct irblock *last;  // 配置の最後
+  struct irblock *all;   // 作った順のブロックの列
+  struct irblock *alltail;
+  int nblocks;           // 作ったブロックの数
+  int ninsts;            // 作った命令の数
+  int nstmts;            // 文の数
+  int nvars;             // 関数で使う変数の数
+  int *varids;           // 変数の番号からシンボルIDへ
 };
@@ -0,0 +1,279 @@
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+#include <errno.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// 複数ファイルのコンパイルドライバ。
+// 入力ファイルごとに子プロセスをforkし、最大jobs個を並行して走らせる。
+// コンパイラの状態はすべてグローバル変数なので、
+// プロセスを分けるのが一番安全に並列化できる方法となる。
+
+// 1つの入力ファイルに対するジョブ
+struct job
+{
+  char *infile;  // 入力ファイル名
+  char *outfile; // 出力ファイル名
+  off_t size;    // 入力ファイルのサイズ。大きいものから先にスケジュールする
+  pid_t pid;     // 実行中の子プロセス。いなければ0
+  FILE *errfile; // 子プロセスの標準エラー出力を溜めておく一時ファイル
+  int status;    // 子プロセスの終了ステータス
+  double start;  // 開始と終了の時刻(秒)
+  double end;
+};
+
+// 単調増加する時計の現在時刻を秒で返す
+double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+// 入力ファイル名から出力ファイル名を作る。
+// 入力が1つだけであれば-oの名前か、なければこれまで通りout.s、
+// そうでなければ拡張子の".c"を".s"に置き換える。
+// -cでアセンブルするときは拡張子が".o"になる
+char *outname(char *infile, int nfiles)
+{
+  char *out, *ext = O_assemble ? ".o" : ".s";
+  int len;
+
+  if (nfiles == 1)
+  {
+    if (O_outfile)
+      return (O_outfile);
+    infile = "out";
+  }
+
+  len = strlen(infile);
+  if (len > 2 && !strcmp(infile + len - 2, ".c"))
+    len -= 2;
+  if ((out = malloc(len + 3)) == NULL)
+    fatal("メモリが確保できませんでした。outname()");
+  memcpy(out, infile, len);
+  strcpy(out + len, ext);
+  return (out);
+}
+
+static pid_t Aspid;   // 実行中のアセンブラ。なければ0
+static char *Asout;   // アセンブラの出力ファイル
+
+// 出力を閉じる前に終了したときは、途中までのアセンブリから
+// オブジェクトファイルが作られないようにアセンブラを止めて出力を消す
+static void killas(void)
+{
+  if (Aspid <= 0)
+    return;
+  kill(Aspid, SIGKILL);
+  waitpid(Aspid, NULL, 0);
+  if (strcmp(Asout, "-"))
+    unlink(Asout);
+  Aspid = 0;
+}
+
+// 出力先を開く。"-"であれば標準出力、-cであればアセンブラを起動して
+// その標準入力へのパイプを返す。パイプにはアセンブリを書いたそばから流し込み、
+// アセンブラはコンパイルと並行して動く。*pidには起動したアセンブラを返す
+FILE *openout(char *outfile, pid_t *pid)
+{
+  int fd[2];
+  char *as;
+  FILE *f;
+
+  *pid = 0;
+  if (!O_assemble)
+  {
+    if (!strcmp(outfile, "-"))
+      return (stdout);
+    return (fopen(outfile, "w"));
+  }
+
+  if ((as = getenv("AS")) == NULL || *as == '\0')
+    as = "as";
+  if (pipe(fd) == -1)
+    return (NULL);
+
+  // アセンブラが途中で終了しても書き込みのエラーとして扱い、
+  // closeout()で失敗を報告する
+  signal(SIGPIPE, SIG_IGN);
+  fflush(stdout);
+  fflush(stderr);
+  if ((*pid = fork()) == -1)
+  {
+    close(fd[0]);
+    close(fd[1]);
+    return (NULL);
+  }
+  if (*pid == 0)
+  {
+    // 子プロセス: パイプを標準入力にしてアセンブラを実行する
+    Aspid = 0;
+    dup2(fd[0], 0);
+    close(fd[0]);
+    close(fd[1]);
+    execlp(as, as, "-o", !strcmp(outfile, "-") ? "/dev/stdout" : outfile,
+           (char *)NULL);
+    fprintf(stderr, "%s を実行できません:%s\n", as, strerror(errno));
+    _exit(127);
+  }
+  close(fd[0]);
+  if (Asout == NULL)
+    atexit(killas);
+  Aspid = *pid;
+  Asout = outfile;
+  if ((f = fdopen(fd[1], "w")) == NULL)
+    close(fd[1]);
+  return (f);
+}
+
+// openout()で開いた出力先を閉じる。
+// アセンブラを起動していればその終了を待つ。失敗すれば-1を返す
+int closeout(FILE *f, pid_t pid)
+{
+  int err = 0, status;
+
+  if (f == stdout)
+    return (fflush(f) == 0 ? 0 : -1);
+  if (fclose(f) != 0)
+    err = -1;
+  if (pid > 0)
+  {
+    Aspid = 0;
+    while (waitpid(pid, &status, 0) == -1)
+      if (errno != EINTR)
+        return (-1);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      err = -1;
+  }
+  return (err);
+}
+
+// qsort()用。入力サイズの降順に並べる
+static int bysize(const void *a, const void *b)
+{
+  const struct job *ja = *(const struct job **)a;
+  const struct job *jb = *(const struct job **)b;
+
+  if (ja->size != jb->size)
+    return (ja->size < jb->size ? 1 : -1);
+  return (ja < jb ? -1 : 1);
+}
+
+// ジョブを子プロセスで開始する
+static void startjob(struct job *j)
+{
+  if ((j->errfile = tmpfile()) == NULL)
+    fatals("一時ファイルを作成できません", strerror(errno));
+
+  fflush(stdout);
+  fflush(stderr);
+  j->start = now();
+  if ((j->pid = fork()) == -1)
+    fatals("forkできません", strerror(errno));
+
+  if (j->pid == 0)
+  {
+    // 子プロセス: 診断メッセージを一時ファイルへ向けてコンパイルする
+    dup2(fileno(j->errfile), 2);
+    compile_file(j->infile, j->outfile);
+    exit(0);
+  }
+}
+
+// 一時ファイルに溜めた診断メッセージを、行ごとにファイル名を付けて出力する
+static void printdiag(struct job *j)
+{
+  char line[TEXTLEN];
+  int bol = 1;
+
+  rewind(j->errfile);
+  while (fgets(line, sizeof(line), j->errfile) != NULL)
+  {
+    if (bol)
+      fprintf(stderr, "%s: ", j->infile);
+    fputs(line, stderr);
+    bol = (strchr(line, '\n') != NULL);
+  }
+  if (!bol)
+    fputc('\n', stderr);
+  fclose(j->errfile);
+}
+
+// 入力ファイルをjobs個のワーカーでコンパイルする。
+// 大きいファイルから順に開始し、診断メッセージは入力順に出力する。
+// 1つでも失敗すれば1を返す
+int compile_files(char **files, int nfiles, int jobs)
+{
+  struct job *joblist, **order;
+  int i, next, running, failed = 0;
+  double start;
+  struct stat st;
+  pid_t pid;
+  int status;
+
+  joblist = calloc(nfiles, sizeof(struct job));
+  order = malloc(nfiles * sizeof(struct job *));
+  if (joblist == NULL || order == NULL)
+    fatal("メモリが確保できませんでした。compile_files()");
+
+  for (i = 0; i < nfiles; i++)
+  {
+    joblist[i].infile = files[i];
+    joblist[i].outfile = outname(files[i], nfiles);
+    joblist[i].size = (stat(files[i], &st) == 0) ? st.st_size : 0;
+    order[i] = &joblist[i];
+  }
+  qsort(order, nfiles, sizeof(struct job *), bysize);
+
+  // ワーカーが空くたびに次に大きいジョブを開始する
+  start = now();
+  next = running = 0;
+  while (next < nfiles || running > 0)
+  {
+    if (next < nfiles && running < jobs)
+    {
+      startjob(order[next++]);
+      running++;
+      continue;
+    }
+
+    if ((pid = wait(&status)) == -1)
+      fatals("waitに失敗しました", strerror(errno));
+    for (i = 0; i < nfiles; i++)
+    {
+      if (joblist[i].pid == pid)
+      {
+        joblist[i].end = now();
+        joblist[i].status = status;
+        joblist[i].pid = 0;
+        running--;
+        break;
+      }
+    }
+  }
+
+  // 診断メッセージは実行順ではなく入力順に出力する
+  for (i = 0; i < nfiles; i++)
+  {
+    printdiag(&joblist[i]);
+    if (!WIFEXITED(joblist[i].status) || WEXITSTATUS(joblist[i].status) != 0)
+      failed = 1;
+  }
+
+  if (O_timings)
+  {
+    for (i = 0; i < nfiles; i++)
+      fprintf(stderr, "%10.3f ms  %s\n",
+              (joblist[i].end - joblist[i].start) * 1000, joblist[i].infile);
+    fprintf(stderr, "%10.3f ms  合計 (%d ファイル, %d ジョブ)\n",
+            (now() - start) * 1000, nfiles, jobs);
+  }
+
+  return (failed);
+}
@@ -0,0 +1,294 @@
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+#include <limits.h>
+
+// 副作用のない関数のコンパイル時の評価
+//
+// 関数の本体が定数、算術演算、比較、if文、while文、return文と、
+// 同じく副作用のない関数の呼び出しだけでできていれば、その関数は
+// 大域変数にもポインタの先にも触れないので、いつ呼んでも同じ値を返す。
+// そのような関数を定数の引数で呼ぶ式は、本体をここで実行して
+// 値をA_INTLITに置き換える。
+//
+// 評価は燃料(評価するノードの数)と呼び出しの深さで打ち切る。
+// 途中の値がintに収まらないとき、0で割るとき、燃料が切れたときは
+// 置き換えずに実行時の呼び出しを残す。値をintに収めておけば
+// 64ビットのx86-64でも32ビットのARMでも結果が変わらない。
+// 文として呼んで値を捨てる呼び出しは、置き換えても何も得がないのでそのままにする。
+// -O0の出力と-Tのダンプを変えないように、評価は-O1のときだけ行う。
+
+#define EVALFUEL 10000 // 1つの呼び出しの評価で辿るノードの数の上限
+#define EVALDEPTH 64   // 呼び出しの入れ子の深さの上限
+
+// 評価の結果
+enum
+{
+  EV_FAIL,  // 評価できない
+  EV_VALUE, // 式の値か、最後まで実行した文
+  EV_RETURN // return文を実行した
+};
+
+static int Fuel;  // 残りの燃料
+static int Depth; // 呼び出しの入れ子の深さ
+
+// 式nが副作用のない関数の中で使えるものであればtrueを返す。
+// selfは調べている関数のシンボルIDで、自分自身の呼び出しは許す
+static int pureexpr(struct ASTnode *n, int self)
+{
+  switch (n->op)
+  {
+  case A_INTLIT:
+    return (1);
+  case A_WIDEN:
+    return (pureexpr(n->left, self));
+  case A_ADD:
+  case A_SUBTRACT:
+  case A_MULTIPLY:
+  case A_DIVIDE:
+  case A_EQ:
+  case A_NE:
+  case A_LT:
+  case A_GT:
+  case A_LE:
+  case A_GE:
+    return (pureexpr(n->left, self) && pureexpr(n->right, self));
+  case A_FUNCCALL:
+    if (n->v.id != self && Gsym[n->v.id].pure == NULL)
+      return (0);
+    return (pureexpr(n->left, self));
+  case A_INLINE:
+    // 展開した呼び出しは、呼ばれた関数の本体で調べた結果による
+    return (Gsym[n->v.id].pure != NULL);
+  }
+  return (0);
+}
+
+// 文nが副作用のない関数の中で使えるものであればtrueを返す。
+// 文の並びは左に深く伸びるので、左の子へは再帰せずにたどる
+static int purestmt(struct ASTnode *n, int self)
+{
+  for (; n != NULL; n = n->left)
+  {
+    switch (n->op)
+    {
+    case A_GLUE:
+      if (!purestmt(n->right, self))
+        return (0);
+      continue;
+    case A_IF:
+      return (pureexpr(n->left, self) && purestmt(n->mid, self) &&
+              purestmt(n->right, self));
+    case A_WHILE:
+      return (pureexpr(n->left, self) && purestmt(n->right, self));
+    case A_RETURN:
+      return (pureexpr(n->left, self));
+    }
+    return (pureexpr(n, self));
+  }
+  return (1);
+}
+
+static int evalcall(int id, long *val);
+
+// 式nを評価して*valへ入れる
+static int evalexpr(struct ASTnode *n, long *val)
+{
+  long l, r;
+
+  if (--Fuel < 0)
+    return (EV_FAIL);
+  switch (n->op)
+  {
+  case A_INTLIT:
+    *val = n->v.intvalue;
+    return (EV_VALUE);
+  case A_WIDEN:
+    return (evalexpr(n->left, val));
+  case A_FUNCCALL:
+    // 引数は呼ばれた関数では使われないが、評価できることは確かめる
+    if (evalexpr(n->left, &l) == EV_FAIL)
+      return (EV_FAIL);
+    return (evalcall(n->v.id, val));
+  case A_INLINE:
+    // 展開した呼び出しも呼ばれた関数の本体で評価する
+    return (evalcall(n->v.id, val));
+  }
+
+  if (evalexpr(n->left, &l) == EV_FAIL || evalexpr(n->right, &r) == EV_FAIL)
+    return (EV_FAIL);
+  switch (n->op)
+  {
+  case A_ADD:
+    *val = l + r;
+    break;
+  case A_SUBTRACT:
+    *val = l - r;
+    break;
+  case A_MULTIPLY:
+    *val = l * r;
+    break;
+  case A_DIVIDE:
+    if (r == 0)
+      return (EV_FAIL);
+    *val = l / r;
+    break;
+  case A_EQ:
+    *val = (l == r);
+    break;
+  case A_NE:
+    *val = (l != r);
+    break;
+  case A_LT:
+    *val = (l < r);
+    break;
+  case A_GT:
+    *val = (l > r);
+    break;
+  case A_LE:
+    *val = (l <= r);
+    break;
+  case A_GE:
+    *val = (l >= r);
+    break;
+  default:
+    return (EV_FAIL);
+  }
+
+  // 両辺がintに収まっていれば、積も64ビットに収まる
+  if (*val < INT_MIN || *val > INT_MAX)
+    return (EV_FAIL);
+  return (EV_VALUE);
+}
+
+// 文nを実行する。return文に着けば*valへ値を入れてEV_RETURNを返す
+static int evalstmt(struct ASTnode *n, long *val)
+{
+  long cond;
+  int st;
+
+  if (n == NULL)
+    return (EV_VALUE);
+  if (--Fuel < 0)
+    return (EV_FAIL);
+  switch (n->op)
+  {
+  case A_GLUE:
+    if ((st = evalstmt(n->left, val)) != EV_VALUE)
+      return (st);
+    return (evalstmt(n->right, val));
+  case A_IF:
+    if (evalexpr(n->left, &cond) == EV_FAIL)
+      return (EV_FAIL);
+    return (evalstmt(cond ? n->mid : n->right, val));
+  case A_WHILE:
+    while (1)
+    {
+      if (evalexpr(n->left, &cond) == EV_FAIL)
+        return (EV_FAIL);
+      if (!cond)
+        return (EV_VALUE);
+      if ((st = evalstmt(n->right, val)) != EV_VALUE)
+        return (st);
+    }
+  case A_RETURN:
+    if (evalexpr(n->left, val) == EV_FAIL)
+      return (EV_FAIL);
+    return (EV_RETURN);
+  }
+
+  // 式の文は値を捨てる
+  return (evalexpr(n, &cond));
+}
+
+// 副作用のない関数idを実行して戻り値を*valへ入れる
+static int evalcall(int id, long *val)
+{
+  int st;
+
+  if (Gsym[id].pure == NULL || Depth == EVALDEPTH)
+    return (EV_FAIL);
+  Depth++;
+  st = evalstmt(Gsym[id].pure, val);
+  Depth--;
+  if (st == EV_FAIL)
+    return (EV_FAIL);
+
+  // 最後まで実行したvoid関数の値は使われない
+  if (st == EV_VALUE)
+    *val = 0;
+  return (EV_VALUE);
+}
+
+// 値valが型typeのA_INTLITとして表せればtrueを返す
+static int fits(long val, int type)
+{
+  if (type == P_CHAR)
+    return (val >= 0 && val <= 255);
+  return (val >= INT_MIN && val <= INT_MAX);
+}
+
+// 式nの中の、副作用のない関数を定数で呼ぶ式を値に置き換える。
+// 内側の呼び出しから置き換えるので、引数が定数の式になった呼び出しも置き換わる
+static void foldexpr(struct ASTnode *n)
+{
+  long val;
+
+  if (n == NULL)
+    return;
+  foldexpr(n->left);
+  foldexpr(n->mid);
+  foldexpr(n->right);
+  if (n->op != A_FUNCCALL || Gsym[n->v.id].pure == NULL ||
+      n->left->op != A_INTLIT)
+    return;
+
+  Fuel = EVALFUEL;
+  Depth = 0;
+  if (evalcall(n->v.id, &val) == EV_FAIL || !fits(val, n->type))
+    return;
+  if (O_incremental)
+    inc_value(n->v.id, val);
+  n->op = A_INTLIT;
+  n->left = NULL;
+  n->v.intvalue = val;
+}
+
+// 文nの中の式を置き換える。文の並びは左に深く伸びるので左の子はたどる
+static void foldstmt(struct ASTnode *n)
+{
+  for (; n != NULL; n = n->left)
+  {
+    switch (n->op)
+    {
+    case A_GLUE:
+      foldstmt(n->right);
+      continue;
+    case A_IF:
+      foldexpr(n->left);
+      foldstmt(n->mid);
+      foldstmt(n->right);
+      return;
+    case A_WHILE:
+      foldexpr(n->left);
+      foldstmt(n->right);
+      return;
+    case A_FUNCCALL:
+      // 値を捨てる呼び出しは残し、引数だけ置き換える
+      foldexpr(n->left);
+      return;
+    }
+    foldexpr(n);
+    return;
+  }
+}
+
+// パースした関数の本体の中の呼び出しを置き換え、
+// 関数に副作用がなければ、後の呼び出しで評価できるように本体を記録する
+void eval_function(struct ASTnode *tree)
+{
+  int id = tree->v.id;
+
+  foldstmt(tree->left);
+  Gsym[id].pure = purestmt(tree->left, id) ? tree->left : NULL;
+}
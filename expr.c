@@ -240,8 +240,10 @@ struct ASTnode *binexpr(int ptp)
     // セミコロンか')'を見つけたら左ノードを返す
     tokentype = Token.token;
     if (tokentype == T_SEMI || tokentype == T_RPAREN)
+    {
       left->rvalue = 1;
-    return (left);
+      return (left);
+    }
   }
   // 優先順位が同じか低いものになったらツリーを返す
   left->rvalue = 1;
@@ -4,11 +4,225 @@
 
 // 汎用コードジェネレータ
 
+// 次に払い出すラベル番号
+static int Labelid = 1;
+
+// コード生成スレッドごとの状態。
+// Labelcursorが0でなければ、関数用に予約したラベル番号を順に払い出す。
+// Genfuncidはコードを生成中の関数のシンボルID。
+// Inlinelabelは生成中の展開した本体の後ろの合流点のラベルで、
+// Inlinelastはその本体の最後の文
+static _Thread_local int Labelcursor;
+static _Thread_local int Genfuncid;
+static _Thread_local int Inlinelabel;
+static _Thread_local struct ASTnode *Inlinelast;
+
 // 新しいラベル番号を生成して返す
 int genlabel(void)
 {
-  static int id = 1;
-  return (id++);
+  if (O_timereport)
+    stats_count(ST_LABELS, 1);
+  if (Labelcursor)
+    return (Labelcursor++);
+  return (Labelid++);
+}
+
+// アセンブリでのラベルlの名前を返す。返す文字列は次の呼び出しで上書きされる。
+// インクリメンタルモードでは関数名と関数のエンドラベルからの相対番号で名前を付け、
+// 関数の出力が前後の関数に左右されないようにする
+char *genlabelname(int l)
+{
+  static _Thread_local char buf[TEXTLEN + 32];
+
+  if (O_incremental)
+    snprintf(buf, sizeof(buf), ".L%s.%d", Gsym[Genfuncid].name,
+             l - Gsym[Genfuncid].endlabel);
+  else
+    snprintf(buf, sizeof(buf), "L%d", l);
+  return (buf);
+}
+
+// if変換(分岐をなくし、条件付きの転送でどちらかの値を選ぶ)の費用の上限。
+// 変換すると実行しないはずだった腕の式も計算することになる。
+// その命令数が分岐の予測ミスの損失のおよそ半分を超えるなら分岐のままにする
+#define IFCVT_MAXCOST 8
+#define IFCVT_REGS 4 // 使えるレジスタの数
+
+// 式を計算するおおよその命令数を返し、*needに必要なレジスタの数を入れる。
+// 関数呼び出しを含むときは、呼び出しの順序や回数が変わるので-1を返す。
+// speculateが0以外であれば、条件によらず計算するので
+// 例外を起こしうる間接参照と除算を含むときも-1を返す
+static int ifcvtcost(struct ASTnode *n, int speculate, int *need)
+{
+  int lcost, rcost, lneed, rneed;
+
+  switch (n->op)
+  {
+  case A_INTLIT:
+  case A_IDENT:
+  case A_ADDR:
+    *need = 1;
+    return (1);
+  case A_WIDEN:
+    return (ifcvtcost(n->left, speculate, need));
+  case A_SCALE:
+    if ((lcost = ifcvtcost(n->left, speculate, need)) == -1)
+      return (-1);
+    // 2の累乗でなければ大きさを読み込んで掛ける
+    if (n->v.size == 2 || n->v.size == 4 || n->v.size == 8)
+      return (lcost + 1);
+    if (*need < 2)
+      *need = 2;
+    return (lcost + 4);
+  case A_DEREF:
+    if (speculate)
+      return (-1);
+    if ((lcost = ifcvtcost(n->left, speculate, need)) == -1)
+      return (-1);
+    return (lcost + 1);
+  case A_DIVIDE:
+    if (speculate)
+      return (-1);
+    // 他の二項演算と同じ
+  case A_ADD:
+  case A_SUBTRACT:
+  case A_MULTIPLY:
+  case A_EQ:
+  case A_NE:
+  case A_LT:
+  case A_GT:
+  case A_LE:
+  case A_GE:
+    // 左を計算したレジスタを持ったまま右を計算する
+    if ((lcost = ifcvtcost(n->left, speculate, &lneed)) == -1 ||
+        (rcost = ifcvtcost(n->right, speculate, &rneed)) == -1)
+      return (-1);
+    *need = (lneed > rneed + 1) ? lneed : rneed + 1;
+    if (n->op == A_ADD || n->op == A_SUBTRACT)
+      return (lcost + rcost + 1);
+    if (n->op == A_MULTIPLY)
+      return (lcost + rcost + 3);
+    return (lcost + rcost + 4);
+  }
+  return (-1);
+}
+
+// if文の腕が大域変数への代入1つであればその変数のシンボルIDを、
+// そうでなければ-1を返す
+static int ifcvtarm(struct ASTnode *n)
+{
+  if (n == NULL || n->op != A_ASSIGN || n->right->op != A_IDENT)
+    return (-1);
+  return (n->right->v.id);
+}
+
+// if文を条件付きの転送に変換するのであれば0以外を返す。
+// 腕が同じ変数への代入1つずつか、elseがなくtrueの腕の代入1つだけで、
+// 値の式に副作用も例外の可能性もなく、レジスタが足り、
+// 腕の式の費用の合計が上限以内のときに変換する
+static int ifconvertible(struct ASTnode *n)
+{
+  int id, cost, fcost, need;
+
+  if ((id = ifcvtarm(n->mid)) == -1)
+    return (0);
+  if (n->right && ifcvtarm(n->right) != id)
+    return (0);
+
+  // trueの値、falseの値(elseがなければ変数の今の値)、
+  // 比較の左辺、右辺の順にレジスタへ置いていく
+  if ((cost = ifcvtcost(n->mid->left, 1, &need)) == -1 || need > IFCVT_REGS)
+    return (0);
+  if (n->right)
+    fcost = ifcvtcost(n->right->left, 1, &need);
+  else
+    fcost = need = 1;
+  if (fcost == -1 || need + 1 > IFCVT_REGS)
+    return (0);
+  if (ifcvtcost(n->left->left, 0, &need) == -1 || need + 2 > IFCVT_REGS)
+    return (0);
+  if (ifcvtcost(n->left->right, 0, &need) == -1 || need + 3 > IFCVT_REGS)
+    return (0);
+  return (cost + fcost <= IFCVT_MAXCOST);
+}
+
+// ASTツリーのコード生成でgenlabel()が呼ばれる回数を返す。
+// genIF()とgenWHILE()のラベルの使い方に合わせておくこと
+int genlabelcount(struct ASTnode *n)
+{
+  int count = 0;
+
+  // -O1では中間表現のブロックごとに1つ使う
+  if (O_optimize && n->op == A_FUNCTION)
+    return (ir_labelcount(n->v.id));
+
+  // 文の並びは左に深く伸びるので、左の子へは再帰せずにたどる
+  for (; n != NULL; n = n->left)
+  {
+    switch (n->op)
+    {
+    case A_IF:
+      if (!ifconvertible(n))
+        count += (n->right) ? 2 : 1;
+      break;
+    case A_WHILE:
+      count += 2;
+      break;
+    case A_INLINE:
+      count++;
+      break;
+    }
+    count += genlabelcount(n->mid) + genlabelcount(n->right);
+  }
+  return (count);
+}
+
+// 関数のコード生成で使うcount個のラベル番号を予約し、その先頭を返す。
+// 予約した番号は逐次生成と同じ順で払い出されるため出力は変わらない
+int genreservelabels(int count)
+{
+  int base = Labelid;
+
+  Labelid += count;
+  return (base);
+}
+
+// 関数のコードを生成する。labelbaseが0でなければ予約したラベル番号を使う。
+// -ftime-reportではその時間を計り、--traceではスパンを記録する
+void genfunction(struct ASTnode *n, int labelbase)
+{
+  double start = 0;
+
+  if (O_timereport)
+    stats_enter(PH_GEN);
+  if (O_trace)
+    start = trace_now();
+  Labelcursor = labelbase;
+  genAST(n, NOLABEL, 0);
+  Labelcursor = 0;
+  if (O_trace)
+    trace_span("gen", "genAST", start, Gsym[n->v.id].name);
+  if (O_timereport)
+    stats_leave();
+}
+
+// 変換できるif文を分岐なしで生成する。両方の腕の値を計算してから
+// 比較し、条件に合うほうの値を変数へ保存する
+static int genIFCVT(struct ASTnode *n)
+{
+  int id = n->mid->right->v.id;
+  int treg, freg, r1, r2;
+
+  treg = genAST(n->mid->left, NOLABEL, A_ASSIGN);
+  if (n->right)
+    freg = genAST(n->right->left, NOLABEL, A_ASSIGN);
+  else
+    freg = cgloadglob(id);
+  r1 = genAST(n->left->left, NOLABEL, n->left->op);
+  r2 = genAST(n->left->right, NOLABEL, n->left->op);
+  cgstorglob(cgselect(n->left->op, r1, r2, treg, freg), id);
+  genfreeregs();
+  return (NOREG);
 }
 
 // if文とオプションのelse句のコードを生成する
@@ -16,6 +230,10 @@ static int genIF(struct ASTnode *n)
 {
   int Lfalse, Lend;
 
+  // 小さなif文は分岐をなくす
+  if (ifconvertible(n))
+    return (genIFCVT(n));
+
   // 2つのラベルを生成する。1つはfalse合成ステートメント、
   // もう1つはif文全体の終わりへのラベル。
   // else句がなければLfalseが終了ラベルとなる
@@ -80,6 +298,69 @@ static int genWHILE(struct ASTnode *n)
   return (NOREG);
 }
 
+// A_GLUEでつないだ文の並びのコードを生成し、文ごとにレジスタを開放する。
+// 並びは文の数だけ左に深くなるので、再帰せずに左の子の列をスタックに積み、
+// 一番左の文から順に生成する
+static int genGLUE(struct ASTnode *n)
+{
+  struct ASTnode **spine = NULL;
+  int depth = 0, max = 0;
+
+  for (; n->op == A_GLUE; n = n->left)
+  {
+    if (depth == max)
+    {
+      max = max ? 2 * max : 64;
+      if ((spine = realloc(spine, max * sizeof(struct ASTnode *))) == NULL)
+        fatal("メモリが確保できませんでした。genGLUE()");
+    }
+    spine[depth++] = n;
+  }
+
+  genAST(n, NOLABEL, A_GLUE);
+  genfreeregs();
+  while (depth > 0)
+  {
+    genAST(spine[--depth]->right, NOLABEL, A_GLUE);
+    genfreeregs();
+  }
+  free(spine);
+  return (NOREG);
+}
+
+// 呼び出しに展開した関数の本体を生成する。本体の中のA_LEAVEは
+// 値をINLINE_REGへ入れて本体の後ろの合流点へ飛ぶ。本体の最後の文であれば
+// 合流点はすぐ後ろなので飛ばない。
+// 値の入ったレジスタを返す。void関数であればNOREGを返す
+static int genINLINE(struct ASTnode *n)
+{
+  int outerlabel = Inlinelabel;
+  struct ASTnode *outerlast = Inlinelast;
+
+  Inlinelabel = genlabel();
+  Inlinelast = (n->mid->op == A_GLUE) ? n->mid->right : n->mid;
+  genAST(n->mid, NOLABEL, n->op);
+  genfreeregs();
+  cglabel(Inlinelabel);
+  Inlinelabel = outerlabel;
+  Inlinelast = outerlast;
+  if (n->type == P_VOID)
+    return (NOREG);
+  return (cgclaimreg(INLINE_REG));
+}
+
+// 関数の本体nがバックエンドのフレームなしで生成できる
+// 葉の関数であればtrueを返す。文の並びは左に深く伸びるので左の子はたどる
+int genleaf(struct ASTnode *n)
+{
+  for (; n != NULL; n = n->left)
+  {
+    if (!cgleafop(n->op, n->v.id) || !genleaf(n->mid) || !genleaf(n->right))
+      return (0);
+  }
+  return (1);
+}
+
 // ASTと(あれば)前の右辺値を保持するレジスタ、
 // 親のAST操作を引数に取り、再帰的に
 // アセンブリコードを生成する。
@@ -96,16 +377,22 @@ int genAST(struct ASTnode *n, int label, int parentASTop)
   case A_WHILE:
     return (genWHILE(n));
   case A_GLUE:
-    // 子ステートメントそれぞれと結合しレジスタを開放する
-    genAST(n->left, NOLABEL, n->op);
-    genfreeregs();
-    genAST(n->right, NOLABEL, n->op);
-    genfreeregs();
-    return (NOREG);
+    return (genGLUE(n));
+  case A_INLINE:
+    return (genINLINE(n));
   case A_FUNCTION:
-    // コードより先に関数のプレアンブルを生成
-    cgfuncpreamble(n->v.id);
-    genAST(n->left, NOLABEL, n->op);
+    // コードより先に関数のプレアンブルを生成。
+    // 本体が1つの文であればその後でレジスタを開放する。
+    // -O1では最適化した中間表現から本体を生成する
+    Genfuncid = n->v.id;
+    cgfuncpreamble(n->v.id, genleaf(n->left));
+    if (O_optimize)
+      ir_genbody(n->v.id);
+    else
+    {
+      genAST(n->left, NOLABEL, n->op);
+      genfreeregs();
+    }
     cgfuncpostamble(n->v.id);
     return (NOREG);
   }
@@ -166,7 +453,12 @@ int genAST(struct ASTnode *n, int label, int parentASTop)
     // 子の型を親の型へ拡張
     return (cgwiden(leftreg, n->left->type, n->type));
   case A_RETURN:
-    cgreturn(leftreg, Functionid);
+    cgreturn(leftreg, Genfuncid);
+    return (NOREG);
+  case A_LEAVE:
+    cgmovereg(leftreg, INLINE_REG, n->type);
+    if (n != Inlinelast)
+      cgjump(Inlinelabel);
     return (NOREG);
   case A_FUNCCALL:
     return (cgcall(leftreg, n->v.id));
@@ -180,21 +472,7 @@ int genAST(struct ASTnode *n, int label, int parentASTop)
     else
       return (leftreg);
   case A_SCALE:
-    // 小さな最適化: スケール値が2の乗数であればシフト演算を使う
-    switch (n->v.size)
-    {
-    case 2:
-      return (cgshlconst(leftreg, 1));
-    case 4:
-      return (cgshlconst(leftreg, 2));
-    case 8:
-      return (cgshlconst(leftreg, 3));
-    default:
-      // サイズが入ったレジスタを読み込み、
-      // leftregをsize分だけ倍加する
-      rightreg = cgloadint(n->v.size, P_INT);
-      return (cgmul(leftreg, rightreg));
-    }
+    return (genscale(leftreg, n->v.size));
   default:
     fatald("不明なAST操作です", n->op);
   }
@@ -203,6 +481,7 @@ int genAST(struct ASTnode *n, int label, int parentASTop)
 
 void genpreamble()
 {
+  Labelid = 1;
   cgpreamble();
 }
 
@@ -213,6 +492,8 @@ void genpostamble()
 
 void genfreeregs()
 {
+  if (O_trace)
+    trace_regsample();
   freeall_registers();
 }
 void genprintint(int reg)
@@ -229,3 +510,21 @@ int genprimsize(int type)
 {
   return (cgprimsize(type));
 }
+
+// レジスタregの値をsize倍する。
+// 小さな最適化: スケール値が2の乗数であればシフト演算を使う
+int genscale(int reg, int size)
+{
+  switch (size)
+  {
+  case 2:
+    return (cgshlconst(reg, 1));
+  case 4:
+    return (cgshlconst(reg, 2));
+  case 8:
+    return (cgshlconst(reg, 3));
+  default:
+    // サイズが入ったレジスタを読み込み、regをsize分だけ倍加する
+    return (cgmul(reg, cgloadint(size, P_INT)));
+  }
+}
@@ -0,0 +1,283 @@
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+#include <errno.h>
+#include <unistd.h>
+
+// 関数単位のインクリメンタルコンパイル
+//
+// 関数ごとにトークン列と、その関数が参照するグローバルシンボルの
+// 名前と型からフィンガープリントを作る。出力ファイルの横に置いた
+// データベース(<出力ファイル>.fdb)には前回のコンパイルで
+// 関数ごとに生成したアセンブリを保存しておき、フィンガープリントが
+// 一致した関数はgenAST()を呼ばずに保存したテキストをそのまま出力する。
+//
+// 保存したテキストが別の場所でも使えるように、インクリメンタルモードの
+// ラベルは関数名と関数内での相対番号で名前を付ける(genlabelname())。
+//
+// データベースの形式:
+//   "fdb <バージョン> <バックエンド> <オプション>\n"
+//   "F <関数名> <フィンガープリント> <長さ> <壊すレジスタ>\n" <アセンブリ> の繰り返し
+//
+// 関数が呼び出しで壊すレジスタの集合(Gsym[].clobber)は呼ぶ側のコードを変えるので、
+// 再利用した関数についてもデータベースから戻し、cgsymdep()で呼ぶ側のフィンガープリントへ混ぜる
+
+// データベースのエントリ
+struct fentry
+{
+  char *name;             // 関数名
+  char hash[HASHSTRLEN];  // フィンガープリントの16進表記
+  char *text;             // 生成されたアセンブリ
+  size_t len;             // その長さ
+  int clobber;            // 関数が壊すレジスタの集合
+};
+
+static char *Dbbuf;           // 読み込んだデータベースの中身
+static struct fentry *Old;    // 前回のエントリ。テキストはDbbufを指す
+static int Nold;
+static struct fentry *New;    // 今回のエントリ。テキストはmalloc()したもの
+static int Nnew, Maxnew;
+static int Hits, Misses;
+
+static hash128 Fp;            // 関数のトークン列のフィンガープリント
+static hash128 Fpprev;        // 最後のトークンを混ぜる前のFp
+static int Fpactive;          // 関数をパース中であればtrue
+
+// データベースの1行目。条件が違えば前回の出力は使えない
+static void dbheader(char *buf, int size)
+{
+  char flags[TEXTLEN];
+
+  compile_flags(flags, sizeof(flags));
+  snprintf(buf, size, "fdb %s %s %s\n", COMPILERID, cgtarget(), flags);
+}
+
+// データベースのエントリを配列へ追加する
+static struct fentry *addentry(struct fentry **list, int *n, int *max)
+{
+  if (*n == *max)
+  {
+    *max = *max ? *max * 2 : 64;
+    if ((*list = realloc(*list, *max * sizeof(struct fentry))) == NULL)
+      fatal("メモリが確保できませんでした。addentry()");
+  }
+  return (&(*list)[(*n)++]);
+}
+
+// 前回と今回のエントリをすべて解放する
+static void incfree(void)
+{
+  for (int i = 0; i < Nnew; i++)
+  {
+    free(New[i].name);
+    free(New[i].text);
+  }
+  free(New);
+  free(Old);
+  free(Dbbuf);
+  New = Old = NULL;
+  Dbbuf = NULL;
+  Nnew = Nold = Maxnew = Hits = Misses = 0;
+  Fpactive = 0;
+}
+
+// 前回のデータベースを読み込む。dbfileがNULLかファイルがなければ空で始める。
+// 壊れているか条件が違う場合も、すべての関数をコンパイルし直すだけで済む
+void inc_load(char *dbfile)
+{
+  char header[TEXTLEN], *p, *end, *nl;
+  struct fentry *e;
+  int max = 0, namelen;
+  size_t len;
+
+  incfree();
+  if (dbfile == NULL || (Dbbuf = slurp(dbfile, &len)) == NULL)
+    return;
+  dbheader(header, sizeof(header));
+  if (len < strlen(header) || strncmp(Dbbuf, header, strlen(header)))
+    return;
+
+  p = Dbbuf + strlen(header);
+  end = Dbbuf + len;
+  while (p < end)
+  {
+    // "F <関数名> <フィンガープリント> <長さ> <壊すレジスタ>\n"
+    if ((nl = memchr(p, '\n', end - p)) == NULL || strncmp(p, "F ", 2))
+      break;
+    *nl = '\0';
+    e = addentry(&Old, &Nold, &max);
+    if (sscanf(p + 2, "%*s%n %32s %zu %d", &namelen, e->hash, &e->len,
+               &e->clobber) != 3 ||
+        e->len > end - nl - 1)
+    {
+      Nold--;
+      break;
+    }
+    e->name = p + 2;
+    e->name[namelen] = '\0';
+    e->text = nl + 1;
+    p = e->text + e->len;
+  }
+}
+
+// 今回のエントリでデータベースを書き直す。dbfileがNULLであれば解放だけする。
+// 一時ファイルに書いてからrename()するので、途中で止まっても壊れない
+void inc_save(char *dbfile)
+{
+  char header[TEXTLEN], tmp[TEXTLEN];
+  FILE *f;
+  int ok;
+
+  if (dbfile == NULL)
+  {
+    incfree();
+    return;
+  }
+  dbheader(header, sizeof(header));
+  snprintf(tmp, sizeof(tmp), "%s.%d", dbfile, (int)getpid());
+  if ((f = fopen(tmp, "w")) == NULL)
+  {
+    fprintf(stderr, "%s を作成できません:%s\n", tmp, strerror(errno));
+    incfree();
+    return;
+  }
+  fputs(header, f);
+  for (int i = 0; i < Nnew; i++)
+  {
+    fprintf(f, "F %s %s %zu %d\n", New[i].name, New[i].hash, New[i].len,
+            New[i].clobber);
+    fwrite(New[i].text, 1, New[i].len, f);
+  }
+  ok = (fclose(f) == 0);
+  if (!ok || rename(tmp, dbfile) == -1)
+    unlink(tmp);
+
+  if (O_timings)
+    fprintf(stderr, "インクリメンタル: 再利用 %d  再生成 %d 関数\n", Hits, Misses);
+  incfree();
+}
+
+// 関数のフィンガープリントを取り始める。
+// 関数名と型はすでにスキャン済みなので、ここで混ぜておく
+void inc_startfunc(char *name, int type)
+{
+  Fp = fnv1a_str(FNV128BASIS, name);
+  Fp = fnv1a(Fp, &type, sizeof(type));
+  Fp = fnv1a(Fp, &Token.token, sizeof(Token.token));
+  Fpprev = Fp;
+  Fpactive = 1;
+}
+
+// スキャンしたトークンをフィンガープリントに混ぜる
+void inc_token(struct token *t)
+{
+  if (!Fpactive)
+    return;
+  Fpprev = Fp;
+  Fp = fnv1a(Fp, &t->token, sizeof(t->token));
+  if (t->token == T_INTLIT)
+    Fp = fnv1a(Fp, &t->intvalue, sizeof(t->intvalue));
+  else if (t->token == T_IDENT)
+    Fp = fnv1a_str(Fp, Text);
+}
+
+// 関数から参照されたグローバルシンボルの名前と型と、
+// バックエンドがコードに埋め込むシンボルの値を混ぜる。
+// シンボルは一度登録されると変わらないので、参照した時点で混ぜてよい
+void inc_ref(int id)
+{
+  int dep;
+
+  if (!Fpactive)
+    return;
+  dep = cgsymdep(id);
+  Fp = fnv1a_str(Fp, Gsym[id].name);
+  Fp = fnv1a(Fp, &Gsym[id].type, sizeof(Gsym[id].type));
+  Fp = fnv1a(Fp, &Gsym[id].stype, sizeof(Gsym[id].stype));
+  Fp = fnv1a(Fp, &dep, sizeof(dep));
+}
+
+// コンパイル時に評価して値に置き換えた呼び出しの、関数名と値を混ぜる。
+// 呼ばれた関数の本体が変わって値が変われば、この関数も生成し直す。
+// 関数を読み終えてから呼ばれるので、先読みのトークンを含まないFpprevへ混ぜる
+void inc_value(int id, long value)
+{
+  if (!Fpactive)
+    return;
+  Fpprev = fnv1a_str(Fpprev, Gsym[id].name);
+  Fpprev = fnv1a(Fpprev, &value, sizeof(value));
+}
+
+// 呼び出しに展開した関数の、今回のフィンガープリントを混ぜる。
+// 展開した関数が変われば、この関数も生成し直す。
+// inc_value()と同じく関数を読み終えてから呼ばれる
+void inc_inline(int id)
+{
+  if (!Fpactive)
+    return;
+  for (int i = Nnew - 1; i >= 0; i--)
+  {
+    if (!strcmp(New[i].name, Gsym[id].name))
+    {
+      Fpprev = fnv1a_str(Fpprev, New[i].hash);
+      return;
+    }
+  }
+}
+
+// 関数のフィンガープリントを完成させる。
+// 最後にスキャンしたトークンは次の宣言の先読みなので含めない
+static hash128 endfunc(void)
+{
+  Fpactive = 0;
+  return (Fpprev);
+}
+
+// 前回のエントリから関数名で探す。
+// 関数の並びはたいてい変わらないので、同じ位置を先に見る
+static struct fentry *findold(char *name, int hint)
+{
+  if (hint < Nold && !strcmp(Old[hint].name, name))
+    return (&Old[hint]);
+  for (int i = 0; i < Nold; i++)
+    if (!strcmp(Old[i].name, name))
+      return (&Old[i]);
+  return (NULL);
+}
+
+// 関数のコードを出力する。フィンガープリントが前回と一致すれば
+// 保存したアセンブリを使い、そうでなければgenAST()で生成する
+void inc_function(struct ASTnode *tree)
+{
+  struct fentry *e, *old;
+  char *name = Gsym[tree->v.id].name;
+  FILE *realout;
+
+  e = addentry(&New, &Nnew, &Maxnew);
+  hashstr(endfunc(), e->hash);
+  if ((e->name = strdup(name)) == NULL)
+    fatal("メモリが確保できませんでした。inc_function()");
+
+  old = findold(name, Nnew - 1);
+  if (old != NULL && !strcmp(old->hash, e->hash))
+  {
+    if ((e->text = malloc(old->len)) == NULL)
+      fatal("メモリが確保できませんでした。inc_function()");
+    memcpy(e->text, old->text, old->len);
+    e->len = old->len;
+    Gsym[tree->v.id].clobber = old->clobber;
+    Hits++;
+  }
+  else
+  {
+    realout = Outfile;
+    if ((Outfile = open_memstream(&e->text, &e->len)) == NULL)
+      fatal("出力バッファを作成できません");
+    genfunction(tree, 0);
+    fclose(Outfile);
+    Outfile = realout;
+    Misses++;
+  }
+  e->clobber = Gsym[tree->v.id].clobber;
+  fwrite(e->text, 1, e->len, Outfile);
+}
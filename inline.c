@@ -0,0 +1,158 @@
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+
+// 小さな関数のインライン展開
+//
+// 関数をパースするたびに、本体の中の小さな関数の呼び出しを、
+// 呼ばれた関数の本体の複製で置き換える。置き換えたノードはA_INLINEで、
+// midに本体を持ち、v.idは呼ばれた関数のシンボルIDのまま残す。
+// 本体の中のreturn文はA_LEAVEに書き換える。A_LEAVEは値を展開した
+// 呼び出しの値として置き、本体の後ろの合流点へ飛ぶ。呼び出した関数の
+// エンドラベルへは飛ばない。
+//
+// 展開した本体の文は、文ごとにすべてのレジスタを開放して生成する。
+// そのため展開するのは、使用中のレジスタがないときに計算される呼び出し、
+// すなわち文の式で最初に計算される呼び出しだけにする。
+// 呼ばれた関数は引数を使わないので、引数に副作用がなければ捨てる。
+//
+// 展開できる関数は、自分自身を呼ばず、本体のノードの数がINLINE_MAXSIZE以下のもの。
+// 本体にはその関数に展開した呼び出しも含めて数える
+//
+// 展開すると呼び出しの数だけ本体が複製されるので、出力は大きくなりうる。
+// -O0の出力と-Tのダンプを変えないように、展開は-O1のときだけ行う。
+
+#define INLINE_MAXSIZE 40 // 展開する関数の本体のノードの数の上限
+
+// ツリーnのノードの数を返す。limitを超えれば数えるのをやめる
+static int treesize(struct ASTnode *n, int limit)
+{
+  int size = 0;
+
+  // 文の並びは左に深く伸びるので、左の子へは再帰せずにたどる
+  for (; n != NULL && size <= limit; n = n->left)
+  {
+    size++;
+    size += treesize(n->mid, limit - size);
+    size += treesize(n->right, limit - size);
+  }
+  return (size);
+}
+
+// ツリーnが関数idを呼び出していればtrueを返す
+static int calls(struct ASTnode *n, int id)
+{
+  for (; n != NULL; n = n->left)
+  {
+    if (n->op == A_FUNCCALL && n->v.id == id)
+      return (1);
+    if (calls(n->mid, id) || calls(n->right, id))
+      return (1);
+  }
+  return (0);
+}
+
+// 式nに副作用がなければtrueを返す
+static int noeffect(struct ASTnode *n)
+{
+  if (n == NULL)
+    return (1);
+  switch (n->op)
+  {
+  case A_ASSIGN:
+  case A_FUNCCALL:
+  case A_INLINE:
+    return (0);
+  }
+  return (noeffect(n->left) && noeffect(n->right));
+}
+
+// 展開する本体としてツリーnを複製する。return文は型typeの値を置くA_LEAVEにする。
+// 本体の中の展開済みの呼び出しにはreturn文は残っていない
+static struct ASTnode *clone(struct ASTnode *n, int type)
+{
+  struct ASTnode *c, *head = NULL, **link = &head;
+
+  // 文の並びは左に深く伸びるので、左の子へは再帰せずに複製する
+  for (; n != NULL; n = n->left)
+  {
+    if (n->op == A_RETURN)
+      c = mkastnode(A_LEAVE, type, NULL, NULL, NULL, 0);
+    else
+      c = mkastnode(n->op, n->type, NULL, clone(n->mid, type),
+                    clone(n->right, type), 0);
+    c->rvalue = n->rvalue;
+    c->v = n->v;
+    *link = c;
+    link = &c->left;
+  }
+  return (head);
+}
+
+// 呼び出しnを展開できれば、その場でA_INLINEに置き換える
+static void expand(struct ASTnode *n)
+{
+  struct ASTnode *body = Gsym[n->v.id].inl;
+
+  if (body == NULL || !noeffect(n->left))
+    return;
+  if (O_incremental)
+    inc_inline(n->v.id);
+  n->op = A_INLINE;
+  n->left = NULL;
+  n->mid = clone(body, n->type);
+}
+
+// 式nの中で、最初に計算される呼び出しを展開する。
+// どの演算も左の子から計算するので、左の子をたどっていく。
+// 展開できない呼び出しでは、その引数が先に計算される
+static void inlineexpr(struct ASTnode *n)
+{
+  for (; n != NULL; n = n->left)
+  {
+    if (n->op != A_FUNCCALL)
+      continue;
+    expand(n);
+    if (n->op == A_INLINE)
+      return;
+  }
+}
+
+// 文nの中の呼び出しを展開する。文の並びは左に深く伸びるので左の子はたどる
+static void inlinestmt(struct ASTnode *n)
+{
+  for (; n != NULL; n = n->left)
+  {
+    switch (n->op)
+    {
+    case A_GLUE:
+      inlinestmt(n->right);
+      continue;
+    case A_IF:
+      inlineexpr(n->left);
+      inlinestmt(n->mid);
+      inlinestmt(n->right);
+      return;
+    case A_WHILE:
+      inlineexpr(n->left);
+      inlinestmt(n->right);
+      return;
+    }
+    inlineexpr(n);
+    return;
+  }
+}
+
+// パースした関数の本体の中の小さな関数の呼び出しを展開し、
+// この関数も小さければ、後の呼び出しで展開できるように本体を記録する
+void inline_function(struct ASTnode *tree)
+{
+  int id = tree->v.id;
+
+  inlinestmt(tree->left);
+  if (tree->left != NULL && !calls(tree->left, id) &&
+      treesize(tree->left, INLINE_MAXSIZE) <= INLINE_MAXSIZE)
+    Gsym[id].inl = tree->left;
+  else
+    Gsym[id].inl = NULL;
+}
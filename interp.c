@@ -1,45 +1,781 @@
 #include "defs.h"
 #include "data.h"
 #include "decl.h"
+#include <errno.h>
 
-// ASTツリーの解釈
+// バイトコードの仮想機械 (--run)
+//
+// 関数のASTをレジスタ型のバイトコードへ翻訳し、アセンブラを通さずに
+// その場で実行する。大域変数はバイト列のデータ領域に置き、ポインタは
+// データ領域の中の位置で表す。型の大きさとポインタのスケールは
+// バックエンドと同じgenprimsize()に従う。位置0は空けておき、
+// 0を指すポインタの間接参照はエラーにする。
+//
+// 仮想レジスタは64ビットで、式の入れ子の深さで番号を決める。
+// 関数にはローカル変数がないので、呼び出しではレジスタの窓を
+// 呼び出し元が使っている分だけずらし、戻り先を覚えておくだけでよい。
+//
+// ディスパッチはcomputed gotoのスレッデッドコードで、実行の前に
+// 命令のオペコードを処理のラベルのアドレスへ置き換えておく。
+// よく続く命令の組は、翻訳しながらスーパー命令にまとめる。
+//   LI + ADD/SUB/MUL         → ADDK/SUBK/MULK  レジスタと即値の演算
+//   LI + Jcc                 → JccK            レジスタと即値の比較分岐
+//   LDW/LDL + JccK           → JccWK/JccLK     大域変数の読み込み、比較、分岐
+//   LDW/LDL + ADDK + STW/STL → INCW/INCL       大域変数へ即値を足す
 
-// AST操作のリスト
-static char *ASTop[] = {"+", "-", "*", "/"};
+#define NREGS (1 << 20)   // 仮想レジスタのスタックの大きさ
+#define MAXDEPTH 100000   // 呼び出しの入れ子の最大の深さ
+#define NULLSIZE 8        // データ領域の先頭の使わない部分
 
-// 与えられたASTの演算子を解釈し最終値を返す
-int interpretAST(struct ASTnode *n)
+// オペコード。Bは1バイト、Wは4バイト、Lは8バイトの読み書き。
+// 比較の並びはA_EQ, A_NE, A_LT, A_GT, A_LE, A_GEと同じにしておく
+enum
 {
-  int leftval, rightval;
+  OP_LI,   // a = 即値b
+  OP_LDB,  // a = 位置bの大域変数
+  OP_LDW,
+  OP_LDL,
+  OP_STB,  // 位置bの大域変数 = a
+  OP_STW,
+  OP_STL,
+  OP_LDIB, // a = *b
+  OP_LDIW,
+  OP_LDIL,
+  OP_STIB, // *b = a
+  OP_STIW,
+  OP_STIL,
+  OP_ADD,  // a = b 演算 c
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,
+  OP_SHL,  // a = b << 即値c
+  OP_EQ,   // a = (b 比較 c)
+  OP_NE,
+  OP_LT,
+  OP_GT,
+  OP_LE,
+  OP_GE,
+  OP_JMP,  // cへ飛ぶ
+  OP_JEQ,  // a 比較 bであればcへ飛ぶ
+  OP_JNE,
+  OP_JLT,
+  OP_JGT,
+  OP_JLE,
+  OP_JGE,
+  OP_CALL,  // 位置bの関数を呼び、戻り値をaへ入れる
+  OP_PRINT, // printint(a)
+  OP_ENTER, // 関数の入口。aは使うレジスタの数
+  OP_RET,   // aを返す
+  // ここからスーパー命令
+  OP_ADDK, // a = b 演算 即値c
+  OP_SUBK,
+  OP_MULK,
+  OP_JEQK, // a 比較 即値bであればcへ飛ぶ
+  OP_JNEK,
+  OP_JLTK,
+  OP_JGTK,
+  OP_JLEK,
+  OP_JGEK,
+  OP_JEQWK, // 位置aの大域変数 比較 即値bであればcへ飛ぶ
+  OP_JNEWK,
+  OP_JLTWK,
+  OP_JGTWK,
+  OP_JLEWK,
+  OP_JGEWK,
+  OP_JEQLK,
+  OP_JNELK,
+  OP_JLTLK,
+  OP_JGTLK,
+  OP_JLELK,
+  OP_JGELK,
+  OP_INCW, // 位置bの大域変数に即値cを足し、aにも入れる
+  OP_INCL,
+  OP_MAX
+};
 
-  // 左右のサブツリーの値を取得
-  if (n->left)
-    leftval = interpretAST(n->left);
-  if (n->right)
-    rightval = interpretAST(n->right);
+// 命令
+struct insn
+{
+  void *lab; // 実行前に処理のラベルのアドレスを入れる
+  int op;
+  int a, b, c;
+};
 
-  //デバッグ用出力
-  /*
-  if (n->op == A_INTLIT)
-    printf("int %d\n", n->intvalue);
-  else
-    printf("%d %s %d\n", leftval, ASTop[n->op], rightval);
-*/
+// 呼び出し元の情報
+struct frame
+{
+  struct insn *ip; // 戻り先
+  long *regs;      // レジスタの窓
+  int dst;         // 戻り値を入れるレジスタ
+};
+
+static struct insn *Code; // すべての関数のバイトコード
+static int Ncode, Maxcode;
+static int Barrier;       // これより前の命令とはまとめない(分岐先)
+static int Maxreg;        // 翻訳中の関数で使ったレジスタの最大の番号
+static int Datasize;      // データ領域の大きさ
+static int Threaded;      // オペコードをラベルのアドレスへ置き換えたか
+static int Leaves;        // 展開した本体から合流点へ飛ぶ命令の鎖。-1で終わる
+
+// 否定した比較のAST操作。A_EQ, A_NE, A_LT, A_GT, A_LE, A_GEの並び
+static int Invcmp[] = {A_NE, A_EQ, A_GE, A_LE, A_GT, A_LT};
+
+// 実行時のエラーを表示して終了する
+static void vmerror(char *s)
+{
+  fflush(stdout);
+  fprintf(stderr, "実行時エラー: %s\n", s);
+  exit(1);
+}
+
+// 命令を1つ追加し、その位置を返す。直前の命令とまとめられればまとめる
+static int emit(int op, int a, int b, int c)
+{
+  struct insn *p, *q;
+
+  if (Ncode == Maxcode)
+  {
+    Maxcode = Maxcode ? 2 * Maxcode : 1024;
+    if ((Code = realloc(Code, Maxcode * sizeof(struct insn))) == NULL)
+      fatal("メモリが確保できませんでした。emit()");
+  }
+
+  // 直前の即値を演算や比較分岐の右の値に取り込む
+  p = &Code[Ncode - 1];
+  if (Barrier < Ncode && p->op == OP_LI && p->a == c && p->a != b &&
+      (op == OP_ADD || op == OP_SUB || op == OP_MUL))
+  {
+    p->op = OP_ADDK + op - OP_ADD;
+    p->c = p->b;
+    p->a = a;
+    p->b = b;
+    return (Ncode - 1);
+  }
+  if (Barrier < Ncode && p->op == OP_LI && p->a == b && p->a != a &&
+      op >= OP_JEQ && op <= OP_JGE)
+  {
+    p->op = OP_JEQK + op - OP_JEQ;
+    p->a = a;
+    p->c = c;
+
+    // 比べるレジスタが直前に大域変数から読んだものであれば、読み込みもまとめる
+    q = p - 1;
+    if (Barrier < Ncode - 1 && (q->op == OP_LDW || q->op == OP_LDL) &&
+        q->a == a)
+    {
+      q->op = (q->op == OP_LDW ? OP_JEQWK : OP_JEQLK) + op - OP_JEQ;
+      q->a = q->b;
+      q->b = p->b;
+      q->c = c;
+      Ncode--;
+    }
+    return (Ncode - 1);
+  }
+
+  // 大域変数を読んで即値を足し、同じ変数へ書き戻す
+  q = p - 1;
+  if (Barrier < Ncode - 1 && (op == OP_STW || op == OP_STL) &&
+      p->op == OP_ADDK && p->a == a && p->b == a &&
+      q->op == op - OP_STB + OP_LDB && q->a == a && q->b == b)
+  {
+    q->op = (op == OP_STW) ? OP_INCW : OP_INCL;
+    q->c = p->c;
+    Ncode--;
+    return (Ncode - 1);
+  }
+
+  p = &Code[Ncode];
+  p->op = op;
+  p->a = a;
+  p->b = b;
+  p->c = c;
+  return (Ncode++);
+}
+
+// 今の位置を分岐先にしてその位置を返す
+static int here(void)
+{
+  Barrier = Ncode;
+  return (Ncode);
+}
+
+// 位置iの分岐命令の飛び先を今の位置にする
+static void patch(int i)
+{
+  Code[i].c = here();
+}
 
+// 型の大きさに合った読み書きの命令を返す。opはB版の命令
+static int sized(int op, int type)
+{
+  switch (genprimsize(type))
+  {
+  case 1:
+    return (op);
+  case 4:
+    return (op + 1);
+  case 8:
+    return (op + 2);
+  }
+  fatald("--run: 型の大きさが不明です", type);
+  return (0);
+}
+
+// 使うレジスタの番号を記録する
+static int usereg(int r)
+{
+  if (r > Maxreg)
+    Maxreg = r;
+  return (r);
+}
+
+static void vmstmt(struct ASTnode *n);
+
+// 呼び出しに展開した関数の本体の命令を出す。展開した呼び出しは
+// 使用中のレジスタがないときに計算されるのでrは0で、本体の文もレジスタ0から使う。
+// 本体の中のA_LEAVEは値をレジスタ0へ入れて合流点へ飛ぶ。
+// 飛ぶ命令は飛び先のオペランドで鎖にしておき、合流点が決まったらたどって書き換える
+static void vminline(struct ASTnode *n, int r)
+{
+  int outer = Leaves, next, end;
+
+  if (r != 0)
+    fatald("--run: 展開した呼び出しのレジスタが不正です", r);
+  Leaves = -1;
+  vmstmt(n->mid);
+  end = here();
+  for (int i = Leaves; i != -1; i = next)
+  {
+    next = Code[i].c;
+    Code[i].c = end;
+  }
+  Leaves = outer;
+}
+
+// 式の値をレジスタrへ計算する命令を出す。r+1からは作業用に使う
+static void vmexpr(struct ASTnode *n, int r)
+{
+  usereg(r);
   switch (n->op)
   {
+  case A_INTLIT:
+    emit(OP_LI, r, n->v.intvalue, 0);
+    return;
+  case A_IDENT:
+    emit(sized(OP_LDB, Gsym[n->v.id].type), r, Gsym[n->v.id].posn, 0);
+    return;
+  case A_ADDR:
+    emit(OP_LI, r, Gsym[n->v.id].posn, 0);
+    return;
+  case A_WIDEN:
+    vmexpr(n->left, r);
+    return;
+  case A_DEREF:
+    vmexpr(n->left, r);
+    emit(sized(OP_LDIB, n->type), r, r, 0);
+    return;
+  case A_SCALE:
+    vmexpr(n->left, r);
+    switch (n->v.size)
+    {
+    case 2:
+      emit(OP_SHL, r, r, 1);
+      return;
+    case 4:
+      emit(OP_SHL, r, r, 2);
+      return;
+    case 8:
+      emit(OP_SHL, r, r, 3);
+      return;
+    }
+    emit(OP_MULK, r, r, n->v.size);
+    return;
+  case A_ASSIGN:
+    vmexpr(n->left, r);
+    if (n->right->op == A_IDENT)
+      emit(sized(OP_STB, Gsym[n->right->v.id].type), r,
+           Gsym[n->right->v.id].posn, 0);
+    else
+    {
+      vmexpr(n->right->left, r + 1);
+      emit(sized(OP_STIB, n->right->type), r, r + 1, 0);
+    }
+    return;
+  case A_INLINE:
+    vminline(n, r);
+    return;
+  case A_FUNCCALL:
+    vmexpr(n->left, r);
+    if (!strcmp(Gsym[n->v.id].name, "printint"))
+      emit(OP_PRINT, r, 0, 0);
+    else
+      emit(OP_CALL, r, Gsym[n->v.id].posn, 0);
+    return;
   case A_ADD:
-    return (leftval + rightval);
   case A_SUBTRACT:
-    return (leftval - rightval);
   case A_MULTIPLY:
-    return (leftval * rightval);
   case A_DIVIDE:
-    return (leftval / rightval);
-  case A_INTLIT:
-    return (n->intvalue);
+    vmexpr(n->left, r);
+    vmexpr(n->right, r + 1);
+    emit(OP_ADD + n->op - A_ADD, r, r, r + 1);
+    return;
+  case A_EQ:
+  case A_NE:
+  case A_LT:
+  case A_GT:
+  case A_LE:
+  case A_GE:
+    vmexpr(n->left, r);
+    vmexpr(n->right, r + 1);
+    emit(OP_EQ + n->op - A_EQ, r, r, r + 1);
+    return;
+  }
+  fatald("--run: 不明なAST操作です", n->op);
+}
+
+// 比較nが偽であれば飛ぶ分岐命令を出し、その位置を返す。飛び先は後で決める
+static int vmbranch(struct ASTnode *n)
+{
+  vmexpr(n->left, 0);
+  vmexpr(n->right, 1);
+  return (emit(OP_JEQ + Invcmp[n->op - A_EQ] - A_EQ, 0, 1, 0));
+}
+
+// if文の命令を出す
+static void vmif(struct ASTnode *n)
+{
+  int jfalse, jend;
+
+  jfalse = vmbranch(n->left);
+  vmstmt(n->mid);
+  if (n->right)
+  {
+    jend = emit(OP_JMP, 0, 0, 0);
+    patch(jfalse);
+    vmstmt(n->right);
+    patch(jend);
+  }
+  else
+    patch(jfalse);
+}
+
+// while文の命令を出す
+static void vmwhile(struct ASTnode *n)
+{
+  int start, jend;
+
+  start = here();
+  jend = vmbranch(n->left);
+  vmstmt(n->right);
+  emit(OP_JMP, 0, 0, start);
+  patch(jend);
+}
+
+// 文の命令を出す。文の並びは左に深く伸びるので、genGLUE()と同じように
+// 左の子の列をスタックに積んで一番左の文から順に出す
+static void vmstmt(struct ASTnode *n)
+{
+  struct ASTnode **spine = NULL;
+  int depth = 0, max = 0;
+
+  if (n == NULL)
+    return;
+  if (n->op == A_GLUE)
+  {
+    for (; n->op == A_GLUE; n = n->left)
+    {
+      if (depth == max)
+      {
+        max = max ? 2 * max : 64;
+        if ((spine = realloc(spine, max * sizeof(struct ASTnode *))) == NULL)
+          fatal("メモリが確保できませんでした。vmstmt()");
+      }
+      spine[depth++] = n;
+    }
+    vmstmt(n);
+    while (depth > 0)
+      vmstmt(spine[--depth]->right);
+    free(spine);
+    return;
+  }
+
+  switch (n->op)
+  {
+  case A_IF:
+    vmif(n);
+    break;
+  case A_WHILE:
+    vmwhile(n);
+    break;
+  case A_RETURN:
+    vmexpr(n->left, 0);
+    emit(OP_RET, 0, 0, 0);
+    break;
+  case A_LEAVE:
+    vmexpr(n->left, 0);
+    Leaves = emit(OP_JMP, 0, 0, Leaves);
+    break;
   default:
-    fprintf(stderr, "不明なAST操作fです。%d\n", n->op);
+    vmexpr(n, 0);
+  }
+}
+
+// 大域変数にデータ領域の位置を割り当てる。大きさに合わせて揃えておく
+void vm_global(int id)
+{
+  int size = genprimsize(Gsym[id].type);
+
+  Datasize = (Datasize + size - 1) & ~(size - 1);
+  Gsym[id].posn = Datasize;
+  Datasize += size;
+}
+
+// 関数をバイトコードへ翻訳する。関数の位置はシンボルのposnに記録する
+void vm_function(struct ASTnode *n)
+{
+  int enter;
+
+  Gsym[n->v.id].posn = here();
+  Maxreg = 0;
+  enter = emit(OP_ENTER, 0, 0, 0);
+  vmstmt(n->left);
+
+  // 最後まで来たら0を返す
+  emit(OP_LI, 0, 0, 0);
+  emit(OP_RET, 0, 0, 0);
+  Code[enter].a = Maxreg + 1;
+}
+
+// 位置aからsizeバイトを読み書きできるか確かめる
+#define CHECK(a, size)                                  \
+  if ((a) < NULLSIZE || (a) > Datasize - (size))        \
+    vmerror("不正なポインタの間接参照です");
+
+// データ領域の読み書き。境界をまたぐ値もあるのでmemcpy()で扱う
+static inline long ldw(unsigned char *m)
+{
+  int v;
+
+  memcpy(&v, m, 4);
+  return (v);
+}
+
+static inline long ldl(unsigned char *m)
+{
+  long v;
+
+  memcpy(&v, m, 8);
+  return (v);
+}
+
+static inline void stw(unsigned char *m, long v)
+{
+  int w = v;
+
+  memcpy(m, &w, 4);
+}
+
+static inline void stl(unsigned char *m, long v)
+{
+  memcpy(m, &v, 8);
+}
+
+// 位置entryの関数から実行し、その戻り値を返す
+static long execute(int entry)
+{
+  static void *labels[OP_MAX] = {
+      &&op_li, &&op_ldb, &&op_ldw, &&op_ldl, &&op_stb, &&op_stw, &&op_stl,
+      &&op_ldib, &&op_ldiw, &&op_ldil, &&op_stib, &&op_stiw, &&op_stil,
+      &&op_add, &&op_sub, &&op_mul, &&op_div, &&op_shl,
+      &&op_eq, &&op_ne, &&op_lt, &&op_gt, &&op_le, &&op_ge,
+      &&op_jmp, &&op_jeq, &&op_jne, &&op_jlt, &&op_jgt, &&op_jle, &&op_jge,
+      &&op_call, &&op_print, &&op_enter, &&op_ret,
+      &&op_addk, &&op_subk, &&op_mulk,
+      &&op_jeqk, &&op_jnek, &&op_jltk, &&op_jgtk, &&op_jlek, &&op_jgek,
+      &&op_jeqwk, &&op_jnewk, &&op_jltwk, &&op_jgtwk, &&op_jlewk, &&op_jgewk,
+      &&op_jeqlk, &&op_jnelk, &&op_jltlk, &&op_jgtlk, &&op_jlelk, &&op_jgelk,
+      &&op_incw, &&op_incl};
+  static struct frame frames[MAXDEPTH];
+  unsigned char *mem;
+  long *regs, *regend, *r, v;
+  struct insn *ip;
+  int depth = 0;
+
+  if (!Threaded)
+  {
+    for (int i = 0; i < Ncode; i++)
+      Code[i].lab = labels[Code[i].op];
+    Threaded = 1;
+  }
+  if ((mem = calloc(Datasize, 1)) == NULL ||
+      (regs = malloc(NREGS * sizeof(long))) == NULL)
+    fatal("メモリが確保できませんでした。execute()");
+  regend = regs + NREGS;
+  r = regs;
+  ip = &Code[entry];
+
+// 次の命令へ進む、cの位置へ飛ぶ
+#define NEXT goto *(++ip)->lab
+#define JUMP(c)           \
+  {                       \
+    ip = &Code[c];        \
+    goto *ip->lab;        \
+  }
+// 演算はオーバーフローしても折り返すように符号なしで行う
+#define ARITH(x, y, o) ((long)((unsigned long)(x)o(unsigned long)(y)))
+
+  goto *ip->lab;
+
+op_li:
+  r[ip->a] = ip->b;
+  NEXT;
+op_ldb:
+  r[ip->a] = mem[ip->b];
+  NEXT;
+op_ldw:
+  r[ip->a] = ldw(mem + ip->b);
+  NEXT;
+op_ldl:
+  r[ip->a] = ldl(mem + ip->b);
+  NEXT;
+op_stb:
+  mem[ip->b] = r[ip->a];
+  NEXT;
+op_stw:
+  stw(mem + ip->b, r[ip->a]);
+  NEXT;
+op_stl:
+  stl(mem + ip->b, r[ip->a]);
+  NEXT;
+op_ldib:
+  CHECK(r[ip->b], 1);
+  r[ip->a] = mem[r[ip->b]];
+  NEXT;
+op_ldiw:
+  CHECK(r[ip->b], 4);
+  r[ip->a] = ldw(mem + r[ip->b]);
+  NEXT;
+op_ldil:
+  CHECK(r[ip->b], 8);
+  r[ip->a] = ldl(mem + r[ip->b]);
+  NEXT;
+op_stib:
+  CHECK(r[ip->b], 1);
+  mem[r[ip->b]] = r[ip->a];
+  NEXT;
+op_stiw:
+  CHECK(r[ip->b], 4);
+  stw(mem + r[ip->b], r[ip->a]);
+  NEXT;
+op_stil:
+  CHECK(r[ip->b], 8);
+  stl(mem + r[ip->b], r[ip->a]);
+  NEXT;
+op_add:
+  r[ip->a] = ARITH(r[ip->b], r[ip->c], +);
+  NEXT;
+op_sub:
+  r[ip->a] = ARITH(r[ip->b], r[ip->c], -);
+  NEXT;
+op_mul:
+  r[ip->a] = ARITH(r[ip->b], r[ip->c], *);
+  NEXT;
+op_div:
+  if (r[ip->c] == 0)
+    vmerror("0で割りました");
+  r[ip->a] = (r[ip->c] == -1) ? ARITH(0, r[ip->b], -) : r[ip->b] / r[ip->c];
+  NEXT;
+op_shl:
+  r[ip->a] = ARITH(r[ip->b], ip->c, <<);
+  NEXT;
+op_eq:
+  r[ip->a] = r[ip->b] == r[ip->c];
+  NEXT;
+op_ne:
+  r[ip->a] = r[ip->b] != r[ip->c];
+  NEXT;
+op_lt:
+  r[ip->a] = r[ip->b] < r[ip->c];
+  NEXT;
+op_gt:
+  r[ip->a] = r[ip->b] > r[ip->c];
+  NEXT;
+op_le:
+  r[ip->a] = r[ip->b] <= r[ip->c];
+  NEXT;
+op_ge:
+  r[ip->a] = r[ip->b] >= r[ip->c];
+  NEXT;
+op_jmp:
+  JUMP(ip->c);
+op_jeq:
+  if (r[ip->a] == r[ip->b])
+    JUMP(ip->c);
+  NEXT;
+op_jne:
+  if (r[ip->a] != r[ip->b])
+    JUMP(ip->c);
+  NEXT;
+op_jlt:
+  if (r[ip->a] < r[ip->b])
+    JUMP(ip->c);
+  NEXT;
+op_jgt:
+  if (r[ip->a] > r[ip->b])
+    JUMP(ip->c);
+  NEXT;
+op_jle:
+  if (r[ip->a] <= r[ip->b])
+    JUMP(ip->c);
+  NEXT;
+op_jge:
+  if (r[ip->a] >= r[ip->b])
+    JUMP(ip->c);
+  NEXT;
+op_call:
+  if (depth == MAXDEPTH)
+    vmerror("関数の呼び出しが深すぎます");
+  frames[depth].ip = ip;
+  frames[depth].regs = r;
+  frames[depth++].dst = ip->a;
+  r += ip->a + 1;
+  JUMP(ip->b);
+op_print:
+  printf("%ld\n", r[ip->a]);
+  NEXT;
+op_enter:
+  if (r + ip->a > regend)
+    vmerror("レジスタのスタックがあふれました");
+  NEXT;
+op_ret:
+  v = r[ip->a];
+  if (depth == 0)
+  {
+    free(regs);
+    free(mem);
+    return (v);
+  }
+  depth--;
+  ip = frames[depth].ip;
+  r = frames[depth].regs;
+  r[frames[depth].dst] = v;
+  NEXT;
+op_addk:
+  r[ip->a] = ARITH(r[ip->b], ip->c, +);
+  NEXT;
+op_subk:
+  r[ip->a] = ARITH(r[ip->b], ip->c, -);
+  NEXT;
+op_mulk:
+  r[ip->a] = ARITH(r[ip->b], ip->c, *);
+  NEXT;
+op_jeqk:
+  if (r[ip->a] == ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_jnek:
+  if (r[ip->a] != ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_jltk:
+  if (r[ip->a] < ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_jgtk:
+  if (r[ip->a] > ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_jlek:
+  if (r[ip->a] <= ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_jgek:
+  if (r[ip->a] >= ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_jeqwk:
+  if (ldw(mem + ip->a) == ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_jnewk:
+  if (ldw(mem + ip->a) != ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_jltwk:
+  if (ldw(mem + ip->a) < ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_jgtwk:
+  if (ldw(mem + ip->a) > ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_jlewk:
+  if (ldw(mem + ip->a) <= ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_jgewk:
+  if (ldw(mem + ip->a) >= ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_jeqlk:
+  if (ldl(mem + ip->a) == ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_jnelk:
+  if (ldl(mem + ip->a) != ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_jltlk:
+  if (ldl(mem + ip->a) < ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_jgtlk:
+  if (ldl(mem + ip->a) > ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_jlelk:
+  if (ldl(mem + ip->a) <= ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_jgelk:
+  if (ldl(mem + ip->a) >= ip->b)
+    JUMP(ip->c);
+  NEXT;
+op_incw:
+  r[ip->a] = (int)ARITH(ldw(mem + ip->b), ip->c, +);
+  stw(mem + ip->b, r[ip->a]);
+  NEXT;
+op_incl:
+  r[ip->a] = ARITH(ldl(mem + ip->b), ip->c, +);
+  stl(mem + ip->b, r[ip->a]);
+  NEXT;
+}
+
+// 入力ファイルをバイトコードへ翻訳してmain()を実行し、
+// その戻り値の下位8ビットを終了ステータスとして返す
+int vm_runfile(char *infile)
+{
+  FILE *in;
+  int id;
+  long status;
+
+  if ((in = fopen(infile, "r")) == NULL)
+  {
+    fprintf(stderr, "%s を開けません:%s\n", infile, strerror(errno));
+    exit(1);
+  }
+  Ncode = Barrier = Threaded = 0;
+  Datasize = NULLSIZE;
+  O_run = 1;
+  compile(in, NULL);
+  fclose(in);
+
+  if ((id = findglob("main")) == -1 || Gsym[id].stype != S_FUNCTION)
+  {
+    fprintf(stderr, "%s にmain()がありません\n", infile);
     exit(1);
   }
+  status = execute(Gsym[id].posn);
+  fflush(stdout);
+  return (status & 0xff);
 }
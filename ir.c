@@ -0,0 +1,942 @@
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+
+// 中間表現の構築
+//
+// -O1では、パースした関数の本体を基本ブロックの制御フローグラフへ下ろす。
+// ブロックの中の命令は文ごとの木の形のまま計算する順に並べ、
+// 文の木の根の命令(保存、呼び出し、分岐など)に印を付けておく。
+// コード生成はこの根から木をたどってcg*の関数を呼ぶ。
+//
+// 大域変数の値はSSA形式の値として表す。変数を読むと、その場所で変数が
+// 持っている値の命令が得られる。構築はBraunらの方法で、先行ブロックが
+// すべてわかったブロックを封じてからφの引数を埋め、引数がすべて同じφは
+// その値に置き換える。関数呼び出しはどの変数も書き換えうるので、
+// その後で読む変数は読み込み命令から始め直す。ポインタを通した保存の後では、
+// 別名解析(alias.c)で触れうるとわかった変数だけを読み込み命令から始め直す。
+//
+// 変数への保存は最適化でも消さないので、変数のメモリにはいつも
+// その変数の今の値が入っている。コード生成はこれを使い、ほかの文で作った値は
+// その値を持っている変数から読み込む。
+
+static struct irfunc *Fn;       // 構築中の関数
+static struct irblock *Cur;     // 命令を追加しているブロック
+static struct irblock *Join;    // 構築中の展開した本体の合流点
+static int Curstmt;             // 構築中の文の番号
+static int Nstmts;              // 関数の中の文の数
+
+// シンボルIDから関数の中の変数の番号へ。
+// Vargenが今の関数の世代と違うシンボルはまだ番号がない
+static int Varidx[NSYMBOLS];
+static int Vargen[NSYMBOLS];
+static int Gen;
+
+// ブロックの変数の定義を、リストの先頭の場所と変数の番号で引く表。
+// 変数の多い関数でリストをたどらないように使う
+static struct irdef **Deftab;
+static int Deftabsize;
+static int Ndefs;
+
+// 置き換えた先をたどって値を返す
+struct irinst *ir_resolve(struct irinst *v)
+{
+  while (v->repl)
+    v = v->repl;
+  return (v);
+}
+
+// 保存した値nの元の値を返す。代入の連鎖では最初の値になる
+struct irinst *ir_storedval(struct irinst *n)
+{
+  while (n->op == IR_STORE || n->op == IR_STDEREF)
+    n = n->args[0];
+  return (n);
+}
+
+// 関数の命令の引数をすべて置き換えた先へ向け直す
+void ir_resolveargs(struct irfunc *fn)
+{
+  struct irblock *b;
+  struct irinst *n;
+
+  for (b = fn->entry; b; b = b->next)
+  {
+    for (n = b->phis; n; n = n->next)
+      for (int i = 0; i < n->nargs; i++)
+        n->args[i] = ir_resolve(n->args[i]);
+    for (n = b->head; n; n = n->next)
+      for (int i = 0; i < n->nargs; i++)
+        n->args[i] = ir_resolve(n->args[i]);
+  }
+}
+
+// 命令を作る。どのブロックにも入れない
+struct irinst *ir_newinst(struct irfunc *fn, int op, int type)
+{
+  struct irinst *n = arena_alloc(sizeof(struct irinst));
+
+  memset(n, 0, sizeof(struct irinst));
+  n->op = op;
+  n->type = type;
+  n->id = -1;
+  n->var = -1;
+  n->num = ++fn->ninsts;
+  n->args = n->abuf;
+  n->leader = n;
+  n->hvar = -1;
+  n->hslot = -1;
+  n->base = -2;
+  return (n);
+}
+
+// 型typeの定数valの命令を作る。どの文の木にも属さない
+struct irinst *ir_const(struct irfunc *fn, long val, int type)
+{
+  struct irinst *n = ir_newinst(fn, IR_CONST, type);
+
+  n->val = val;
+  return (n);
+}
+
+// 命令nをブロックbの命令の列から外す
+void ir_unlink(struct irinst *n)
+{
+  struct irblock *b = n->block;
+
+  if (n->op == IR_PHI)
+  {
+    if (n->prev)
+      n->prev->next = n->next;
+    else
+      b->phis = n->next;
+    if (n->next)
+      n->next->prev = n->prev;
+    return;
+  }
+  if (n->prev)
+    n->prev->next = n->next;
+  else
+    b->head = n->next;
+  if (n->next)
+    n->next->prev = n->prev;
+  else
+    b->tail = n->prev;
+}
+
+// ブロックfromからtoへの辺を消し、toのφからその引数を除く
+void ir_removeedge(struct irblock *from, struct irblock *to)
+{
+  struct irinst *phi;
+  int i;
+
+  for (i = 0; i < to->npreds; i++)
+    if (to->preds[i] == from)
+      break;
+  if (i == to->npreds)
+    return;
+  for (phi = to->phis; phi; phi = phi->next)
+  {
+    memmove(&phi->args[i], &phi->args[i + 1],
+            (phi->nargs - i - 1) * sizeof(struct irinst *));
+    phi->nargs--;
+  }
+  memmove(&to->preds[i], &to->preds[i + 1],
+          (to->npreds - i - 1) * sizeof(struct irblock *));
+  to->npreds--;
+}
+
+// 関数fnの新しいブロックを作る。配置にはまだ置かない
+struct irblock *ir_newblock(struct irfunc *fn)
+{
+  struct irblock *b = arena_alloc(sizeof(struct irblock));
+
+  memset(b, 0, sizeof(struct irblock));
+  b->num = fn->nblocks++;
+  if (fn->alltail)
+    fn->alltail->allnext = b;
+  else
+    fn->all = b;
+  fn->alltail = b;
+  return (b);
+}
+
+// ブロックbを配置の最後に置き、命令を追加するブロックにする
+static void startblock(struct irblock *b)
+{
+  if (Fn->last)
+    Fn->last->next = b;
+  else
+    Fn->entry = b;
+  Fn->last = b;
+  Cur = b;
+}
+
+// ブロックbへどこからも来なければtrueを返す。
+// returnの後ろに続く文などで、入口のブロックは除く
+static int dead(struct irblock *b)
+{
+  return (b->npreds == 0 && b != Fn->entry);
+}
+
+// ブロックfromからtoへの辺を作る。fromへどこからも来なければ作らない
+static void addedge(struct irblock *from, struct irblock *to)
+{
+  struct irblock **preds;
+
+  if (dead(from))
+    return;
+  from->succs[from->nsuccs++] = to;
+  if (to->npreds == to->maxpreds)
+  {
+    to->maxpreds = to->maxpreds ? 2 * to->maxpreds : 2;
+    preds = arena_alloc(to->maxpreds * sizeof(struct irblock *));
+    if (to->npreds)
+      memcpy(preds, to->preds, to->npreds * sizeof(struct irblock *));
+    to->preds = preds;
+  }
+  to->preds[to->npreds++] = from;
+}
+
+// 命令nが終端命令であればtrueを返す
+static int isterm(struct irinst *n)
+{
+  return (n->op == IR_BR || n->op == IR_JMP || n->op == IR_RET);
+}
+
+// 命令nをブロックbの最後に追加する
+void ir_append(struct irblock *b, struct irinst *n)
+{
+  n->block = b;
+  n->prev = b->tail;
+  if (b->tail)
+    b->tail->next = n;
+  else
+    b->head = n;
+  b->tail = n;
+}
+
+// 命令nをブロックbの終端命令の前に入れる
+void ir_insertterm(struct irblock *b, struct irinst *n)
+{
+  struct irinst *t = b->tail;
+
+  n->block = b;
+  n->next = t;
+  n->prev = t->prev;
+  if (t->prev)
+    t->prev->next = n;
+  else
+    b->head = n;
+  t->prev = n;
+}
+
+// 構築中の文の命令を作ってブロックの最後に追加する。
+// 同じ文の木の引数に副作用があれば、この命令の木にも副作用がある
+static struct irinst *add(int op, int type, struct irinst *l, struct irinst *r)
+{
+  struct irinst *n = ir_newinst(Fn, op, type);
+
+  n->stmt = Curstmt;
+  if (op == IR_STORE || op == IR_STDEREF || op == IR_CALL)
+    n->flags |= IRF_EFFECT;
+  if (l)
+  {
+    n->args[n->nargs++] = l;
+    if (l->stmt == Curstmt)
+      n->flags |= l->flags & IRF_EFFECT;
+  }
+  if (r)
+  {
+    n->args[n->nargs++] = r;
+    if (r->stmt == Curstmt)
+      n->flags |= r->flags & IRF_EFFECT;
+  }
+  ir_append(Cur, n);
+  return (n);
+}
+
+// 新しい文を始める
+static void newstmt(void)
+{
+  Curstmt = ++Nstmts;
+}
+
+// 定義のリストの先頭の場所listと変数varから、定義を探す表の枠を返す
+static int defhash(struct irdef **list, int var)
+{
+  unsigned long h = (unsigned long)list / sizeof(struct irdef *);
+
+  return ((h * 31 + var) & (Deftabsize - 1));
+}
+
+// 定義を探す表を2倍の大きさにする
+static void growdeftab(void)
+{
+  struct irdef **old = Deftab, *d, *next;
+  int oldsize = Deftabsize;
+
+  Deftabsize = oldsize ? oldsize * 2 : 256;
+  if ((Deftab = calloc(Deftabsize, sizeof(struct irdef *))) == NULL)
+    fatal("メモリが確保できませんでした。growdeftab()");
+  for (int i = 0; i < oldsize; i++)
+    for (d = old[i]; d; d = next)
+    {
+      next = d->hnext;
+      d->hnext = Deftab[defhash(d->list, d->var)];
+      Deftab[defhash(d->list, d->var)] = d;
+    }
+  free(old);
+}
+
+// 定義を探す表を空にする
+static void cleardeftab(void)
+{
+  free(Deftab);
+  Deftab = NULL;
+  Deftabsize = Ndefs = 0;
+}
+
+// 定義のリスト*listから変数varの定義を探す
+static struct irdef *finddef(struct irdef **list, int var)
+{
+  struct irdef *d;
+
+  if (Deftabsize == 0)
+    return (NULL);
+  for (d = Deftab[defhash(list, var)]; d; d = d->hnext)
+    if (d->list == list && d->var == var)
+      return (d);
+  return (NULL);
+}
+
+// 定義のリスト*listへ変数varの値valを記録する
+static void setdef(struct irdef **list, int var, struct irinst *val, int stamp)
+{
+  struct irdef *d = finddef(list, var);
+  int h;
+
+  if (d == NULL)
+  {
+    if (Ndefs >= Deftabsize)
+      growdeftab();
+    d = arena_alloc(sizeof(struct irdef));
+    d->var = var;
+    d->list = list;
+    d->next = *list;
+    *list = d;
+    h = defhash(list, var);
+    d->hnext = Deftab[h];
+    Deftab[h] = d;
+    Ndefs++;
+  }
+  d->val = val;
+  d->stamp = stamp;
+}
+
+// ブロックbで変数varが値valを持つようになった
+static void writevar(struct irblock *b, int var, struct irinst *val)
+{
+  setdef(&b->defs, var, val, b->clobbers);
+}
+
+// ブロックbの入口で変数varのメモリに値valが入っていることを記録する
+void ir_setentry(struct irblock *b, int var, struct irinst *val)
+{
+  setdef(&b->entry, var, val, 0);
+}
+
+static struct irinst *readvar(int var, struct irblock *b);
+
+// ブロックbに変数varの読み込み命令を置く。
+// 構築中のブロックでは今の文の木に、できあがったブロックでは終端命令の前に置く
+static struct irinst *newload(int var, struct irblock *b)
+{
+  int id = Fn->varids[var];
+  struct irinst *n = ir_newinst(Fn, IR_LOAD, Gsym[id].type);
+
+  n->id = id;
+  n->var = var;
+  if (b->tail && isterm(b->tail))
+    ir_insertterm(b, n);
+  else
+  {
+    n->stmt = Curstmt;
+    ir_append(b, n);
+  }
+  writevar(b, var, n);
+  return (n);
+}
+
+// ブロックbの先頭に変数varのφを作る
+static struct irinst *newphi(struct irblock *b, int var, int type)
+{
+  struct irinst *n = ir_newinst(Fn, IR_PHI, type);
+
+  n->block = b;
+  n->var = var;
+  if (var != -1)
+    n->id = Fn->varids[var];
+  n->next = b->phis;
+  if (b->phis)
+    b->phis->prev = n;
+  b->phis = n;
+  return (n);
+}
+
+// φの引数の領域を先行ブロックの数だけ確保する
+static void phiargs(struct irinst *phi)
+{
+  int n = phi->block->npreds;
+
+  if (n > 2)
+    phi->args = arena_alloc(n * sizeof(struct irinst *));
+  phi->nargs = n;
+}
+
+// φの引数がすべて同じ値(かφ自身)であれば、φをその値に置き換えて返す。
+// そうでなければφを返す
+static struct irinst *trivial(struct irinst *phi)
+{
+  struct irinst *same = NULL, *a;
+
+  for (int i = 0; i < phi->nargs; i++)
+  {
+    a = ir_resolve(phi->args[i]);
+    if (a == same || a == phi)
+      continue;
+    if (same)
+      return (phi);
+    same = a;
+  }
+
+  // 引数のないφは、どこからも来ないブロックのもの。そのままにしておく
+  if (same == NULL)
+    return (phi);
+  phi->repl = same;
+  ir_unlink(phi);
+  return (same);
+}
+
+// φの引数を先行ブロックから読んで埋める
+static struct irinst *addphiops(struct irinst *phi)
+{
+  struct irblock *b = phi->block;
+
+  phiargs(phi);
+  for (int i = 0; i < b->npreds; i++)
+    phi->args[i] = readvar(phi->var, b->preds[i]);
+  return (trivial(phi));
+}
+
+// ブロックbの入口での変数varの値を求める
+static struct irinst *readrec(int var, struct irblock *b)
+{
+  struct irinst *val;
+
+  if (!b->sealed)
+  {
+    // まだ先行ブロックが増えるので、φを置いて封じるときに埋める
+    val = newphi(b, var, Gsym[Fn->varids[var]].type);
+    setdef(&b->incomplete, var, val, 0);
+  }
+  else if (b->npreds == 1)
+    val = readvar(var, b->preds[0]);
+  else
+  {
+    // ループで自分へ戻ってきたときのために先にφを定義にしておく
+    val = newphi(b, var, Gsym[Fn->varids[var]].type);
+    writevar(b, var, val);
+    val = addphiops(val);
+  }
+  writevar(b, var, val);
+  setdef(&b->entry, var, val, 0);
+  return (val);
+}
+
+// ブロックbで、書き換えの回数がstampだったときより後に、
+// 変数varを書き換えうる命令があればtrueを返す
+static int clobbered(struct irblock *b, int var, int stamp)
+{
+  if (stamp < b->lastcall)
+    return (1);
+  for (int i = stamp; i < b->clobbers; i++)
+    if (ir_mayalias(b->clobs[i], Fn->varids[var]))
+      return (1);
+  return (0);
+}
+
+// ブロックbの今の位置(できあがったブロックでは出口)での変数varの値を返す
+static struct irinst *readvar(int var, struct irblock *b)
+{
+  struct irdef *d = finddef(&b->defs, var);
+
+  if (d && !clobbered(b, var, d->stamp))
+  {
+    d->stamp = b->clobbers;
+    return (ir_resolve(d->val));
+  }
+
+  // 書き換えうる命令の後や、入口のブロックではメモリから読む
+  if (d || clobbered(b, var, 0) || (b->sealed && b->npreds == 0))
+    return (newload(var, b));
+  return (readrec(var, b));
+}
+
+// 命令nは変数を書き換えうるので、ブロックbの書き換えの回数を増やす
+static void clobber(struct irblock *b, struct irinst *n)
+{
+  struct irinst **c;
+
+  if (b->clobbers == b->maxclobs)
+  {
+    b->maxclobs = b->maxclobs ? 2 * b->maxclobs : 4;
+    c = arena_alloc(b->maxclobs * sizeof(struct irinst *));
+    if (b->clobbers)
+      memcpy(c, b->clobs, b->clobbers * sizeof(struct irinst *));
+    b->clobs = c;
+  }
+  b->clobs[b->clobbers++] = n;
+  if (n->op == IR_CALL)
+    b->lastcall = b->clobbers;
+}
+
+// ブロックbの先行ブロックがすべてわかったので、置いておいたφを埋める
+static void seal(struct irblock *b)
+{
+  for (struct irdef *d = b->incomplete; d; d = d->next)
+    addphiops(d->val);
+  b->sealed = 1;
+}
+
+// 値vを変数idへ保存したとき、メモリの値がvと同じになればtrueを返す。
+// レジスタより狭い変数では、定数と同じ型の変数の値のほかは切り詰められうる
+static int exact(struct irinst *v, int id)
+{
+  int type = Gsym[id].type;
+
+  v = ir_storedval(v);
+  if (genprimsize(type) >= genprimsize(P_LONG))
+    return (1);
+  if (v->op == IR_CONST)
+    return (type != P_CHAR || (v->val >= 0 && v->val <= 255));
+  return (v->op == IR_LOAD && Gsym[v->id].type == type);
+}
+
+static struct irinst *expr(struct ASTnode *n);
+static void stmt(struct ASTnode *n);
+
+// 文を1つ作って、ブロックbへの無条件分岐を置く
+static void jumpto(struct irblock *b)
+{
+  newstmt();
+  add(IR_JMP, P_NONE, NULL, NULL)->flags |= IRF_ROOT;
+  addedge(Cur, b);
+}
+
+// 代入の命令を作る。値を先に、ポインタを通した保存ではポインタを後に計算する
+static struct irinst *assign(struct ASTnode *n)
+{
+  struct irinst *v, *s, *p;
+  int id;
+
+  v = expr(n->left);
+  if (n->right->op == A_IDENT)
+  {
+    id = n->right->v.id;
+    s = add(IR_STORE, v->type, v, NULL);
+    s->id = id;
+    s->var = Varidx[id];
+
+    // 切り詰められうるときは保存した後のメモリから読み直す
+    if (exact(v, id))
+    {
+      s->flags |= IRF_EXACT;
+      writevar(Cur, s->var, ir_storedval(v));
+    }
+    else
+      newload(s->var, Cur);
+    return (s);
+  }
+
+  p = expr(n->right->left);
+  s = add(IR_STDEREF, v->type, v, p);
+  s->val = n->right->type;
+  clobber(Cur, s);
+  return (s);
+}
+
+// 展開した呼び出しの命令を作る。本体の後ろに合流点のブロックを置き、
+// 値のある関数であれば、本体のA_LEAVEの値を合流点のφで受け取る
+static struct irinst *inlined(struct ASTnode *n)
+{
+  struct irblock *outer = Join, *join, *p;
+  struct irinst *phi, *l;
+  int outerstmt = Curstmt;
+
+  join = ir_newblock(Fn);
+  Join = join;
+  stmt(n->mid);
+  jumpto(join);
+  Join = outer;
+  Curstmt = outerstmt;
+  seal(join);
+  startblock(join);
+  if (n->type == P_VOID)
+    return (NULL);
+
+  // 合流点へ来るのは本体のA_LEAVEからだけ。値は合流点のφに入る
+  phi = newphi(join, -1, n->type);
+  phi->id = n->v.id;
+  phi->stmt = Curstmt;
+  phi->flags |= IRF_INLINE;
+  phiargs(phi);
+  for (int i = 0; i < join->npreds; i++)
+  {
+    p = join->preds[i];
+    for (l = p->tail; l && l->op != IR_LEAVE; l = l->prev)
+      ;
+    if (l == NULL)
+      fatal("展開した本体が値を返していません");
+    phi->args[i] = l->args[0];
+  }
+  return (phi);
+}
+
+// 式nの命令を計算する順に作り、式の値の命令を返す
+static struct irinst *expr(struct ASTnode *n)
+{
+  struct irinst *l, *r, *v;
+
+  switch (n->op)
+  {
+  case A_INTLIT:
+    v = add(IR_CONST, n->type, NULL, NULL);
+    v->val = n->v.intvalue;
+    return (v);
+  case A_IDENT:
+    return (readvar(Varidx[n->v.id], Cur));
+  case A_ADDR:
+    v = add(IR_ADDR, n->type, NULL, NULL);
+    v->id = n->v.id;
+    return (v);
+  case A_WIDEN:
+    v = add(IR_WIDEN, n->type, expr(n->left), NULL);
+    v->val = n->left->type;
+    return (v);
+  case A_SCALE:
+    v = add(IR_SCALE, n->type, expr(n->left), NULL);
+    v->val = n->v.size;
+    return (v);
+  case A_DEREF:
+    v = add(IR_DEREF, n->type, expr(n->left), NULL);
+    v->val = n->left->type;
+    return (v);
+  case A_FUNCCALL:
+    v = add(IR_CALL, n->type, expr(n->left), NULL);
+    v->id = n->v.id;
+    clobber(Cur, v);
+    return (v);
+  case A_ASSIGN:
+    return (assign(n));
+  case A_INLINE:
+    return (inlined(n));
+  case A_ADD:
+  case A_SUBTRACT:
+  case A_MULTIPLY:
+  case A_DIVIDE:
+  case A_EQ:
+  case A_NE:
+  case A_LT:
+  case A_GT:
+  case A_LE:
+  case A_GE:
+    l = expr(n->left);
+    r = expr(n->right);
+    return (add(n->op - A_ADD + IR_ADD, n->type, l, r));
+  }
+  fatald("中間表現へ下ろせないAST操作です", n->op);
+  return (NULL);
+}
+
+// if文。条件の比較から真と偽のブロックへ分岐し、合流点で続ける
+static void ifstmt(struct ASTnode *n)
+{
+  struct irblock *t, *f = NULL, *j;
+
+  newstmt();
+  add(IR_BR, P_NONE, expr(n->left), NULL)->flags |= IRF_ROOT;
+  t = ir_newblock(Fn);
+  if (n->right)
+    f = ir_newblock(Fn);
+  j = ir_newblock(Fn);
+  addedge(Cur, t);
+  addedge(Cur, f ? f : j);
+
+  seal(t);
+  startblock(t);
+  stmt(n->mid);
+  jumpto(j);
+  if (f)
+  {
+    seal(f);
+    startblock(f);
+    stmt(n->right);
+    jumpto(j);
+  }
+  seal(j);
+  startblock(j);
+}
+
+// while文。条件のブロックは本体から戻ってくる辺ができてから封じる。
+// 条件に展開した呼び出しがあれば、分岐するのはその合流点のブロック
+static void whilestmt(struct ASTnode *n)
+{
+  struct irblock *h, *body, *x;
+
+  h = ir_newblock(Fn);
+  jumpto(h);
+  startblock(h);
+  newstmt();
+  add(IR_BR, P_NONE, expr(n->left), NULL)->flags |= IRF_ROOT;
+  body = ir_newblock(Fn);
+  x = ir_newblock(Fn);
+  addedge(Cur, body);
+  addedge(Cur, x);
+
+  seal(body);
+  startblock(body);
+  stmt(n->right);
+  jumpto(h);
+  seal(h);
+  seal(x);
+  startblock(x);
+}
+
+// A_GLUEでつないだ文の並び。並びは左に深く伸びるので、
+// genGLUE()と同じく左の子の列をスタックに積んで一番左の文から作る
+static void stmts(struct ASTnode *n)
+{
+  struct ASTnode **spine = NULL;
+  int depth = 0, max = 0;
+
+  for (; n->op == A_GLUE; n = n->left)
+  {
+    if (depth == max)
+    {
+      max = max ? 2 * max : 64;
+      if ((spine = realloc(spine, max * sizeof(struct ASTnode *))) == NULL)
+        fatal("メモリが確保できませんでした。stmts()");
+    }
+    spine[depth++] = n;
+  }
+
+  stmt(n);
+  while (depth > 0)
+    stmt(spine[--depth]->right);
+  free(spine);
+}
+
+// 文nの命令を作る
+static void stmt(struct ASTnode *n)
+{
+  struct irinst *v;
+
+  if (n == NULL)
+    return;
+  switch (n->op)
+  {
+  case A_GLUE:
+    stmts(n);
+    return;
+  case A_IF:
+    ifstmt(n);
+    return;
+  case A_WHILE:
+    whilestmt(n);
+    return;
+  case A_RETURN:
+  case A_LEAVE:
+    // 値を返した後の文はどこからも来ないブロックに置く
+    newstmt();
+    v = expr(n->left);
+    add(n->op == A_RETURN ? IR_RET : IR_LEAVE, n->type, v, NULL)->flags |= IRF_ROOT;
+    if (n->op == A_LEAVE)
+      jumpto(Join);
+    startblock(ir_newblock(Fn));
+    return;
+  }
+
+  // 式の文。保存と呼び出しはそれ自体を根にし、
+  // ほかの式は値を捨てる命令を根にする
+  newstmt();
+  if ((v = expr(n)) == NULL)
+    return;
+  if (v->op == IR_STORE || v->op == IR_STDEREF || v->op == IR_CALL)
+    v->flags |= IRF_ROOT;
+  else
+    add(IR_EVAL, P_NONE, v, NULL)->flags |= IRF_ROOT;
+}
+
+// ツリーnの中の変数に関数の中の番号を付ける
+static void countvars(struct ASTnode *n)
+{
+  int id;
+
+  for (; n != NULL; n = n->left)
+  {
+    if (n->op == A_IDENT && Vargen[id = n->v.id] != Gen)
+    {
+      Vargen[id] = Gen;
+      Varidx[id] = Fn->nvars++;
+    }
+    countvars(n->mid);
+    countvars(n->right);
+  }
+}
+
+// パースした関数treeの中間表現を作って最適化し、シンボルテーブルに記録する
+void ir_function(struct ASTnode *tree)
+{
+  struct irblock *entry;
+
+  // エラーで前の関数の構築を抜けたときの表も捨てる
+  cleardeftab();
+  Fn = arena_alloc(sizeof(struct irfunc));
+  memset(Fn, 0, sizeof(struct irfunc));
+  Fn->id = tree->v.id;
+  Gen++;
+  countvars(tree->left);
+  Fn->varids = arena_alloc((Fn->nvars + 1) * sizeof(int));
+  for (int i = 0; i < Globs; i++)
+    if (Vargen[i] == Gen)
+      Fn->varids[Varidx[i]] = i;
+
+  Join = NULL;
+  Nstmts = Curstmt = 0;
+  entry = ir_newblock(Fn);
+  entry->sealed = 1;
+  startblock(entry);
+  stmt(tree->left);
+  Fn->nstmts = Nstmts;
+
+  ir_resolveargs(Fn);
+  ir_optimize(Fn);
+  Gsym[Fn->id].ir = Fn;
+  cleardeftab();
+}
+
+// 関数idの中間表現のコード生成で使うラベルの数を返す
+int ir_labelcount(int id)
+{
+  return (Gsym[id].ir->nblocks);
+}
+
+// 命令の名前
+static char *Irname[] = {
+    "", "const", "addr", "load", "store", "add", "sub", "mul", "div",
+    "eq", "ne", "lt", "gt", "le", "ge", "widen", "scale", "deref",
+    "stderef", "call", "phi", "eval", "promote", "demote", "hoist", "leave", "ret",
+    "br", "jmp"};
+
+// 引数vを出力する。定数は値で示す
+static void dumparg(struct irinst *v)
+{
+  if (v->op == IR_CONST)
+    fprintf(stdout, "%ld", v->val);
+  else
+    fprintf(stdout, "v%d", v->num);
+}
+
+// 関数fnの命令nを1行で出力する。ポインタを通した読み書きには、
+// 指す変数がわかればその変数を、関数の変数のどれにも触れなければnoaliasを付ける
+static void dumpinst(struct irfunc *fn, struct irinst *n)
+{
+  struct irblock *b = n->block;
+  int base;
+
+  fprintf(stdout, "  ");
+  if (n->op < IR_EVAL)
+    fprintf(stdout, "v%d = ", n->num);
+  fprintf(stdout, "%s", Irname[n->op]);
+  switch (n->op)
+  {
+  case IR_ADDR:
+  case IR_LOAD:
+  case IR_CALL:
+    fprintf(stdout, " %s", Gsym[n->id].name);
+    break;
+  case IR_STORE:
+    fprintf(stdout, " %s,", Gsym[n->id].name);
+    break;
+  case IR_PROMOTE:
+  case IR_DEMOTE:
+    fprintf(stdout, " %s, reg%ld\n", Gsym[n->id].name, n->val);
+    return;
+  case IR_HOIST:
+    fprintf(stdout, " ");
+    dumparg(n->args[0]);
+    fprintf(stdout, ", reg%ld\n", n->val);
+    return;
+  case IR_PHI:
+    fprintf(stdout, " %s%s", n->flags & IRF_INLINE ? "inline " : "",
+            Gsym[n->id].name);
+    for (int i = 0; i < n->nargs; i++)
+    {
+      fprintf(stdout, " [");
+      dumparg(n->args[i]);
+      fprintf(stdout, ", B%d]", b->preds[i]->num);
+    }
+    fprintf(stdout, "\n");
+    return;
+  }
+  for (int i = 0; i < n->nargs; i++)
+  {
+    fprintf(stdout, i ? ", " : " ");
+    dumparg(n->args[i]);
+  }
+  if (n->op == IR_SCALE)
+    fprintf(stdout, ", %ld", n->val);
+  if (n->op == IR_BR)
+    fprintf(stdout, ", B%d, B%d", b->succs[0]->num, b->succs[1]->num);
+  if (n->op == IR_JMP)
+    fprintf(stdout, " B%d", b->succs[0]->num);
+  if (n->leader != n)
+    fprintf(stdout, "  ; = v%d", n->leader->num);
+  if (n->op == IR_DEREF || n->op == IR_STDEREF)
+  {
+    base = ir_ptrbase(n->args[n->op == IR_DEREF ? 0 : 1]);
+    if (base != -1)
+      fprintf(stdout, "  ; points to %s", Gsym[base].name);
+    else if (ir_noalias(fn, n))
+      fprintf(stdout, "  ; noalias");
+  }
+  fprintf(stdout, "\n");
+}
+
+// 関数idの中間表現を出力する
+void ir_dump(int id)
+{
+  struct irfunc *fn = Gsym[id].ir;
+  struct irblock *b;
+  struct irinst *n;
+
+  fprintf(stdout, "function %s\n", Gsym[id].name);
+  for (b = fn->entry; b; b = b->next)
+  {
+    fprintf(stdout, "B%d:", b->num);
+    if (b->npreds)
+    {
+      fprintf(stdout, "  ; preds");
+      for (int i = 0; i < b->npreds; i++)
+        fprintf(stdout, " B%d", b->preds[i]->num);
+    }
+    fprintf(stdout, "\n");
+    for (n = b->phis; n; n = n->next)
+      dumpinst(fn, n);
+    for (n = b->head; n; n = n->next)
+      if (n->op != IR_CONST)
+        dumpinst(fn, n);
+  }
+  fprintf(stdout, "\n");
+}
@@ -0,0 +1,542 @@
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+
+// 中間表現からのコード生成
+//
+// -O1では関数の本体を、最適化した中間表現からcg*の関数で生成する。
+// ブロックは配置の順に並べ、すぐ後ろのブロックへの分岐は出さない。
+// ブロックの中では文の木の根ごとに、木をたどって引数から生成し、
+// 根を生成するたびにすべてのレジスタを開放する。
+//
+// ほかの文で作った値はレジスタに残っていないので変数から読み込む。
+// 変数のメモリにはいつもその変数の今の値が入っているので、生成しながら
+// 変数がどの値を持っているかをHoldに記録しておく。木の中の値も、
+// 値番号が同じ値を持っている変数があれば、計算し直さずにそこから読み込む。
+// ループの間は変数用のレジスタに置く変数(loop.c)は、メモリの代わりに
+// そのレジスタを変数の場所として読み書きする。前ブロックへ移したループで
+// 変わらない値は、ループの間は変数用のレジスタから読み込む。
+// ループの変数に大きさを掛けてポインタに足す値も変数用のレジスタに置き、
+// ループの変数への保存のたびに、足した数に大きさを掛けた数をレジスタへ足す。
+// 大きさ(2、4、8)を掛けた値を足す加算は、掛け算をせずにアドレスの計算の形の
+// 1命令にする。
+// 並列コード生成ではワーカーのスレッドで呼ばれるので状態はスレッドごとに持つ
+
+static _Thread_local struct irfunc *Fn;     // 生成中の関数
+static _Thread_local struct irinst **Hold;  // 変数が今持っている値。わからなければNULL
+static _Thread_local int Stmt;              // 生成中の文の番号
+static _Thread_local int *Reg;              // 変数を置いた変数用のレジスタ。-1はメモリ
+static _Thread_local struct irpromo *Promo; // 生成中のブロックでレジスタに置いた変数
+
+// 変数の記録をすべて消す。呼び出しはどの変数も書き換えうる
+static void clearholds(void)
+{
+  if (Fn->nvars)
+    memset(Hold, 0, Fn->nvars * sizeof(struct irinst *));
+}
+
+// ポインタを通した保存nが書き換えうる変数の記録を消す
+static void clobberholds(struct irinst *n)
+{
+  for (int i = 0; i < Fn->nvars; i++)
+    if (Hold[i] && ir_mayalias(n, Fn->varids[i]))
+      Hold[i] = NULL;
+}
+
+// 変数varが値vを持つようになった
+static void sethold(int var, struct irinst *v)
+{
+  v = ir_resolve(v);
+  Hold[var] = v;
+  v->leader->hvar = var;
+}
+
+// 値vと値番号が同じ値を持っている変数を返す。なければ-1を返す。
+// 最後に記録した変数で見つからなければ、searchがtrueのときだけすべて探す
+static int holder(struct irinst *v, int search)
+{
+  struct irinst *l = v->leader;
+
+  if (l->hvar != -1 && Hold[l->hvar] && Hold[l->hvar]->leader == l)
+    return (l->hvar);
+  if (!search)
+    return (-1);
+  for (int i = 0; i < Fn->nvars; i++)
+    if (Hold[i] && Hold[i]->leader == l)
+      return (i);
+  return (-1);
+}
+
+// 変数への保存nの後で、変数が持つ値を記録する
+static void storehold(struct irinst *n)
+{
+  if (n->flags & IRF_EXACT)
+    sethold(n->var, ir_storedval(n->args[0]));
+  else
+    Hold[n->var] = NULL;
+}
+
+// ブロックbで変数用のレジスタに置く変数に切り替える
+static void setpromo(struct irblock *b)
+{
+  struct irpromo *p;
+
+  for (p = Promo; p; p = p->next)
+    if (p->var != -1)
+      Reg[p->var] = -1;
+    else if (p->iv == -1)
+      p->val->hslot = -1;
+  Promo = b->promo;
+  for (p = Promo; p; p = p->next)
+    if (p->var != -1)
+      Reg[p->var] = p->slot;
+    else if (p->iv == -1)
+      p->val->hslot = p->slot;
+}
+
+// 変数varの値をレジスタへ読み込む
+static int loadvar(int var)
+{
+  if (Reg[var] != -1)
+    return (cgloadvarreg(Reg[var]));
+  return (cgloadglob(Fn->varids[var]));
+}
+
+static int gen(struct irinst *n);
+
+// 値vをレジスタに入れて、そのレジスタを返す
+static int load(struct irinst *v)
+{
+  int x;
+
+  if (v->hslot != -1)
+    return (cgloadvarreg(v->hslot));
+  switch (v->op)
+  {
+  case IR_CONST:
+    return (cgloadint(v->val, v->type));
+  case IR_ADDR:
+    return (cgaddress(v->id));
+  }
+
+  // ほかの文の値と生成済みの値は、それを持っている変数から読み込む
+  if (v->stmt != Stmt || v->done)
+  {
+    if ((x = holder(v, 1)) == -1)
+      fatald("中間表現の値を置く場所がありません。v", v->num);
+    return (loadvar(x));
+  }
+
+  // 副作用のない木は、同じ値を持っている変数があればそこから読み込む
+  if (!(v->flags & IRF_EFFECT) && (x = holder(v, 0)) != -1)
+    return (loadvar(x));
+  return (gen(v));
+}
+
+// 変数用のレジスタに置いた変数への保存nが、根の文で変数に定数を足すだけであれば
+// 足す値を*valへ入れてtrueを返す
+static int increment(struct irinst *n, int *val)
+{
+  struct irinst *a = n->args[0], *v, *c;
+
+  if (!(n->flags & IRF_ROOT) || a->stmt != Stmt || a->done ||
+      (a->op != IR_ADD && a->op != IR_SUB))
+    return (0);
+  v = a->args[0];
+  c = a->args[1];
+  if (v->op == IR_CONST && a->op == IR_ADD)
+  {
+    v = a->args[1];
+    c = a->args[0];
+  }
+  if (c->op != IR_CONST)
+    return (0);
+
+  // 足される値は、この文で読み込む変数か、変数が今持っている値
+  if (v->op == IR_LOAD && v->var == n->var && v->stmt == Stmt)
+    ;
+  else if (Hold[n->var] == NULL || Hold[n->var]->leader != v->leader)
+    return (0);
+  *val = a->op == IR_ADD ? c->val : -c->val;
+  return (1);
+}
+
+// 変数用のレジスタに置いた変数への保存nを生成する。
+// 変数に定数を足すだけであれば、レジスタへ直接足す
+static int storereg(struct irinst *n)
+{
+  int r, val;
+
+  if (increment(n, &val) && cgaddvarreg(Reg[n->var], val))
+  {
+    n->args[0]->done = 1;
+    n->done = 1;
+    sethold(n->var, n->args[0]);
+    return (NOREG);
+  }
+  r = cgstorvarreg(load(n->args[0]), Reg[n->var]);
+  n->done = 1;
+  storehold(n);
+  return (r);
+}
+
+// 変数への保存nを生成する
+static int storevar(struct irinst *n)
+{
+  int r;
+
+  if (Reg[n->var] != -1)
+    return (storereg(n));
+  r = cgstorglob(load(n->args[0]), n->id);
+  n->done = 1;
+  storehold(n);
+  return (r);
+}
+
+// 変数varから計算するポインタを変数用のレジスタに置いていればtrueを返す
+static int hasiv(int var)
+{
+  for (struct irpromo *p = Promo; p; p = p->next)
+    if (p->iv == var)
+      return (1);
+  return (0);
+}
+
+// ポインタpを置いた変数用のレジスタへ定数valを足す。
+// 即値で足せなければ、負の数は正の数を読み込んで引く
+static void addiv(struct irpromo *p, int val)
+{
+  int r;
+
+  if (cgaddvarreg(p->slot, val))
+    return;
+  r = cgloadvarreg(p->slot);
+  if (val < 0)
+    r = cgsub(r, cgloadint(-val, P_LONG));
+  else
+    r = cgadd(cgloadint(val, P_LONG), r);
+  cgstorvarreg(r, p->slot);
+}
+
+// ポインタpを置いた変数用のレジスタへ、ループの変数の今の値に大きさを掛けた数を
+// signが正なら足し、負なら引く。ループの変数への保存は根の文に限るので
+// (loop.c)、使ったレジスタはすべて開放してよい
+static void moveiv(struct irpromo *p, int sign)
+{
+  int r = cgloadvarreg(p->slot);
+  int v = genscale(loadvar(p->iv), p->size > 0 ? p->size : -p->size);
+
+  cgstorvarreg(sign * p->size > 0 ? cgadd(v, r) : cgsub(r, v), p->slot);
+  freeall_registers();
+}
+
+// ポインタを計算するループの変数への保存nを生成する。
+// 変数に定数を足すだけであれば、足す数に大きさを掛けた数をポインタへ足す。
+// そうでなければ保存の前に古い値の分を引き、保存の後に新しい値の分を足す
+static int storeiv(struct irinst *n)
+{
+  struct irpromo *p;
+  int r, val, step = increment(n, &val);
+
+  for (p = Promo; !step && p; p = p->next)
+    if (p->iv == n->var)
+      moveiv(p, -1);
+  r = storevar(n);
+  for (p = Promo; p; p = p->next)
+    if (p->iv == n->var)
+    {
+      if (step)
+        addiv(p, val * p->size);
+      else
+        moveiv(p, 1);
+    }
+  return (r);
+}
+
+// 値vを計算し直さずに使えればtrueを返す。同じ文の木で生成していない値は、
+// 生成しなくても後で記録し直す変数の読み込みだけ
+static int settled(struct irinst *v)
+{
+  return (v->op == IR_CONST || v->op == IR_ADDR || v->stmt != Stmt ||
+          v->done || v->op == IR_LOAD);
+}
+
+// 加減算nのうち、大きさを掛けた値の引数の位置を返す。なければ-1を返す
+static int scaledarg(struct irinst *n)
+{
+  if (n->op == IR_ADD && n->args[0]->op == IR_SCALE)
+    return (0);
+  if (n->args[1]->op == IR_SCALE)
+    return (1);
+  return (-1);
+}
+
+// 加減算nがループの変数から計算するポインタで、変数用のレジスタにその値が
+// あれば、レジスタから読み込む。なければNOREGを返す
+static int loadiv(struct irinst *n)
+{
+  struct irinst *s, *base, *v;
+  struct irpromo *p;
+  int i;
+
+  if ((i = scaledarg(n)) == -1)
+    return (NOREG);
+  s = n->args[i];
+  base = n->args[1 - i];
+  v = s->args[0];
+  if (!settled(base) || !settled(v))
+    return (NOREG);
+  for (p = Promo; p; p = p->next)
+    if (p->iv != -1 && s->val == (p->size > 0 ? p->size : -p->size) &&
+        (p->size > 0) == (n->op == IR_ADD) && base->leader == p->val->leader &&
+        Hold[p->iv] && Hold[p->iv]->leader == v->leader)
+      return (cgloadvarreg(p->slot));
+  return (NOREG);
+}
+
+// 加算nの大きさ(2、4、8)を掛けた引数を、掛け算をせずにアドレスの計算の形で
+// 足す。そうできなければNOREGを返す
+static int addscaled(struct irinst *n)
+{
+  struct irinst *s;
+  int i, l, r;
+
+  if (n->op != IR_ADD || (i = scaledarg(n)) == -1)
+    return (NOREG);
+  s = n->args[i];
+  if (s->stmt != Stmt || s->hslot != -1 || holder(s, 0) != -1 ||
+      (s->val != 2 && s->val != 4 && s->val != 8))
+    return (NOREG);
+  if (i == 0)
+  {
+    r = load(s->args[0]);
+    l = load(n->args[1]);
+  }
+  else
+  {
+    l = load(n->args[0]);
+    r = load(s->args[0]);
+  }
+  return (cgaddscaled(l, r, s->val));
+}
+
+// 文の木の命令nを生成して、値の入ったレジスタを返す
+static int gen(struct irinst *n)
+{
+  int l, r;
+
+  switch (n->op)
+  {
+  case IR_LOAD:
+    r = loadvar(n->var);
+    sethold(n->var, n);
+    return (r);
+  case IR_STORE:
+    return (hasiv(n->var) ? storeiv(n) : storevar(n));
+  case IR_STDEREF:
+    l = load(n->args[0]);
+    r = load(n->args[1]);
+    r = cgstorderef(l, r, n->val);
+    n->done = 1;
+    clobberholds(n);
+    return (r);
+  case IR_CALL:
+    r = cgcall(load(n->args[0]), n->id);
+    n->done = 1;
+    clearholds();
+    return (r);
+  case IR_PHI:
+    // 展開した関数の値は本体のA_LEAVEがINLINE_REGへ入れている
+    return (cgclaimreg(INLINE_REG));
+  case IR_WIDEN:
+    return (cgwiden(load(n->args[0]), n->val, n->type));
+  case IR_SCALE:
+    return (genscale(load(n->args[0]), n->val));
+  case IR_DEREF:
+    return (cgderef(load(n->args[0]), n->val));
+  case IR_EVAL:
+    load(n->args[0]);
+    return (NOREG);
+  case IR_LEAVE:
+    cgmovereg(load(n->args[0]), INLINE_REG, n->type);
+    return (NOREG);
+  case IR_PROMOTE:
+    cgvarload(n->val, n->id);
+    return (NOREG);
+  case IR_DEMOTE:
+    cgvarstore(n->val, n->id);
+    return (NOREG);
+  case IR_HOIST:
+    return (cgstorvarreg(load(n->args[0]), n->val));
+  case IR_RET:
+    cgreturn(load(n->args[0]), Fn->id);
+    return (NOREG);
+  }
+
+  if ((n->op == IR_ADD || n->op == IR_SUB) &&
+      ((r = loadiv(n)) != NOREG || (r = addscaled(n)) != NOREG))
+    return (r);
+  l = load(n->args[0]);
+  r = load(n->args[1]);
+  switch (n->op)
+  {
+  case IR_ADD:
+    return (cgadd(l, r));
+  case IR_SUB:
+    return (cgsub(l, r));
+  case IR_MUL:
+    return (cgmul(l, r));
+  case IR_DIV:
+    return (cgdiv(l, r));
+  case IR_EQ:
+  case IR_NE:
+  case IR_LT:
+  case IR_GT:
+  case IR_LE:
+  case IR_GE:
+    return (cgcompare_and_set(n->op - IR_EQ + A_EQ, l, r));
+  }
+  fatald("コードを生成できない中間表現の命令です", n->op);
+  return (NOREG);
+}
+
+// 比較の反対の比較
+static int Invert[] = {A_NE, A_EQ, A_GE, A_LE, A_GT, A_LT};
+
+// ブロックbの条件分岐tを生成する。cgcompare_and_jump()は条件に合わないときに飛ぶ
+static void genbr(struct irblock *b, struct irinst *t)
+{
+  struct irinst *c = t->args[0];
+  struct irblock *tb = b->succs[0], *fb = b->succs[1];
+  int l, r, op = c->op - IR_EQ + A_EQ;
+
+  l = load(c->args[0]);
+  r = load(c->args[1]);
+  if (tb == b->next)
+    cgcompare_and_jump(op, l, r, fb->label);
+  else if (fb == b->next)
+    cgcompare_and_jump(Invert[op - A_EQ], l, r, tb->label);
+  else
+  {
+    cgcompare_and_jump(op, l, r, fb->label);
+    cgjump(tb->label);
+  }
+}
+
+// 根を生成した後で、fromからtoまでの命令の後に変数が持つ値を記録し直す。
+// 生成せずに変数から読んだ命令の分も記録するため。
+// 書き換えうる命令より前の記録は、その命令が書き換えうる変数の分だけ消す
+static void replay(struct irinst *from, struct irinst *to)
+{
+  struct irinst *n;
+
+  for (n = from; n != to->next; n = n->next)
+  {
+    if (n->op == IR_LOAD)
+      sethold(n->var, n);
+    if (n->op == IR_STORE)
+      storehold(n);
+    if (n->op == IR_CALL)
+      clearholds();
+    if (n->op == IR_STDEREF)
+      clobberholds(n);
+  }
+}
+
+// ブロックbの入口で変数が持つ値を求める。
+// 生成済みの先行ブロックの出口の値がすべて同じ変数と、構築で入口の値を読んだ変数
+static void entryholds(struct irblock *b)
+{
+  struct irinst *v, *w;
+  int i, j;
+
+  clearholds();
+  for (i = 0; i < b->npreds; i++)
+    if (!b->preds[i]->lowered)
+      break;
+  if (b->npreds && i == b->npreds)
+    for (i = 0; i < Fn->nvars; i++)
+    {
+      v = b->preds[0]->exitval[i];
+      for (j = 1; v && j < b->npreds; j++)
+        if ((w = b->preds[j]->exitval[i]) == NULL || w->leader != v->leader)
+          v = NULL;
+      if (v)
+        sethold(i, v);
+    }
+  for (struct irdef *d = b->entry; d; d = d->next)
+    sethold(d->var, d->val);
+}
+
+// 関数idの本体を中間表現から生成する
+void ir_genbody(int id)
+{
+  struct irblock *b, *s;
+  struct irinst *n, *seg;
+
+  Fn = Gsym[id].ir;
+  Hold = malloc((Fn->nvars + 1) * sizeof(struct irinst *));
+  Reg = malloc((Fn->nvars + 1) * sizeof(int));
+  if (Hold == NULL || Reg == NULL)
+    fatal("メモリが確保できませんでした。ir_genbody()");
+  for (int i = 0; i < Fn->nvars; i++)
+    Reg[i] = -1;
+  Promo = NULL;
+
+  // ラベルは作った順にブロックごとに1つ使う。ir_labelcount()と合わせておくこと
+  for (b = Fn->all; b; b = b->allnext)
+    b->label = genlabel();
+
+  // 後ろへ落ちない分岐の行き先にだけラベルを置く
+  for (b = Fn->entry; b; b = b->next)
+    b->jumped = 0;
+  for (b = Fn->entry; b; b = b->next)
+    for (int i = 0; i < b->nsuccs; i++)
+      if ((s = b->succs[i]) != b->next)
+        s->jumped = 1;
+
+  for (b = Fn->entry; b; b = b->next)
+  {
+    if (b->jumped)
+      cglabel(b->label);
+    setpromo(b);
+    entryholds(b);
+    seg = b->head;
+    for (n = b->head; n; n = n->next)
+    {
+      if (!(n->flags & IRF_ROOT))
+        continue;
+      Stmt = n->stmt;
+      if (n->op == IR_BR)
+        genbr(b, n);
+      else if (n->op == IR_JMP)
+      {
+        if (b->succs[0] != b->next)
+          cgjump(b->succs[0]->label);
+      }
+      else
+        gen(n);
+      genfreeregs();
+
+      // 切り詰められうる保存の後に読み直す命令も、この根の文に含める
+      while (n->next && n->next->op == IR_LOAD && n->next->stmt == Stmt)
+        n = n->next;
+      replay(seg, n);
+      seg = n->next;
+    }
+    if (seg)
+      replay(seg, b->tail);
+
+    // 出口で変数が持つ値を後続のブロックのために残す
+    b->exitval = malloc((Fn->nvars + 1) * sizeof(struct irinst *));
+    if (b->exitval == NULL)
+      fatal("メモリが確保できませんでした。ir_genbody()");
+    memcpy(b->exitval, Hold, Fn->nvars * sizeof(struct irinst *));
+    b->lowered = 1;
+  }
+
+  for (b = Fn->entry; b; b = b->next)
+    free(b->exitval);
+  free(Hold);
+  free(Reg);
+}
@@ -0,0 +1,7 @@
+#include <stdio.h>
+
+// 生成したプログラムが使う実行時ライブラリ
+void printint(long x)
+{
+  printf("%ld\n", x);
+}
@@ -0,0 +1,813 @@
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+
+// ループの最適化
+//
+// 中間表現の関数から自然ループを見つける。ブロックhが先行ブロックpを
+// 支配していれば、pからhへの辺はループを戻る辺で、hはループの条件のブロックになる。
+// ループのブロックは、戻る辺の元から先行ブロックを逆にたどってhまでに着くブロック。
+// while文のループでは、ループの外からhへ来る辺は1本だけになる。
+//
+// 大域変数のレジスタへの昇格: 呼び出しのないループで、ポインタを通した保存が
+// 触れえない変数(alias.c)は、ループの中で書き換えるのはその変数への保存だけになる。
+// そのような変数のうちよく使うレジスタの幅のものを、ループの間はバックエンドの
+// 変数用のレジスタに置く。
+// ループの外から入る辺に置く前ブロックでメモリから一度だけ読み込み、
+// ループから出る辺に置くブロックで一度だけ書き戻す。return文のブロックは
+// ループへ戻らないのでループの外になり、そこへの辺もループから出る辺になる。
+// ループの中の読み書きは、コード生成でレジスタとの間の移動になる。
+// ポインタを通した読み込みが触れうる変数は、メモリを古いままにしないように
+// ループの中で保存しないときだけ昇格する。
+//
+// ループで変わらない値の移動: 昇格で余った変数用のレジスタには、ループの中で
+// 値の変わらない副作用のない木(大きさを掛けた値、書き換えない変数の読み込み、
+// 変数のアドレスからの計算など)を置く。木の命令は前ブロックへ移し、
+// ループの中ではレジスタから読み込む。前ブロックはループの最初の条件の前に
+// 一度だけ実行されるので、ループを一度も回らなくても木を計算する。
+// 条件のブロックの命令はそのときも実行するが、ほかのブロックからは
+// 0での除算とポインタを通した読み込みのように失敗しうる命令は移さない。
+//
+// ループの変数の強さの軽減: ループの中で定数を足すだけの変数iについて、
+// ループで変わらないポインタqとの和q + i(iに大きさを掛けた値を足す)も
+// 変数用のレジスタに置く。前ブロックで一度だけ計算し、iへの保存のたびに
+// 足した数に大きさを掛けた数をレジスタへ足すので、ループの中で毎回の
+// 掛け算と足し算がなくなる。大域変数iへの保存は外から見えるので残す。
+//
+// 外側のループから調べ、昇格したループの内側のループはそのまま昇格した変数を使う
+
+#define MAXWEIGHT 3 // 回数の重みを付ける入れ子の深さの上限
+#define MAXIVS 8    // ループごとに調べるループの変数から計算するポインタの数
+
+static struct irfunc *Fn;     // 最適化中の関数
+static int Mark;              // 最後に使ったループの印
+static struct irblock **Prev; // ブロックの番号から配置で直前のブロックへ
+static int Maxprev;           // Prevの大きさ
+static char *Ext;             // 値の番号から、ほかの文で使う値であればtrue
+static char *Inv;             // 値の番号から、ループで変わらない値の印(INV_*)
+static int Maxinv;            // ExtとInvの大きさ
+
+// ループで変わらない値の印
+enum
+{
+  INV_TOP = 1, // 変わらない値の木の根
+  INV_INNER,   // 変わらない値の木の中
+  INV_HOISTED  // 前ブロックへ移すと決めた木の根
+};
+
+// ループ
+struct loop
+{
+  struct irblock *header;  // 条件のブロック
+  struct irblock **blocks; // ループのブロック
+  int nblocks;
+  int mark;                // ループのブロックのloopに付けた印
+};
+
+// ループの変数から計算するポインタ base + var * size の候補
+struct ivcand
+{
+  struct irinst *base; // ループで変わらないポインタ
+  long size;           // ループの変数に掛ける大きさ。引くときは負
+  int var;             // ループの変数
+  int score;           // 重みと省ける命令の数の積の和
+};
+
+// ブロックbがループlのブロックであればtrueを返す
+static int inloop(struct loop *l, struct irblock *b)
+{
+  return (b->loop == l->mark);
+}
+
+// ブロックbをループlのブロックにする
+static void addblock(struct loop *l, struct irblock *b)
+{
+  b->loop = l->mark;
+  l->blocks[l->nblocks++] = b;
+}
+
+// ブロックhを条件のブロックとするループのブロックをlに集める。
+// hへ戻る辺がなければfalseを返す。
+// 作ったブロックは支配木に入っていないので戻る辺の元にはしない
+static int findloop(struct loop *l, struct irblock *h, struct irblock **stack)
+{
+  struct irblock *b, *p;
+  int sp = 0;
+
+  l->header = h;
+  l->nblocks = 0;
+  l->mark = ++Mark;
+  addblock(l, h);
+  for (int i = 0; i < h->npreds; i++)
+  {
+    p = h->preds[i];
+    if (p->rpo >= 0 && ir_dominates(h, p) && !inloop(l, p))
+    {
+      addblock(l, p);
+      stack[sp++] = p;
+    }
+  }
+  if (sp == 0)
+    return (0);
+
+  while (sp > 0)
+  {
+    b = stack[--sp];
+    for (int i = 0; i < b->npreds; i++)
+      if (!inloop(l, p = b->preds[i]))
+      {
+        addblock(l, p);
+        stack[sp++] = p;
+      }
+  }
+  return (1);
+}
+
+// ブロックbからsへの辺にブロックを入れて返す。
+// 入れたブロックはsへ分岐し、配置ではsの直前に置く。
+// sの先行ブロックの並びは変えないので、φの引数はそのままでよい
+static struct irblock *splitedge(struct irblock *b, struct irblock *s)
+{
+  struct irblock *t = ir_newblock(Fn), *prev;
+  struct irinst *j;
+
+  if (t->num >= Maxprev)
+  {
+    Maxprev *= 2;
+    if ((Prev = realloc(Prev, Maxprev * sizeof(struct irblock *))) == NULL)
+      fatal("メモリが確保できませんでした。splitedge()");
+  }
+  t->rpo = -1;
+  t->sealed = 1;
+  t->maxpreds = 2;
+  t->preds = arena_alloc(t->maxpreds * sizeof(struct irblock *));
+  t->preds[t->npreds++] = b;
+  t->succs[t->nsuccs++] = s;
+  for (int i = 0; i < b->nsuccs; i++)
+    if (b->succs[i] == s)
+      b->succs[i] = t;
+  for (int i = 0; i < s->npreds; i++)
+    if (s->preds[i] == b)
+      s->preds[i] = t;
+
+  j = ir_newinst(Fn, IR_JMP, P_NONE);
+  j->flags |= IRF_ROOT;
+  ir_append(t, j);
+
+  if ((prev = Prev[s->num]) == NULL)
+    Fn->entry = t;
+  else
+    prev->next = t;
+  Prev[t->num] = prev;
+  Prev[s->num] = t;
+  t->next = s;
+  return (t);
+}
+
+// ブロックbの終端命令の前に、変数用のレジスタと変数の間の移動opを置く
+static void addmove(struct irblock *b, int op, struct irpromo *p)
+{
+  struct irinst *n = ir_newinst(Fn, op, P_NONE);
+
+  n->id = Fn->varids[p->var];
+  n->var = p->var;
+  n->val = p->slot;
+  n->flags |= IRF_ROOT;
+  ir_insertterm(b, n);
+}
+
+// ループlの中のブロックbの命令の重み。
+// 内側のループの中では、入れ子の深さ1つにつき8倍にする
+static int weightof(struct loop *l, struct irblock *b)
+{
+  int depth = b->depth - l->header->depth;
+
+  return (1 << 3 * (depth < MAXWEIGHT ? depth : MAXWEIGHT));
+}
+
+// ループの中で値nを使うときに、その値を持っていそうな変数を返す。なければ-1
+static int varof(struct irinst *n, int *holds)
+{
+  return (n->op == IR_CONST || n->op == IR_ADDR ? -1 : holds[n->num]);
+}
+
+// ループの中のポインタを通した読み書きaccesses[0..n-1]が変数varに触れるために
+// 昇格できなければtrueを返す。読み込みはループの中で保存する変数だけを妨げる
+static int aliased(struct irinst **accesses, int n, int var, int written)
+{
+  for (int i = 0; i < n; i++)
+    if ((accesses[i]->op == IR_STDEREF || written) &&
+        ir_mayalias(accesses[i], Fn->varids[var]))
+      return (1);
+  return (0);
+}
+
+// ブロックhの入口で変数のメモリに値vが入っていればtrueを返す
+static int atentry(struct irblock *h, struct irinst *v)
+{
+  for (struct irdef *d = h->entry; d; d = d->next)
+    if (ir_resolve(d->val) == v)
+      return (1);
+  return (0);
+}
+
+// ループlの中で、命令nがループで変わらない値を計算すればtrueを返す。
+// 引数は定数とアドレスのほか、同じ文の木の変わらない値でほかの文では
+// 使わないものか、ループの外の値で条件のブロックの入口で変数が持つもの。
+// 変数の読み込みはループの中で書き換えない変数から、ポインタを通した読み込みは
+// ループの中のどの保存も触れないものだけ。writtenとaccessesはpromoteloop()のもの
+static int invariant(struct loop *l, struct irinst *n, int *written,
+                     struct irinst **accesses, int naccesses)
+{
+  struct irinst *a;
+
+  switch (n->op)
+  {
+  case IR_DIV:
+  case IR_DEREF:
+    if (n->block != l->header)
+      return (0);
+    break;
+  case IR_ADDR:
+  case IR_LOAD:
+  case IR_ADD:
+  case IR_SUB:
+  case IR_MUL:
+  case IR_WIDEN:
+  case IR_SCALE:
+    break;
+  default:
+    return (0);
+  }
+  if (n->op == IR_LOAD &&
+      (written[n->var] || aliased(accesses, naccesses, n->var, 0)))
+    return (0);
+  for (int i = 0; n->op == IR_DEREF && i < naccesses; i++)
+    if (accesses[i]->op == IR_STDEREF && ir_accessalias(accesses[i], n))
+      return (0);
+  for (int i = 0; i < n->nargs; i++)
+  {
+    a = n->args[i];
+    if (a->op == IR_CONST || a->op == IR_ADDR)
+      continue;
+    if (a->stmt != n->stmt)
+    {
+      if (inloop(l, a->block) || !atentry(l->header, a))
+        return (0);
+    }
+    else if (a->block != n->block || a->num >= Maxinv || !Inv[a->num] ||
+             Ext[a->num])
+      return (0);
+  }
+  return (1);
+}
+
+// ループlの中の変わらない値の命令に印を付ける
+static void markinv(struct loop *l, int *written, struct irinst **accesses,
+                    int naccesses)
+{
+  struct irinst *n, *a;
+
+  for (int i = 0; i < l->nblocks; i++)
+    for (n = l->blocks[i]->head; n; n = n->next)
+      if (n->num < Maxinv && invariant(l, n, written, accesses, naccesses))
+      {
+        Inv[n->num] = INV_TOP;
+        for (int j = 0; j < n->nargs; j++)
+          if ((a = n->args[j])->stmt == n->stmt && a->op != IR_CONST)
+            Inv[a->num] = INV_INNER;
+      }
+}
+
+// ループlの中の変わらない値の印を消す
+static void clearinv(struct loop *l)
+{
+  struct irinst *n;
+
+  for (int i = 0; i < l->nblocks; i++)
+    for (n = l->blocks[i]->head; n; n = n->next)
+      if (n->num < Maxinv)
+        Inv[n->num] = 0;
+}
+
+// 変わらない値の木nを前ブロックへ移すと、ループの中で毎回省ける命令の数。
+// 木の命令と、ほかの文の値を変数から読み込む命令を数える
+static int treecost(struct irinst *n)
+{
+  struct irinst *a;
+  int cost = 1;
+
+  for (int i = 0; i < n->nargs; i++)
+  {
+    a = n->args[i];
+    if (a->op == IR_CONST || a->op == IR_ADDR)
+      continue;
+    cost += a->stmt == n->stmt ? treecost(a) : 1;
+  }
+  return (cost);
+}
+
+// ループlで、前ブロックへ移す変わらない値の木のうち、重みと省ける命令の数の
+// 積の最も大きいものを、その積を*scoreに入れて返す。なければNULLを返す。
+// 命令が1つだけの木はメモリを読むものだけで、昇格した変数listの読み込みは除く
+static struct irinst *besttree(struct loop *l, struct irpromo *list,
+                               int *score)
+{
+  struct irblock *b;
+  struct irinst *n, *top = NULL;
+  struct irpromo *p;
+  int s, cost;
+
+  *score = 0;
+  for (int i = 0; i < l->nblocks; i++)
+  {
+    b = l->blocks[i];
+    for (n = b->head; n; n = n->next)
+    {
+      if (n->num >= Maxinv || Inv[n->num] != INV_TOP)
+        continue;
+      if ((cost = treecost(n)) == 1)
+      {
+        if (n->op != IR_LOAD && n->op != IR_DEREF)
+          continue;
+        for (p = list; p; p = p->next)
+          if (n->op == IR_LOAD && p->var == n->var)
+            break;
+        if (p)
+          continue;
+      }
+      if ((s = weightof(l, b) * cost) > *score)
+      {
+        top = n;
+        *score = s;
+      }
+    }
+  }
+  return (top);
+}
+
+// 変わらない値の木nの命令を、計算する順のまま前ブロックpreの文stmtへ移す
+static void movetree(struct irblock *pre, struct irinst *n, int stmt)
+{
+  struct irinst *a;
+
+  for (int i = 0; i < n->nargs; i++)
+    if ((a = n->args[i])->op != IR_CONST && a->stmt == n->stmt)
+      movetree(pre, a, stmt);
+  ir_unlink(n);
+  n->stmt = stmt;
+  ir_insertterm(pre, n);
+}
+
+// 変わらない値pの木を前ブロックpreへ移し、変数用のレジスタへ入れる
+static void hoist(struct irblock *pre, struct irpromo *p)
+{
+  struct irinst *h = ir_newinst(Fn, IR_HOIST, P_NONE);
+  int stmt = ++Fn->nstmts;
+
+  movetree(pre, p->val, stmt);
+  h->args[h->nargs++] = p->val;
+  h->val = p->slot;
+  h->stmt = stmt;
+  h->flags |= IRF_ROOT;
+  ir_insertterm(pre, h);
+}
+
+// 変数への保存nが、根の文で変数に定数を足した値を保存するものであればtrueを返す
+static int stepstore(struct irinst *n)
+{
+  struct irinst *a = n->args[0];
+
+  if (!(n->flags & IRF_ROOT) || !(n->flags & IRF_EXACT) || a->stmt != n->stmt)
+    return (0);
+  if (a->op == IR_ADD)
+    return (a->args[0]->op == IR_CONST || a->args[1]->op == IR_CONST);
+  return (a->op == IR_SUB && a->args[1]->op == IR_CONST);
+}
+
+// ループlの中の加減算nが、ループで変わらないポインタと、変数の値に大きさを
+// 掛けた値の和か差であれば、候補をcに入れてtrueを返す。
+// ポインタは変数のアドレスか、ループの外の値で条件のブロックの入口で変数が持つもの
+static int ivuse(struct loop *l, struct irinst *n, int *holds, struct ivcand *c)
+{
+  struct irinst *s, *base;
+
+  if (n->op == IR_ADD && n->args[0]->op == IR_SCALE)
+  {
+    s = n->args[0];
+    base = n->args[1];
+  }
+  else if ((n->op == IR_ADD || n->op == IR_SUB) && n->args[1]->op == IR_SCALE)
+  {
+    s = n->args[1];
+    base = n->args[0];
+  }
+  else
+    return (0);
+  if (base->op != IR_ADDR &&
+      (!ptrtype(base->type) || base->op == IR_CONST || base->stmt == n->stmt ||
+       inloop(l, base->block) || !atentry(l->header, base)))
+    return (0);
+  if ((c->var = varof(s->args[0], holds)) == -1)
+    return (0);
+  c->base = base;
+  c->size = n->op == IR_ADD ? s->val : -s->val;
+  return (1);
+}
+
+// ループlの候補cands[0..ncands-1]のうち、ループの中で定数を足すだけで、
+// ポインタを通した保存が触れない変数から計算するものの点数を決める。
+// 点数から、変数への保存のたびにレジスタへ足す命令の分を引く
+static void ivscore(struct loop *l, struct ivcand *cands, int ncands,
+                    int *written, struct irinst **accesses, int naccesses)
+{
+  struct irblock *b;
+  struct irinst *n;
+  struct ivcand *c;
+  int id;
+
+  for (c = cands; c < cands + ncands; c++)
+  {
+    id = Fn->varids[c->var];
+    if (written[c->var] != 1 ||
+        genprimsize(Gsym[id].type) < genprimsize(P_LONG) ||
+        aliased(accesses, naccesses, c->var, 0))
+    {
+      c->score = 0;
+      continue;
+    }
+    for (int i = 0; i < l->nblocks; i++)
+    {
+      b = l->blocks[i];
+      for (n = b->head; n; n = n->next)
+        if (n->op == IR_STORE && n->var == c->var)
+          c->score -= weightof(l, b);
+    }
+  }
+}
+
+// ループの変数から計算するポインタpの最初の値を前ブロックpreで計算し、
+// 変数用のレジスタへ入れる
+static void ivinit(struct irblock *pre, struct irpromo *p)
+{
+  int id = Fn->varids[p->iv], stmt = ++Fn->nstmts;
+  struct irinst *v, *s, *a, *h;
+
+  v = ir_newinst(Fn, IR_LOAD, Gsym[id].type);
+  v->id = id;
+  v->var = p->iv;
+  s = ir_newinst(Fn, IR_SCALE, p->val->type);
+  s->val = p->size > 0 ? p->size : -p->size;
+  s->args[s->nargs++] = v;
+  a = ir_newinst(Fn, p->size > 0 ? IR_ADD : IR_SUB, p->val->type);
+  a->args[a->nargs++] = p->val;
+  a->args[a->nargs++] = s;
+  h = ir_newinst(Fn, IR_HOIST, P_NONE);
+  h->args[h->nargs++] = a;
+  h->val = p->slot;
+  h->flags |= IRF_ROOT;
+  v->stmt = s->stmt = a->stmt = h->stmt = stmt;
+  ir_insertterm(pre, v);
+  ir_insertterm(pre, s);
+  ir_insertterm(pre, a);
+  ir_insertterm(pre, h);
+}
+
+// ループlの変数をレジスタへ昇格する。
+// holdsは値の番号からその値を持つ変数へ、scoreとwrittenは変数ごとの、
+// accessesは命令ごとの作業用の領域
+static void promoteloop(struct loop *l, int *holds, int *score, int *written,
+                        struct irinst **accesses)
+{
+  struct irblock *b, *pre = NULL, *s;
+  struct irinst *n, *top;
+  struct irpromo *list = NULL, *p;
+  struct ivcand cands[MAXIVS], c;
+  int *vars, nvars = 0, naccesses = 0, ncands = 0, call = 0, outside = 0;
+  int best, iv, v, id, weight, treescore, k;
+
+  for (int i = 0; i < l->header->npreds; i++)
+    if (!inloop(l, b = l->header->preds[i]))
+    {
+      pre = b;
+      outside++;
+    }
+  if (outside != 1 || l->header == Fn->entry)
+    return;
+
+  // 変数がループの中で読み書きされる回数を数える。
+  // ほかの文の値は、それを持っている変数から読み込むので1回に数える
+  if ((vars = malloc((Fn->nvars + 1) * sizeof(int))) == NULL)
+    fatal("メモリが確保できませんでした。promoteloop()");
+  for (int i = 0; i < l->nblocks; i++)
+  {
+    b = l->blocks[i];
+    weight = weightof(l, b);
+    for (n = b->head; n; n = n->next)
+    {
+      if (n->op == IR_CALL)
+        call = 1;
+      if (n->op == IR_DEREF || n->op == IR_STDEREF)
+        accesses[naccesses++] = n;
+      if (n->op == IR_STORE)
+        written[n->var] = written[n->var] != 2 && stepstore(n) ? 1 : 2;
+      if (ivuse(l, n, holds, &c))
+      {
+        for (k = 0; k < ncands; k++)
+          if (cands[k].base->leader == c.base->leader &&
+              cands[k].size == c.size && cands[k].var == c.var)
+            break;
+        if (k == ncands && ncands < MAXIVS)
+        {
+          c.score = 0;
+          cands[ncands++] = c;
+        }
+        if (k < ncands)
+          cands[k].score += weight * treecost(n);
+      }
+      for (int j = -1; j < n->nargs; j++)
+      {
+        if (j == -1)
+          v = n->op == IR_LOAD || n->op == IR_STORE ? n->var : -1;
+        else
+          v = n->args[j]->stmt != n->stmt ? varof(n->args[j], holds) : -1;
+        if (v == -1)
+          continue;
+        if (score[v] == 0)
+          vars[nvars++] = v;
+        score[v] += weight;
+      }
+    }
+  }
+
+  // レジスタの幅の変数と変わらない値の木とループの変数から計算するポインタから、
+  // 回数と省ける命令の数の多いものを変数用のレジスタの数だけ選ぶ
+  if (!call)
+  {
+    markinv(l, written, accesses, naccesses);
+    ivscore(l, cands, ncands, written, accesses, naccesses);
+  }
+  for (int slot = 0; !call && slot < cgvarregs(); slot++)
+  {
+    best = -1;
+    for (int i = 0; i < nvars; i++)
+    {
+      v = vars[i];
+      id = Fn->varids[v];
+      if (score[v] == 0 || genprimsize(Gsym[id].type) < genprimsize(P_LONG))
+        continue;
+      if (aliased(accesses, naccesses, v, written[v]))
+      {
+        score[v] = 0;
+        continue;
+      }
+      if (best == -1 || score[v] > score[best])
+        best = v;
+    }
+    top = besttree(l, list, &treescore);
+    iv = -1;
+    for (k = 0; k < ncands; k++)
+      if (cands[k].score > 0 && (iv == -1 || cands[k].score > cands[iv].score))
+        iv = k;
+    if (best == -1 && top == NULL && iv == -1)
+      break;
+    p = arena_alloc(sizeof(struct irpromo));
+    p->iv = -1;
+    p->size = 0;
+    if (best != -1 && score[best] >= treescore &&
+        (iv == -1 || score[best] >= cands[iv].score))
+    {
+      p->var = best;
+      p->val = NULL;
+      p->written = written[best];
+      score[best] = 0;
+    }
+    else if (top && (iv == -1 || treescore >= cands[iv].score))
+    {
+      p->var = -1;
+      p->val = top;
+      p->written = 0;
+      Inv[top->num] = INV_HOISTED;
+    }
+    else
+    {
+      p->var = -1;
+      p->val = cands[iv].base;
+      p->written = 0;
+      p->iv = cands[iv].var;
+      p->size = cands[iv].size;
+      cands[iv].score = 0;
+    }
+    p->slot = slot;
+    p->next = list;
+    list = p;
+  }
+  if (!call)
+    clearinv(l);
+  for (int i = 0; i < nvars; i++)
+    score[vars[i]] = written[vars[i]] = 0;
+  free(vars);
+  if (list == NULL)
+    return;
+
+  // 前ブロックで読み込むか変わらない値を計算し、
+  // ループから出る辺で書き換えた変数を書き戻す
+  // 前ブロックはメモリに書かないので、条件のブロックの入口で変数が持つ値は
+  // 前ブロックの入口でも同じ。変わらない値の木はそこから読み込む
+  pre = splitedge(pre, l->header);
+  for (struct irdef *d = l->header->entry; d; d = d->next)
+    ir_setentry(pre, d->var, d->val);
+  for (p = list; p; p = p->next)
+    if (p->var != -1)
+      addmove(pre, IR_PROMOTE, p);
+    else if (p->iv != -1)
+      ivinit(pre, p);
+    else
+      hoist(pre, p);
+  for (int i = 0; i < l->nblocks; i++)
+  {
+    b = l->blocks[i];
+    b->promo = list;
+    for (int j = 0; j < b->nsuccs; j++)
+    {
+      if (inloop(l, s = b->succs[j]))
+        continue;
+      for (p = list; p; p = p->next)
+        if (p->written)
+          break;
+      if (p == NULL)
+        continue;
+      s = splitedge(b, s);
+      for (p = list; p; p = p->next)
+        if (p->written)
+          addmove(s, IR_DEMOTE, p);
+    }
+  }
+}
+
+// ブロックbを含むループのうち、今までに見つけた最も外側のものの条件のブロックを返す。
+// ループに入っていないブロックはb自身。innerはブロックの番号から、それを含む
+// 最も内側のループの条件のブロックへ、upは条件のブロックの番号から、
+// それを含むループの条件のブロックへ。upは途中を縮めながらたどる
+static struct irblock *outermost(struct irblock *b, struct irblock **inner,
+                                 struct irblock **up)
+{
+  struct irblock *h, *r, *next;
+
+  if ((h = inner[b->num]) == NULL)
+    return (b);
+  for (r = h; up[r->num]; r = up[r->num])
+    ;
+  for (; h != r; h = next)
+  {
+    next = up[h->num];
+    up[h->num] = r;
+  }
+  return (r);
+}
+
+// ブロックごとに、ブロックを含むループの数をdepthに入れる。
+// orderは逆後順に並べたcount個のブロック。
+// 内側のループの条件のブロックから順に、戻る辺の元から先行ブロックを逆にたどる。
+// すでに内側のループに入れたブロックに着けば、そのループ全体を1つのブロックとみなして
+// その条件のブロックの先行ブロックへ進むので、入れ子が深くてもブロックごとに
+// たどるのは一度ずつになる
+static void loopdepth(struct irblock **order, int count, struct irblock **stack)
+{
+  struct irblock **inner, **outer, **up, *h, *b, *p;
+  int sp, mark;
+
+  // outerは条件のブロックの番号から、すぐ外側のループの条件のブロックへ
+  inner = calloc(Fn->nblocks + 1, sizeof(struct irblock *));
+  outer = calloc(Fn->nblocks + 1, sizeof(struct irblock *));
+  up = calloc(Fn->nblocks + 1, sizeof(struct irblock *));
+  if (inner == NULL || outer == NULL || up == NULL)
+    fatal("メモリが確保できませんでした。loopdepth()");
+
+  for (int i = count - 1; i >= 0; i--)
+  {
+    h = order[i];
+    mark = ++Mark;
+    h->loop = mark;
+    sp = 0;
+    for (int j = 0; j < h->npreds; j++)
+    {
+      p = h->preds[j];
+      if (p->rpo >= 0 && ir_dominates(h, p) &&
+          (p = outermost(p, inner, up))->loop != mark)
+      {
+        p->loop = mark;
+        stack[sp++] = p;
+      }
+    }
+    if (sp == 0)
+      continue;
+
+    inner[h->num] = h;
+    while (sp > 0)
+    {
+      b = stack[--sp];
+      if (inner[b->num] == NULL)
+        inner[b->num] = h;
+      else
+        outer[b->num] = up[b->num] = h;
+      for (int j = 0; j < b->npreds; j++)
+        if ((p = outermost(b->preds[j], inner, up))->loop != mark)
+        {
+          p->loop = mark;
+          stack[sp++] = p;
+        }
+    }
+  }
+
+  // 逆後順では外側のループの条件のブロックが、内側やループのブロックより先に来る
+  for (int i = 0; i < count; i++)
+  {
+    b = order[i];
+    if ((h = inner[b->num]) == NULL)
+      b->depth = 0;
+    else if (h != b)
+      b->depth = h->depth;
+    else
+      b->depth = outer[b->num] ? outer[b->num]->depth + 1 : 1;
+  }
+  free(inner);
+  free(outer);
+  free(up);
+}
+
+// 関数fnのループで、大域変数をレジスタへ昇格し、変わらない値を前ブロックへ移す。
+// orderは支配木を作ったときに逆後順に並べたcount個のブロック
+void ir_promote(struct irfunc *fn, struct irblock **order, int count)
+{
+  struct irblock **stack, *b, *prev;
+  struct irinst *n, **accesses;
+  struct loop l;
+  int *holds, *score, *written;
+
+  Fn = fn;
+  stack = malloc(count * sizeof(struct irblock *));
+  l.blocks = malloc(count * sizeof(struct irblock *));
+  holds = malloc((fn->ninsts + 1) * sizeof(int));
+  score = calloc(fn->nvars + 1, sizeof(int));
+  written = calloc(fn->nvars + 1, sizeof(int));
+  accesses = malloc((fn->ninsts + 1) * sizeof(struct irinst *));
+  Maxprev = 2 * fn->nblocks;
+  Prev = malloc(Maxprev * sizeof(struct irblock *));
+  Maxinv = fn->ninsts + 1;
+  Ext = calloc(Maxinv, sizeof(char));
+  Inv = calloc(Maxinv, sizeof(char));
+  if (stack == NULL || l.blocks == NULL || holds == NULL || score == NULL ||
+      written == NULL || accesses == NULL || Prev == NULL || Ext == NULL ||
+      Inv == NULL)
+    fatal("メモリが確保できませんでした。ir_promote()");
+
+  // 値を持っている変数は、読み込みとφではその変数、
+  // そのまま保存した値では保存した変数
+  for (int i = 0; i <= fn->ninsts; i++)
+    holds[i] = -1;
+  for (prev = NULL, b = fn->entry; b; prev = b, b = b->next)
+  {
+    Prev[b->num] = prev;
+    b->loop = 0;
+    for (n = b->phis; n; n = n->next)
+    {
+      holds[n->num] = n->var;
+      for (int i = 0; i < n->nargs; i++)
+        Ext[n->args[i]->num] = 1;
+    }
+    for (n = b->head; n; n = n->next)
+    {
+      for (int i = 0; i < n->nargs; i++)
+        if (n->args[i]->stmt != n->stmt)
+          Ext[n->args[i]->num] = 1;
+      if (n->op == IR_LOAD)
+        holds[n->num] = n->var;
+      if (n->op == IR_STORE && (n->flags & IRF_EXACT))
+        holds[ir_storedval(n)->num] = n->var;
+    }
+  }
+
+  // ブロックごとに、ブロックを含むループの数を数える
+  for (b = fn->entry; b; b = b->next)
+    b->depth = 0;
+  loopdepth(order, count, stack);
+
+  // 逆後順では外側のループの条件のブロックが内側より先に来る
+  for (int i = 0; i < count; i++)
+  {
+    b = order[i];
+    if (b->promo == NULL && findloop(&l, b, stack))
+      promoteloop(&l, holds, score, written, accesses);
+  }
+
+  free(stack);
+  free(l.blocks);
+  free(holds);
+  free(score);
+  free(written);
+  free(accesses);
+  free(Prev);
+  free(Ext);
+  free(Inv);
+}
@@ -4,36 +4,325 @@
 #undef extern_
 #include "decl.h"
 #include <errno.h>
+#include <unistd.h>
 
-// グローバル変数の初期化
+// グローバル変数の初期化。
+// コンパイルサーバでは同じプロセスで何度も呼ばれるので、
+// 前回のコンパイルの状態をここですべて消しておく
 static void init()
 {
     Line = 1;
     Putback = '\n';
-    Globs = 0;
-    O_dumpAST = 0;
+    clearglobs();
+    arena_reset();
+    scan_reset();
 }
 
 // 引数がおかしいときに使い方を表示
 static void usage(char *prog)
 {
-    fprintf(stderr, "Usage: %s [-T] infile\n", prog);
+    fprintf(stderr, "Usage: %s [-TtPc] [-o outfile] [-j jobs] [-p threads] infile [infile ...]\n"
+                    "       %s [--cache=dir] [--cache-size=bytes] [--cache-stats] ...\n"
+                    "       %s --incremental ...\n"
+                    "       %s -O1 [-fdump-ir] ...\n"
+                    "       %s -ftime-report[=json] ...\n"
+                    "       %s --trace=file ...\n"
+                    "       %s --run [-T] infile\n"
+                    "       %s --server=socket\n"
+                    "       %s --client=socket [--bench=n] [-T] infile [infile ...]\n",
+            prog, prog, prog, prog, prog, prog, prog, prog, prog);
     exit(1);
 }
 
+// コンパイルごとのオプションを既定値に戻す
+void reset_options(void)
+{
+    O_dumpAST = 0;
+    O_incremental = 0;
+    O_optimize = 0;
+    O_dumpIR = 0;
+}
+
+// コンパイルごとのオプションを1つ解釈する。
+// コマンドラインとコンパイルサーバへのリクエストで共通。
+// 解釈できなければ0を返す
+int compile_option(char *arg)
+{
+    if (!strcmp(arg, "-T"))
+        O_dumpAST = 1;
+    else if (!strcmp(arg, "--incremental"))
+        O_incremental = 1;
+    else if (!strcmp(arg, "-O1"))
+        O_optimize = 1;
+    else if (!strcmp(arg, "-O0"))
+        O_optimize = 0;
+    else if (!strcmp(arg, "-fdump-ir"))
+        O_dumpIR = 1;
+    else
+        return (0);
+    return (1);
+}
+
+// 現在のコンパイルごとのオプションをcompile_option()が
+// 解釈できる形の文字列にしてbufへ書き出す
+void compile_flags(char *buf, int size)
+{
+    snprintf(buf, size, "%s%s%s%s%s%s%s", O_dumpAST ? "-T" : "",
+             O_dumpAST && O_incremental ? " " : "",
+             O_incremental ? "--incremental" : "",
+             (O_dumpAST || O_incremental) && O_optimize ? " " : "",
+             O_optimize ? "-O1" : "",
+             (O_dumpAST || O_incremental || O_optimize) && O_dumpIR ? " " : "",
+             O_dumpIR ? "-fdump-ir" : "");
+}
+
+// "-ofile"や"-o file"のように、オプション文字の後ろか次の引数にある
+// 値の文字列を取得する。*iは値を取った引数の位置へ進める
+static char *strarg(int argc, char *argv[], int *i, int j)
+{
+    if (argv[*i][j + 1])
+        return (&argv[*i][j + 1]);
+    if (*i + 1 < argc)
+        return (argv[++*i]);
+    usage(argv[0]);
+    return (NULL);
+}
+
+// "-j4"や"-j 4"のように、オプション文字の後ろか次の引数にある
+// 正の整数の値を取得する。*iは値を取った引数の位置へ進める
+static int intarg(int argc, char *argv[], int *i, int j)
+{
+    int val;
+
+    if ((val = atoi(strarg(argc, argv, i, j))) < 1)
+        usage(argv[0]);
+    return (val);
+}
+
+// 開いている入力からコンパイルして出力へアセンブリを書き出す
+void compile(FILE *in, FILE *out)
+{
+    FILE *timed;
+
+    init();
+    Infile = in;
+    Outfile = out;
+
+    // とりあえずvoid printint()を確実に定義する
+    addglob("printint", P_CHAR, S_FUNCTION, 0);
+
+    // 関数のコードがバックエンドの共有状態に依存するのであれば
+    // 並列化も関数単位の出力の再利用もしない
+    if ((O_threads > 1 || O_pipeline) && !cgfunclocal())
+    {
+        fprintf(stderr, "このバックエンドでは関数単位の並列コード生成はできません\n");
+        O_threads = 1;
+        O_pipeline = 0;
+    }
+    if (O_incremental && !cgfunclocal())
+    {
+        fprintf(stderr, "このバックエンドではインクリメンタルコンパイルはできません\n");
+        O_incremental = 0;
+    }
+
+    // インクリメンタルモードでは関数ごとの出力を記録するため逐次生成する
+    if (O_incremental)
+    {
+        O_threads = 1;
+        O_pipeline = 0;
+    }
+
+    // 計測するときは出力への書き込みを数えるストリームを挟み、
+    // トレースするときはさらに書き込みを記録するストリームを挟む
+    if (O_timereport)
+    {
+        stats_begin();
+        Outfile = stats_wrap(out);
+        stats_enter(PH_PARSE);
+    }
+    timed = Outfile;
+    if (O_trace)
+        Outfile = trace_wrap(timed);
+
+    scan(&Token); // 入力ファイルの最初のトークンを取得
+    if (!O_run)
+        genpreamble(); // プレアンブルを出力
+    if (O_threads > 1 || O_pipeline)
+        par_begin(O_threads);
+    global_declarations(); // グローバル宣言のパース
+    if (O_threads > 1 || O_pipeline)
+        par_end();
+    if (!O_run)
+        genpostamble(); // ポストアンブルを出力
+
+    if (O_trace)
+        fclose(Outfile);
+    if (O_timereport)
+    {
+        stats_leave();
+        fclose(timed);
+    }
+    Outfile = out;
+}
+
+// 1つの入力ファイルをコンパイルしてoutfileへアセンブリを書き出す。
+// outfileが"-"であれば標準出力へ、-cであればアセンブラへ流し込む。
+// キャッシュがあれば入力のバイト列で引き、ヒットすれば字句解析もしない。
+// -Tや-fdump-irのダンプはコンパイルしないと出ないので、そのときはキャッシュを使わない
+void compile_file(char *infile, char *outfile)
+{
+    FILE *in, *out;
+    char *src = NULL, key[TEXTLEN], db[TEXTLEN], *dbfile = NULL;
+    int tostdout = !strcmp(outfile, "-");
+    int usecache = O_cachedir && !O_dumpAST && !O_dumpIR;
+    double start = 0;
+    size_t len;
+    pid_t pid;
+
+    if (O_trace)
+        start = trace_now();
+
+    if (usecache)
+    {
+        if ((src = slurp(infile, &len)) == NULL)
+        {
+            fprintf(stderr, "%s を開けません:%s\n", infile, strerror(errno));
+            exit(1);
+        }
+        if (cache_lookup(src, len, outfile, key))
+        {
+            free(src);
+            return;
+        }
+        in = openbuf(src, len);
+    }
+    else if ((in = fopen(infile, "r")) == NULL)
+    {
+        fprintf(stderr, "%s を開けません:%s\n", infile, strerror(errno));
+        exit(1);
+    }
+
+    // 出力ファイルの作成。パイプへ書くときは関数ごとにフラッシュして
+    // 読み手がコンパイルの終わりを待たずに処理できるようにする
+    if ((out = openout(outfile, &pid)) == NULL)
+    {
+        fprintf(stderr, "%sを作成できませんでした%s\n", outfile, strerror(errno));
+        exit(1);
+    }
+    Streamout = tostdout || O_assemble;
+
+    // インクリメンタルモードでは出力ファイルの横のデータベースを使う
+    if (O_incremental)
+    {
+        if (!tostdout)
+        {
+            snprintf(db, sizeof(db), "%s.fdb", outfile);
+            dbfile = db;
+        }
+        inc_load(dbfile);
+    }
+    compile(in, out);
+    fclose(in);
+    if (O_timereport)
+        stats_report(infile, O_timereport == 2);
+    if (closeout(out, pid) == -1) // 出力ファイルを閉じて終了
+    {
+        fprintf(stderr, "%sを作成できませんでした\n", outfile);
+        if (!tostdout)
+            unlink(outfile);
+        exit(1);
+    }
+    if (O_incremental)
+        inc_save(dbfile);
+
+    if (usecache)
+    {
+        if (!tostdout)
+            cache_store(outfile, key);
+        free(src);
+    }
+
+    // 入力ファイル全体のスパンを記録し、このファイルのイベントを書き出す
+    if (O_trace)
+    {
+        trace_span("file", infile, start, outfile);
+        trace_flush(infile);
+    }
+}
+
 // メイン。引数を調べて、なければ使い方を表示
 // 入力ファイルを開いてscanfileを呼びtokenを見ていく。
 int main(int argc, char *argv[])
 {
-    int i;
+    int i, jobs = 1, bench = 0, cachestats = 0, run = 0, status;
+    char *serverpath = NULL, *clientpath = NULL, *tracepath = NULL;
 
-    init();
+    Errfile = stderr;
+    Fatalenv = NULL;
+    reset_options();
+    O_timings = 0;
+    O_threads = 1;
+    O_pipeline = 0;
+    O_cachedir = NULL;
+    O_cachesize = 64 * 1024 * 1024;
+    O_outfile = NULL;
+    O_assemble = 0;
+    O_timereport = 0;
+    O_trace = 0;
+    O_run = 0;
 
     // コマンドラインオプション
     for (i = 1; i < argc; i++)
     {
         if (*argv[i] != '-')
             break;
+
+        // 計測結果の出力
+        if (!strcmp(argv[i], "-ftime-report"))
+        {
+            O_timereport = 1;
+            continue;
+        }
+        if (!strcmp(argv[i], "-ftime-report=json"))
+        {
+            O_timereport = 2;
+            continue;
+        }
+
+        // コンパイルごとのオプション
+        if (compile_option(argv[i]))
+            continue;
+
+        // 長いオプション
+        if (argv[i][1] == '-')
+        {
+            if (!strncmp(argv[i], "--server=", 9))
+                serverpath = argv[i] + 9;
+            else if (!strncmp(argv[i], "--client=", 9))
+                clientpath = argv[i] + 9;
+            else if (!strncmp(argv[i], "--bench=", 8))
+            {
+                if ((bench = atoi(argv[i] + 8)) < 1)
+                    usage(argv[0]);
+            }
+            else if (!strncmp(argv[i], "--cache=", 8))
+                O_cachedir = argv[i] + 8;
+            else if (!strncmp(argv[i], "--cache-size=", 13))
+            {
+                if ((O_cachesize = atol(argv[i] + 13)) < 1)
+                    usage(argv[0]);
+            }
+            else if (!strcmp(argv[i], "--cache-stats"))
+                cachestats = 1;
+            else if (!strncmp(argv[i], "--trace=", 8))
+                tracepath = argv[i] + 8;
+            else if (!strcmp(argv[i], "--run"))
+                run = 1;
+            else
+                usage(argv[0]);
+            continue;
+        }
+
         for (int j = 1; argv[i][j]; j++)
         {
             switch (argv[i][j])
@@ -41,35 +330,95 @@ int main(int argc, char *argv[])
             case 'T':
                 O_dumpAST = 1;
                 break;
+            case 't':
+                O_timings = 1;
+                break;
+            case 'P':
+                O_pipeline = 1;
+                break;
+            case 'j':
+                jobs = intarg(argc, argv, &i, j);
+                goto nextarg;
+            case 'p':
+                O_threads = intarg(argc, argv, &i, j);
+                goto nextarg;
+            case 'o':
+                O_outfile = strarg(argc, argv, &i, j);
+                goto nextarg;
+            case 'c':
+                O_assemble = 1;
+                break;
             default:
                 usage(argv[0]);
             }
         }
+    nextarg:;
+    }
+
+    // トレースはこのプロセスとその子プロセスでのコンパイルだけを記録する
+    if (tracepath && (serverpath || clientpath))
+    {
+        fprintf(stderr, "--traceはコンパイルサーバとクライアントでは使えません\n");
+        return (1);
+    }
+
+    // 出力を作らずに仮想機械で実行する。入力は1つで、出力や計測のオプションは使えない
+    if (run)
+    {
+        if (argc - i != 1 || serverpath || clientpath || tracepath || jobs > 1 ||
+            O_threads > 1 || O_pipeline || O_outfile || O_assemble ||
+            O_cachedir || O_incremental || O_timings || O_timereport ||
+            O_optimize || O_dumpIR)
+        {
+            fprintf(stderr, "--runは入力ファイル1つと-Tだけと使えます\n");
+            return (1);
+        }
+        return (vm_runfile(argv[i]));
     }
 
+    // コンパイルサーバとそのクライアント
+    if (serverpath)
+        return (server(serverpath));
+
+    // キャッシュの統計だけを見る
+    if (i >= argc && cachestats && O_cachedir)
+    {
+        cache_report();
+        return (0);
+    }
     if (i >= argc)
         usage(argv[0]);
 
-    if ((Infile = fopen(argv[i], "r")) == NULL)
+    // 出力ファイル名は入力が1つのときだけ指定できる
+    if (O_outfile && argc - i > 1)
     {
-        fprintf(stderr, "%s を開けません:%s\n", argv[i], strerror(errno));
-        exit(1);
+        fprintf(stderr, "-oは入力ファイルが1つのときだけ指定できます\n");
+        return (1);
     }
+    if (clientpath)
+        return (client(clientpath, &argv[i], argc - i, bench));
 
-    // 出力ファイルの作成
-    if ((Outfile = fopen("out.s", "w")) == NULL)
+    if (tracepath)
     {
-        fprintf(stderr, "out.sを作成できませんでした%s\n", strerror(errno));
-        exit(1);
+        if (trace_open(tracepath) == -1)
+        {
+            fprintf(stderr, "%s を作成できません:%s\n", tracepath, strerror(errno));
+            return (1);
+        }
+        O_trace = 1;
     }
 
-    // とりあえずvoid printint()を確実に定義する
-    addglob("printint", P_CHAR, S_FUNCTION, 0);
+    // 入力が1つでジョブも1つであればこのプロセスでコンパイルする。
+    // そうでなければ入力ごとに出力を書き出すドライバに任せる
+    if (argc - i == 1 && jobs == 1 && !O_timings)
+    {
+        compile_file(argv[i], outname(argv[i], 1));
+        status = 0;
+    }
+    else
+        status = compile_files(&argv[i], argc - i, jobs);
 
-    scan(&Token);          // 入力ファイルの最初のトークンを取得
-    genpreamble();         // プレアンブルを出力
-    global_declarations(); // グローバル宣言のパース
-    genpostamble();        // ポストアンブルを出力
-    fclose(Outfile);       // 出力ファイルを閉じて終了
-    return (0);
+    if (cachestats && O_cachedir)
+        cache_report();
+    return (status);
 }
@@ -55,27 +55,94 @@ void ident(void)
   match(T_IDENT, "identifier");
 }
 
+// FNV-1aの128ビット版でバイト列をハッシュに混ぜる
+hash128 fnv1a(hash128 h, void *buf, size_t len)
+{
+  hash128 prime = ((hash128)1 << 88) + 0x13b;
+  unsigned char *p = buf;
+
+  for (size_t i = 0; i < len; i++)
+  {
+    h ^= p[i];
+    h *= prime;
+  }
+  return (h);
+}
+
+// 文字列を区切りのNUL文字ごとハッシュに混ぜる
+hash128 fnv1a_str(hash128 h, char *s)
+{
+  return (fnv1a(h, s, strlen(s) + 1));
+}
+
+// ハッシュ値を32桁の16進数にしてbufへ書き出す。
+// bufはHASHSTRLENバイト必要
+void hashstr(hash128 h, char *buf)
+{
+  snprintf(buf, HASHSTRLEN, "%016llx%016llx",
+           (unsigned long long)(h >> 64), (unsigned long long)h);
+}
+
+// ファイルの中身をmalloc()したバッファへ読み込み、NUL文字を付けて返す。
+// 開けなければNULLを返す
+char *slurp(char *file, size_t *len)
+{
+  FILE *f;
+  char *buf;
+  long size;
+
+  if ((f = fopen(file, "r")) == NULL)
+    return (NULL);
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  rewind(f);
+  if ((buf = malloc(size + 1)) == NULL)
+    fatal("メモリが確保できませんでした。slurp()");
+  *len = fread(buf, 1, size, f);
+  buf[*len] = '\0';
+  fclose(f);
+  return (buf);
+}
+
+// メモリ上のバイト列を入力ファイルとして開く
+FILE *openbuf(char *buf, size_t len)
+{
+  // fmemopen()は長さ0のバッファを開けないことがある
+  if (len == 0)
+    return (fopen("/dev/null", "r"));
+  return (fmemopen(buf, len, "r"));
+}
+
+// エラーの後始末。Fatalenvがセットされていればそこへ戻り、
+// そうでなければ終了する
+static void fatalexit(void)
+{
+  if (Fatalenv)
+    longjmp(*Fatalenv, 1);
+  exit(1);
+}
+
 // エラーを出力
 void fatal(char *s)
 {
-  fprintf(stderr, "%s on line %d\n", s, Line);
-  exit(1);
+  fprintf(Errfile, "%s on line %d\n", s, Line);
+  fatalexit();
 }
 
 void fatals(char *s1, char *s2)
 {
-  fprintf(stderr, "%s:%s on line %d\n", s1, s2, Line);
-  exit(1);
+  fprintf(Errfile, "%s:%s on line %d\n", s1, s2, Line);
+  fatalexit();
 }
 
 void fatald(char *s, int d)
 {
-  fprintf(stderr, "%s:%d on line %d\n", s, d, Line);
-  exit(1);
+  fprintf(Errfile, "%s:%d on line %d\n", s, d, Line);
+  fatalexit();
 }
 
 void fatalc(char *s, int c)
 {
-  fprintf(stderr, "%s:%c on line %d\n", s, c, Line);
-  exit(1);
+  fprintf(Errfile, "%s:%c on line %d\n", s, c, Line);
+  fatalexit();
 }
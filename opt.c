@@ -0,0 +1,809 @@
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+#include <limits.h>
+
+// 中間表現の最適化
+//
+// ir.cで作った関数の中間表現に、次の順でパスをかける。
+// 疎な条件付き定数伝播: 実行されうるブロックと定数になる値を同時に求め、
+//   定数になった値を定数に、条件が定数の分岐を無条件分岐に置き換えて、
+//   実行されないブロックを消す。畳み込みはeval.cと同じくintに収まる値だけ。
+// コピー伝播: 引数がすべて同じφと、大きさの変わらない型の拡張を、その値に置き換える。
+// 別名解析: alias.cでポインタの指す先を求める。
+// 冗長な読み込みの削除: 変数を書き換えうる命令の後で置いた読み込みのうち、
+//   別名解析で書き換えないとわかったものを、前に読んだか保存した値に置き換える。
+// 大域的な値番号付け: 支配木の順にたどり、同じ演算を同じ値に行う命令に、
+//   それを支配する最初の命令を代表として記録する。使う側は書き換えず、
+//   コード生成が代表の値を持っている変数から読み込むのに使う。
+// 不要命令の削除: 副作用のある根から使われない命令を消す。
+// 最後にloop.cのループの最適化をかける。
+
+#define MAXWALK 1000 // 冗長な読み込みを探すときに逆にたどる命令の数の上限
+
+// 定数伝播の束
+enum
+{
+  LAT_TOP,   // まだ値がわからない
+  LAT_CONST, // 定数cval
+  LAT_BOTTOM // 定数ではない
+};
+
+static int Changed; // パスの繰り返しで何か変わった
+
+// 定数伝播の作業リスト。束の値は命令ごとに高々2回しか下がらないので、
+// 値の作業リストは命令の数の2倍、辺の作業リストは辺の数で足りる
+static struct irinst **Ssawork; // 束の値が下がった命令
+static int Nssawork;
+static struct irblock **Edgework; // 実行されうるとわかった辺の行き先
+static int Nedgework;
+static struct irinst ***Users; // 命令の番号から、それを引数に使う命令の列へ
+static int *Nusers;
+
+// 値vの束の値を*valと共に返す。定数の命令はいつも定数
+static int latof(struct irinst *v, long *val)
+{
+  if (v->op == IR_CONST)
+  {
+    *val = v->val;
+    return (LAT_CONST);
+  }
+  *val = v->cval;
+  return (v->lat);
+}
+
+// 命令nの束の値を、今の値とlat, valの交わりにする。
+// 値が下がれば、使う側を見直すように作業リストへ積む
+static void meet(struct irinst *n, int lat, long val)
+{
+  if (lat == LAT_TOP || n->lat == LAT_BOTTOM)
+    return;
+  if (n->lat == LAT_CONST && (lat == LAT_BOTTOM || val != n->cval))
+    lat = LAT_BOTTOM;
+  else if (n->lat == LAT_CONST)
+    return;
+  n->lat = lat;
+  n->cval = val;
+  Ssawork[Nssawork++] = n;
+}
+
+// 演算opを定数l, rで行い*valへ入れる。
+// 0で割るときと、値がintに収まらないときは畳み込まない
+static int fold(int op, long l, long r, long *val)
+{
+  switch (op)
+  {
+  case IR_ADD:
+    *val = l + r;
+    break;
+  case IR_SUB:
+    *val = l - r;
+    break;
+  case IR_MUL:
+  case IR_SCALE:
+    *val = l * r;
+    break;
+  case IR_DIV:
+    if (r == 0)
+      return (0);
+    *val = l / r;
+    break;
+  case IR_EQ:
+    *val = (l == r);
+    break;
+  case IR_NE:
+    *val = (l != r);
+    break;
+  case IR_LT:
+    *val = (l < r);
+    break;
+  case IR_GT:
+    *val = (l > r);
+    break;
+  case IR_LE:
+    *val = (l <= r);
+    break;
+  case IR_GE:
+    *val = (l >= r);
+    break;
+  }
+
+  // 両辺がintに収まっていれば、積も64ビットに収まる
+  return (*val >= INT_MIN && *val <= INT_MAX);
+}
+
+// 命令nの束の値を引数から求める
+static void evaluate(struct irinst *n)
+{
+  long l, r, val = 0;
+  int ll, rl;
+
+  switch (n->op)
+  {
+  case IR_CONST:
+    meet(n, LAT_CONST, n->val);
+    return;
+  case IR_STORE:
+  case IR_STDEREF:
+  case IR_WIDEN:
+    // 保存の値は保存した値。拡張しても定数の値は変わらない
+    ll = latof(n->args[0], &l);
+    meet(n, ll, l);
+    return;
+  case IR_SCALE:
+    ll = latof(n->args[0], &l);
+    if (ll == LAT_CONST && !fold(n->op, l, n->val, &val))
+      ll = LAT_BOTTOM;
+    meet(n, ll, val);
+    return;
+  case IR_ADD:
+  case IR_SUB:
+  case IR_MUL:
+  case IR_DIV:
+  case IR_EQ:
+  case IR_NE:
+  case IR_LT:
+  case IR_GT:
+  case IR_LE:
+  case IR_GE:
+    ll = latof(n->args[0], &l);
+    rl = latof(n->args[1], &r);
+    if (ll == LAT_BOTTOM || rl == LAT_BOTTOM)
+      meet(n, LAT_BOTTOM, 0);
+    else if (ll == LAT_CONST && rl == LAT_CONST)
+    {
+      ll = fold(n->op, l, r, &val) ? LAT_CONST : LAT_BOTTOM;
+      meet(n, ll, val);
+    }
+    return;
+  case IR_EVAL:
+  case IR_LEAVE:
+  case IR_RET:
+  case IR_BR:
+  case IR_JMP:
+    return;
+  }
+
+  // 読み込み、アドレス、間接参照、呼び出しの値はわからない
+  meet(n, LAT_BOTTOM, 0);
+}
+
+// ブロックbからsへの辺を実行されうるものにして、辺の作業リストへ積む
+static void markedge(struct irblock *b, struct irblock *s)
+{
+  int found = 0;
+
+  for (int i = 0; i < s->npreds; i++)
+    if (s->preds[i] == b && !s->execin[i])
+    {
+      s->execin[i] = 1;
+      found = 1;
+    }
+  if (found)
+    Edgework[Nedgework++] = s;
+}
+
+// φnの束の値を、実行されうる辺から来る引数で求める
+static void visitphi(struct irinst *n)
+{
+  struct irblock *b = n->block;
+  long val;
+  int lat;
+
+  for (int i = 0; i < n->nargs; i++)
+    if (b->execin[i])
+    {
+      lat = latof(n->args[i], &val);
+      meet(n, lat, val);
+    }
+}
+
+// ブロックbの終端命令から、実行されうる後続ブロックへの辺を求める。
+// 条件のわからない分岐は両方へ進みうる
+static void visitterm(struct irblock *b)
+{
+  struct irinst *t;
+  long val;
+
+  if ((t = b->tail) == NULL || b->nsuccs == 0)
+    return;
+  if (t->op == IR_BR && latof(t->args[0], &val) == LAT_CONST)
+    markedge(b, b->succs[val ? 0 : 1]);
+  else
+    for (int i = 0; i < b->nsuccs; i++)
+      markedge(b, b->succs[i]);
+}
+
+// 関数の命令nとそれが引数に使う値vの組ごとに、fを呼ぶ
+static void eachuse(struct irfunc *fn, void (*f)(struct irinst *v, struct irinst *n))
+{
+  struct irblock *b;
+  struct irinst *n;
+
+  for (b = fn->entry; b; b = b->next)
+  {
+    for (n = b->phis; n; n = n->next)
+      for (int i = 0; i < n->nargs; i++)
+        f(n->args[i], n);
+    for (n = b->head; n; n = n->next)
+      for (int i = 0; i < n->nargs; i++)
+        f(n->args[i], n);
+  }
+}
+
+// eachuse()から呼ぶ。値vを使う命令の数を数える
+static void countuse(struct irinst *v, struct irinst *n)
+{
+  Nusers[v->num]++;
+}
+
+// eachuse()から呼ぶ。値vを使う命令の列にnを加える
+static void adduse(struct irinst *v, struct irinst *n)
+{
+  Users[v->num][Nusers[v->num]++] = n;
+}
+
+// 命令の番号から、それを引数に使う命令の列への表を作る。
+// 列は使う数ずつ区切ったひとつの配列に詰め、その先頭を*bufへ入れる
+static void mkusers(struct irfunc *fn, struct irinst ***buf)
+{
+  int total = 0;
+
+  Users = malloc((fn->ninsts + 1) * sizeof(struct irinst **));
+  Nusers = calloc(fn->ninsts + 1, sizeof(int));
+  if (Users == NULL || Nusers == NULL)
+    fatal("メモリが確保できませんでした。mkusers()");
+  eachuse(fn, countuse);
+  for (int i = 0; i <= fn->ninsts; i++)
+    total += Nusers[i];
+  if ((*buf = malloc((total + 1) * sizeof(struct irinst *))) == NULL)
+    fatal("メモリが確保できませんでした。mkusers()");
+  total = 0;
+  for (int i = 0; i <= fn->ninsts; i++)
+  {
+    Users[i] = *buf + total;
+    total += Nusers[i];
+    Nusers[i] = 0;
+  }
+  eachuse(fn, adduse);
+}
+
+// 疎な条件付き定数伝播。WegmanとZadeckの方法で、
+// 実行されうるとわかった辺の作業リストと、束の値が下がった命令の作業リストを使う。
+// 辺を初めてたどったブロックはすべての命令を評価し、
+// すでに実行されうるブロックへの辺ではφだけを評価し直す。
+// 値が下がった命令は、それを使う命令のうち実行されうるブロックにあるものだけを
+// 評価し直す。どちらの作業リストも空になれば束の値は変わらない
+static void sccp(struct irfunc *fn)
+{
+  struct irblock *b, *s, *prev;
+  struct irinst *n, *t, **ubuf;
+  long val;
+  int nedges = 1;
+
+  for (b = fn->entry; b; b = b->next)
+  {
+    b->exec = 0;
+    b->execin = arena_alloc(b->npreds + 1);
+    memset(b->execin, 0, b->npreds + 1);
+    nedges += b->nsuccs;
+  }
+  mkusers(fn, &ubuf);
+  Ssawork = malloc((2 * fn->ninsts + 1) * sizeof(struct irinst *));
+  Edgework = malloc(nedges * sizeof(struct irblock *));
+  if (Ssawork == NULL || Edgework == NULL)
+    fatal("メモリが確保できませんでした。sccp()");
+  Nssawork = 0;
+
+  // 入口のブロックへは関数の外からの辺がある
+  Edgework[0] = fn->entry;
+  Nedgework = 1;
+
+  while (Nedgework > 0 || Nssawork > 0)
+  {
+    if (Nedgework > 0)
+    {
+      s = Edgework[--Nedgework];
+      for (n = s->phis; n; n = n->next)
+        visitphi(n);
+      if (s->exec)
+        continue;
+
+      // 初めて実行されうるとわかったブロック
+      s->exec = 1;
+      for (n = s->head; n; n = n->next)
+        evaluate(n);
+      visitterm(s);
+      continue;
+    }
+
+    // 値の下がった命令を使う命令を評価し直す
+    n = Ssawork[--Nssawork];
+    for (int i = 0; i < Nusers[n->num]; i++)
+    {
+      t = Users[n->num][i];
+      if (!t->block->exec)
+        continue;
+      if (t->op == IR_PHI)
+        visitphi(t);
+      else
+      {
+        evaluate(t);
+        if (t == t->block->tail)
+          visitterm(t->block);
+      }
+    }
+  }
+  free(Ssawork);
+  free(Edgework);
+  free(Users);
+  free(Nusers);
+  free(ubuf);
+
+  // 定数になった値を定数の命令に置き換え、条件が定数の分岐は無条件分岐にする
+  for (b = fn->entry; b; b = b->next)
+  {
+    if (!b->exec)
+      continue;
+    for (n = b->phis; n; n = n->next)
+      if (n->lat == LAT_CONST)
+      {
+        n->repl = ir_const(fn, n->cval, n->type);
+        ir_unlink(n);
+      }
+    for (n = b->head; n; n = n->next)
+      if (n->lat == LAT_CONST && n->op >= IR_ADD && n->op <= IR_SCALE)
+        n->repl = ir_const(fn, n->cval, n->type);
+
+    t = b->tail;
+    if (t && t->op == IR_BR && b->nsuccs == 2 &&
+        latof(t->args[0], &val) == LAT_CONST)
+    {
+      ir_removeedge(b, b->succs[val ? 1 : 0]);
+      b->succs[0] = b->succs[val ? 0 : 1];
+      b->nsuccs = 1;
+      t->op = IR_JMP;
+      t->nargs = 0;
+    }
+  }
+
+  // 実行されないブロックを配置から外し、そこからの辺を消す
+  for (prev = NULL, b = fn->entry; b; b = b->next)
+  {
+    if (b->exec)
+    {
+      prev = b;
+      continue;
+    }
+    for (int i = 0; i < b->nsuccs; i++)
+      if (b->succs[i]->exec)
+        ir_removeedge(b, b->succs[i]);
+    prev->next = b->next;
+    if (fn->last == b)
+      fn->last = prev;
+  }
+  ir_resolveargs(fn);
+}
+
+// コピー伝播
+static void copyprop(struct irfunc *fn)
+{
+  struct irblock *b;
+  struct irinst *n, *same, *a;
+
+  do
+  {
+    Changed = 0;
+    for (b = fn->entry; b; b = b->next)
+    {
+      // 引数がすべて同じ値(かφ自身)であるφ
+      for (n = b->phis; n; n = n->next)
+      {
+        if (n->flags & IRF_INLINE)
+          continue;
+        same = NULL;
+        for (int i = 0; i < n->nargs; i++)
+        {
+          a = ir_resolve(n->args[i]);
+          if (a == n || a == same)
+            continue;
+          if (same)
+          {
+            same = n;
+            break;
+          }
+          same = a;
+        }
+        if (same != NULL && same != n)
+        {
+          n->repl = same;
+          ir_unlink(n);
+          Changed = 1;
+        }
+      }
+
+      // 同じ大きさの型への拡張は何もしない
+      for (n = b->head; n; n = n->next)
+        if (n->op == IR_WIDEN && n->repl == NULL &&
+            genprimsize(n->val) == genprimsize(n->type))
+        {
+          n->repl = ir_resolve(n->args[0]);
+          Changed = 1;
+        }
+    }
+  } while (Changed);
+  ir_resolveargs(fn);
+}
+
+// 関数の支配木を作る。Cooper, Harvey, Kennedyの反復法で、
+// 逆後順の番号rpoと、支配木の行きがけと帰りがけの番号pre, postを付ける。
+// 逆後順に並べたブロックの配列を返し、その数を*countへ入れる
+static struct irblock **dominators(struct irfunc *fn, int *count)
+{
+  struct irblock **order, **stack, *b, *s, *p, *idom;
+  int *next, sp, n = 0, num = 0, changed;
+
+  for (b = fn->entry; b; b = b->next)
+  {
+    b->rpo = -1;
+    b->idom = NULL;
+    b->child = b->sibling = NULL;
+    n++;
+  }
+  order = malloc(n * sizeof(struct irblock *));
+  stack = malloc(n * sizeof(struct irblock *));
+  next = malloc(n * sizeof(int));
+  if (order == NULL || stack == NULL || next == NULL)
+    fatal("メモリが確保できませんでした。dominators()");
+
+  // 深さ優先でたどって後順に並べる。rpoは訪れた印にも使う
+  n = 0;
+  sp = 0;
+  stack[sp] = fn->entry;
+  next[sp++] = 0;
+  fn->entry->rpo = 0;
+  while (sp > 0)
+  {
+    b = stack[sp - 1];
+    if (next[sp - 1] < b->nsuccs)
+    {
+      s = b->succs[next[sp - 1]++];
+      if (s->rpo == -1)
+      {
+        s->rpo = 0;
+        stack[sp] = s;
+        next[sp++] = 0;
+      }
+      continue;
+    }
+    order[n++] = b;
+    sp--;
+  }
+  for (int i = 0; i < n / 2; i++)
+  {
+    b = order[i];
+    order[i] = order[n - 1 - i];
+    order[n - 1 - i] = b;
+  }
+  for (int i = 0; i < n; i++)
+    order[i]->rpo = i;
+
+  fn->entry->idom = fn->entry;
+  do
+  {
+    changed = 0;
+    for (int i = 1; i < n; i++)
+    {
+      b = order[i];
+      idom = NULL;
+      for (int j = 0; j < b->npreds; j++)
+      {
+        if ((p = b->preds[j])->idom == NULL)
+          continue;
+        if (idom == NULL)
+        {
+          idom = p;
+          continue;
+        }
+
+        // 2つのブロックの支配木の共通の祖先
+        s = idom;
+        while (p != s)
+        {
+          while (p->rpo > s->rpo)
+            p = p->idom;
+          while (s->rpo > p->rpo)
+            s = s->idom;
+        }
+        idom = p;
+      }
+      if (b->idom != idom)
+      {
+        b->idom = idom;
+        changed = 1;
+      }
+    }
+  } while (changed);
+
+  // 支配木の子のリストを作って行きがけと帰りがけの番号を付ける
+  for (int i = n - 1; i > 0; i--)
+  {
+    b = order[i];
+    b->sibling = b->idom->child;
+    b->idom->child = b;
+  }
+  sp = 0;
+  stack[sp++] = fn->entry;
+  fn->entry->pre = num++;
+  while (sp > 0)
+  {
+    b = stack[sp - 1];
+    if ((s = b->child) != NULL)
+    {
+      b->child = s->sibling;
+      s->pre = num++;
+      stack[sp++] = s;
+      continue;
+    }
+    b->post = num++;
+    sp--;
+  }
+
+  free(stack);
+  free(next);
+  *count = n;
+  return (order);
+}
+
+// ブロックaがブロックbを支配していればtrueを返す
+int ir_dominates(struct irblock *a, struct irblock *b)
+{
+  return (a->pre <= b->pre && b->post <= a->post);
+}
+
+// 値番号で比べる引数vの値。定数は値で、ほかは代表の命令で比べる
+static long argkey(struct irinst *v)
+{
+  if (v->op == IR_CONST)
+    return (v->val * 2 + 1);
+  return ((long)v->leader->num * 2);
+}
+
+// 引数を入れ替えても値の変わらない演算であればtrueを返す
+static int commutes(int op)
+{
+  return (op == IR_ADD || op == IR_MUL || op == IR_EQ || op == IR_NE);
+}
+
+// 命令nの値番号のハッシュ値
+static unsigned long hashinst(struct irinst *n)
+{
+  unsigned long h = n->op * 31 + n->type * 7 + n->val * 13 + n->id;
+
+  if (n->op == IR_PHI)
+    h = h * 31 + n->block->num;
+  if (commutes(n->op))
+    return (h * 31 + argkey(n->args[0]) + argkey(n->args[1]));
+  for (int i = 0; i < n->nargs; i++)
+    h = h * 31 + argkey(n->args[i]);
+  return (h);
+}
+
+// 命令aとbが同じ値を計算すればtrueを返す
+static int sameinst(struct irinst *a, struct irinst *b)
+{
+  if (a->op != b->op || a->type != b->type || a->val != b->val ||
+      a->id != b->id || a->nargs != b->nargs)
+    return (0);
+  if (a->op == IR_PHI && a->block != b->block)
+    return (0);
+  if (commutes(a->op) && argkey(a->args[0]) == argkey(b->args[1]) &&
+      argkey(a->args[1]) == argkey(b->args[0]))
+    return (1);
+  for (int i = 0; i < a->nargs; i++)
+    if (argkey(a->args[i]) != argkey(b->args[i]))
+      return (0);
+  return (1);
+}
+
+// 値番号を付ける命令であればtrueを返す。
+// 副作用がなく、メモリを読まず、同じ引数からいつも同じ値になる命令だけ
+static int numbered(struct irinst *n)
+{
+  if (n->repl)
+    return (0);
+  switch (n->op)
+  {
+  case IR_ADDR:
+  case IR_WIDEN:
+  case IR_SCALE:
+    return (1);
+  case IR_PHI:
+    return (!(n->flags & IRF_INLINE));
+  }
+  return (n->op >= IR_ADD && n->op <= IR_GE);
+}
+
+// 命令nに値番号を付ける。nを支配する同じ値の命令があれば、その代表を記録する
+static void number(struct irinst **table, unsigned long mask, struct irinst *n)
+{
+  struct irinst *m;
+  unsigned long h;
+
+  if (!numbered(n))
+    return;
+  for (h = hashinst(n) & mask; (m = table[h]) != NULL; h = (h + 1) & mask)
+    if (sameinst(m, n) && ir_dominates(m->block, n->block))
+    {
+      n->leader = m->leader;
+      return;
+    }
+  table[h] = n;
+}
+
+// 大域的な値番号付け。orderは逆後順に並べたcount個のブロック
+static void gvn(struct irfunc *fn, struct irblock **order, int count)
+{
+  struct irinst **table, *n;
+  int size = 16;
+
+  while (size < 2 * fn->ninsts)
+    size *= 2;
+  if ((table = calloc(size, sizeof(struct irinst *))) == NULL)
+    fatal("メモリが確保できませんでした。gvn()");
+
+  // 逆後順では、命令を見る前にそれを支配する命令をすべて見ている
+  for (int i = 0; i < count; i++)
+  {
+    for (n = order[i]->phis; n; n = n->next)
+      number(table, size - 1, n);
+    for (n = order[i]->head; n; n = n->next)
+      number(table, size - 1, n);
+  }
+  free(table);
+}
+
+// 変数の読み込みlの前で、変数のメモリに入っているとわかる値を返す。なければNULL。
+// 命令を逆にたどり、ブロックの先頭に着けば、先行ブロックが1つのときはそこへ進む。
+// 途中で入口を通ったブロックを*passedに入れ、その数を*npassedに返す
+static struct irinst *available(struct irinst *l, struct irblock **passed,
+                                int *npassed)
+{
+  struct irblock *b = l->block;
+  struct irinst *n = l->prev;
+  int steps = 0;
+
+  *npassed = 0;
+  while (steps < MAXWALK)
+  {
+    for (; n && steps < MAXWALK; n = n->prev, steps++)
+      switch (n->op)
+      {
+      case IR_LOAD:
+        if (n->var == l->var)
+          return (ir_resolve(n));
+        break;
+      case IR_STORE:
+        if (n->var == l->var)
+          return (n->flags & IRF_EXACT ? ir_storedval(n->args[0]) : NULL);
+        break;
+      case IR_CALL:
+        return (NULL);
+      case IR_STDEREF:
+        if (ir_mayalias(n, l->id))
+          return (NULL);
+        break;
+      }
+    if (n)
+      return (NULL);
+
+    passed[(*npassed)++] = b;
+    for (n = b->phis; n; n = n->next)
+      if (n->var == l->var && !(n->flags & IRF_INLINE))
+        return (ir_resolve(n));
+    if (b->npreds != 1 || b->preds[0] == l->block)
+      return (NULL);
+    b = b->preds[0];
+    n = b->tail;
+  }
+  return (NULL);
+}
+
+// 冗長な読み込みの削除: 呼び出しや、別名解析でわからなかったポインタを通した
+// 保存の後で構築が置いた読み込みのうち、間の命令が変数を書き換ええないものを、
+// 前に読んだか保存した値に置き換える。通ったブロックの入口の値にも記録し、
+// コード生成がその値を変数から読み込めるようにする
+static void loads(struct irfunc *fn)
+{
+  struct irblock *b, **passed;
+  struct irinst *n, *v;
+  int npassed, found = 0;
+
+  if ((passed = malloc((fn->nblocks + 1) * sizeof(struct irblock *))) == NULL)
+    fatal("メモリが確保できませんでした。loads()");
+  for (b = fn->entry; b; b = b->next)
+    for (n = b->head; n; n = n->next)
+      if (n->op == IR_LOAD && (v = available(n, passed, &npassed)) != NULL)
+      {
+        n->repl = v;
+        found = 1;
+        for (int i = 0; i < npassed; i++)
+          ir_setentry(passed[i], n->var, v);
+      }
+  free(passed);
+  if (found)
+    ir_resolveargs(fn);
+}
+
+// 不要命令の削除
+static void dce(struct irfunc *fn)
+{
+  struct irblock *b;
+  struct irinst **work, *n, *next;
+  int sp = 0;
+
+  if ((work = malloc((fn->ninsts + 1) * sizeof(struct irinst *))) == NULL)
+    fatal("メモリが確保できませんでした。dce()");
+  for (b = fn->entry; b; b = b->next)
+  {
+    for (n = b->phis; n; n = n->next)
+      n->flags &= ~IRF_LIVE;
+    for (n = b->head; n; n = n->next)
+    {
+      n->flags &= ~IRF_LIVE;
+
+      // 値を捨てるだけの副作用のない式は残さない
+      if ((n->flags & IRF_ROOT) &&
+          (n->op != IR_EVAL || (n->flags & IRF_EFFECT)))
+      {
+        n->flags |= IRF_LIVE;
+        work[sp++] = n;
+      }
+    }
+  }
+
+  while (sp > 0)
+  {
+    n = work[--sp];
+    for (int i = 0; i < n->nargs; i++)
+      if (n->args[i]->block && !(n->args[i]->flags & IRF_LIVE))
+      {
+        n->args[i]->flags |= IRF_LIVE;
+        work[sp++] = n->args[i];
+      }
+  }
+
+  for (b = fn->entry; b; b = b->next)
+  {
+    for (n = b->phis; n; n = next)
+    {
+      next = n->next;
+      if (!(n->flags & IRF_LIVE))
+        ir_unlink(n);
+    }
+    for (n = b->head; n; n = next)
+    {
+      next = n->next;
+      if (!(n->flags & IRF_LIVE))
+        ir_unlink(n);
+    }
+  }
+  free(work);
+}
+
+// 関数の中間表現を最適化する
+void ir_optimize(struct irfunc *fn)
+{
+  struct irblock **order;
+  int count;
+
+  sccp(fn);
+  copyprop(fn);
+  ir_alias(fn);
+  loads(fn);
+  order = dominators(fn, &count);
+  gvn(fn, order, count);
+  dce(fn);
+  ir_promote(fn, order, count);
+  free(order);
+}
@@ -0,0 +1,307 @@
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+#include <pthread.h>
+
+// 関数単位の並列コード生成とパイプライン
+//
+// パーサ(メインスレッド)は関数のASTツリーを作るたびに
+// それをジョブとしてキューへ入れ、コード生成スレッドがそれぞれの
+// バッファへアセンブリを生成する。出力はソース順に並んだチャンクのリストで、
+// パーサ自身の出力(グローバル変数など)もチャンクとして間に挟む。
+// 書き出しスレッドは先頭のチャンクが出来上がるたびに
+// それを出力ファイルへ流し込む。
+//
+//   パーサ --[キュー]--> コード生成 x N --[チャンク]--> 書き出し
+//
+// キューの長さはPIPEDEPTHで制限し、コード生成が遅いときは
+// パーサを待たせてメモリの使用量を抑える。
+
+#define PIPEDEPTH 16 // 生成待ちにできる関数の最大数
+
+// 出力の1片
+struct chunk
+{
+  char *buf;             // 生成されたアセンブリ
+  size_t len;            // その長さ
+  struct ASTnode *tree;  // 関数のASTツリー。パーサの出力であればNULL
+  int labelbase;         // 関数のために予約したラベル番号の先頭
+  int done;              // 生成が終わっていればtrue
+  struct chunk *next;    // ソース順で次のチャンク
+};
+
+// ステージごとの計測値
+struct stage
+{
+  double busy;  // 仕事をしていた時間(秒)
+  double stall; // 待たされていた時間(秒)
+  int stalls;   // 待たされた回数
+  int items;    // 処理したチャンクの数
+};
+
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Workready = PTHREAD_COND_INITIALIZER; // キューに関数が入った
+static pthread_cond_t Queuefree = PTHREAD_COND_INITIALIZER; // キューに空きができた
+static pthread_cond_t Chunkdone = PTHREAD_COND_INITIALIZER; // チャンクが完成した
+
+static struct chunk *Head, *Tail; // まだ書き出していないチャンクのリスト
+static struct chunk *Pending;     // 次にコード生成スレッドが取るべきチャンク
+static struct chunk *Parsechunk;  // パーサが書き込み中のチャンク
+static int Queued;                // 生成待ちの関数の数
+static FILE *Realout;             // 本来の出力ファイル
+static pthread_t *Workers;
+static pthread_t Writer;
+static int Nworkers;
+static int Finished;              // パースが終わればtrue
+static struct stage Parse, Codegen, Write;
+static double Start;
+static _Thread_local struct chunk *Current; // コード生成スレッドが生成中のチャンク
+
+// 新規チャンクをリストの末尾へ追加する。ロックを取って呼ぶこと
+static struct chunk *newchunk(struct ASTnode *tree)
+{
+  struct chunk *c;
+
+  if ((c = calloc(1, sizeof(struct chunk))) == NULL)
+    fatal("メモリが確保できませんでした。newchunk()");
+  c->tree = tree;
+  if (Tail)
+    Tail->next = c;
+  else
+    Head = c;
+  Tail = c;
+  return (c);
+}
+
+// パーサの出力先として新しいチャンクを開く
+static void openparsechunk(void)
+{
+  pthread_mutex_lock(&Lock);
+  Parsechunk = newchunk(NULL);
+  pthread_mutex_unlock(&Lock);
+  if ((Outfile = open_memstream(&Parsechunk->buf, &Parsechunk->len)) == NULL)
+    fatal("出力バッファを作成できません");
+}
+
+// チャンクの完成を書き出しスレッドと、それを待つコード生成スレッドへ知らせる
+static void chunkdone(struct chunk *c)
+{
+  pthread_mutex_lock(&Lock);
+  c->done = 1;
+  pthread_cond_broadcast(&Chunkdone);
+  pthread_mutex_unlock(&Lock);
+}
+
+// パーサの出力チャンクを閉じる
+static void closeparsechunk(void)
+{
+  fclose(Outfile);
+  chunkdone(Parsechunk);
+}
+
+// コード生成スレッド。ジョブをソース順に取り出して
+// それぞれ専用のバッファへアセンブリを生成する
+static void *worker(void *arg)
+{
+  struct chunk *c;
+  double t;
+
+  if (O_trace)
+    trace_thread("codegen");
+  freeall_registers();
+  while (1)
+  {
+    pthread_mutex_lock(&Lock);
+    if (Pending == NULL && !Finished)
+    {
+      t = now();
+      Codegen.stalls++;
+      while (Pending == NULL && !Finished)
+        pthread_cond_wait(&Workready, &Lock);
+      Codegen.stall += now() - t;
+    }
+    if (Pending == NULL)
+    {
+      pthread_mutex_unlock(&Lock);
+      return (NULL);
+    }
+    c = Pending;
+    do
+      Pending = Pending->next;
+    while (Pending != NULL && Pending->tree == NULL);
+    Queued--;
+    pthread_cond_signal(&Queuefree);
+    pthread_mutex_unlock(&Lock);
+
+    t = now();
+    Current = c;
+    if ((Outfile = open_memstream(&c->buf, &c->len)) == NULL)
+      fatal("出力バッファを作成できません");
+    genfunction(c->tree, c->labelbase);
+    fclose(Outfile);
+    t = now() - t;
+
+    pthread_mutex_lock(&Lock);
+    Codegen.busy += t;
+    Codegen.items++;
+    pthread_mutex_unlock(&Lock);
+    chunkdone(c);
+  }
+}
+
+// 書き出しスレッド。先頭のチャンクが完成するたびに出力ファイルへ流し込む
+static void *writer(void *arg)
+{
+  struct chunk *c;
+  double t;
+
+  if (O_trace)
+    trace_thread("writer");
+  while (1)
+  {
+    pthread_mutex_lock(&Lock);
+    if ((Head == NULL || !Head->done) && !(Head == NULL && Finished))
+    {
+      t = now();
+      Write.stalls++;
+      while ((Head == NULL || !Head->done) && !(Head == NULL && Finished))
+        pthread_cond_wait(&Chunkdone, &Lock);
+      Write.stall += now() - t;
+    }
+    if ((c = Head) == NULL)
+    {
+      pthread_mutex_unlock(&Lock);
+      return (NULL);
+    }
+    if ((Head = c->next) == NULL)
+      Tail = NULL;
+    pthread_mutex_unlock(&Lock);
+
+    t = now();
+    fwrite(c->buf, 1, c->len, Realout);
+    fflush(Realout);
+    Write.busy += now() - t;
+    Write.items++;
+    free(c->buf);
+    free(c);
+  }
+}
+
+// 並列コード生成を開始する。
+// 以後パーサの出力はチャンクへ書き込まれる
+void par_begin(int nthreads)
+{
+  Head = Tail = Pending = NULL;
+  Queued = Finished = 0;
+  memset(&Parse, 0, sizeof(Parse));
+  memset(&Codegen, 0, sizeof(Codegen));
+  memset(&Write, 0, sizeof(Write));
+  Start = now();
+
+  fflush(Outfile);
+  Realout = Outfile;
+  Nworkers = nthreads;
+  if ((Workers = malloc(nthreads * sizeof(pthread_t))) == NULL)
+    fatal("メモリが確保できませんでした。par_begin()");
+  for (int i = 0; i < nthreads; i++)
+    if (pthread_create(&Workers[i], NULL, worker, NULL) != 0)
+      fatal("スレッドを作成できません");
+  if (pthread_create(&Writer, NULL, writer, NULL) != 0)
+    fatal("スレッドを作成できません");
+  openparsechunk();
+}
+
+// 関数のASTツリーをコード生成スレッドへ渡す。
+// 関数が使うラベルはここで予約しておき、出力を逐次生成と一致させる。
+// キューが一杯であれば空くまで待つ
+void par_function(struct ASTnode *tree)
+{
+  struct chunk *c;
+  double t;
+
+  closeparsechunk();
+  pthread_mutex_lock(&Lock);
+  if (Queued >= PIPEDEPTH)
+  {
+    t = now();
+    Parse.stalls++;
+    while (Queued >= PIPEDEPTH)
+      pthread_cond_wait(&Queuefree, &Lock);
+    Parse.stall += now() - t;
+  }
+  c = newchunk(tree);
+  c->labelbase = genreservelabels(genlabelcount(tree));
+  if (Pending == NULL)
+    Pending = c;
+  Queued++;
+  Parse.items++;
+  pthread_cond_signal(&Workready);
+  pthread_mutex_unlock(&Lock);
+  openparsechunk();
+}
+
+// 生成中の関数より前にある関数idのコード生成が終わるまで待つ。
+// 呼び出す関数のコード生成の結果を使うときに呼ぶ。前の関数は先に
+// 取り出されて生成中か生成済みで、後ろの関数を待つことはないので、待ち合いにはならない。
+// 書き出し済みのチャンクはリストにないので、見つからなければ終わっている
+void par_waitfunc(int id)
+{
+  struct chunk *c;
+
+  pthread_mutex_lock(&Lock);
+  while (1)
+  {
+    for (c = Head; c != Current; c = c->next)
+      if (c->tree && c->tree->v.id == id && !c->done)
+        break;
+    if (c == Current)
+      break;
+    pthread_cond_wait(&Chunkdone, &Lock);
+  }
+  pthread_mutex_unlock(&Lock);
+}
+
+// ステージごとの稼働率と待ちの回数を出力する
+static void par_report(double wall)
+{
+  struct stage *s[] = {&Parse, &Codegen, &Write};
+  char *name[] = {"parse", "codegen", "write"};
+  int n[] = {1, Nworkers, 1};
+
+  fprintf(stderr, "%-8s %8s %10s %10s %8s %10s\n",
+          "stage", "items", "busy ms", "occupancy", "stalls", "stall ms");
+  for (int i = 0; i < 3; i++)
+    fprintf(stderr, "%-8s %8d %10.3f %9.1f%% %8d %10.3f\n", name[i],
+            s[i]->items, s[i]->busy * 1000,
+            wall > 0 ? 100 * s[i]->busy / (wall * n[i]) : 0.0,
+            s[i]->stalls, s[i]->stall * 1000);
+  fprintf(stderr, "%-8s %8s %10.3f\n", "wall", "", wall * 1000);
+}
+
+// すべてのスレッドの終了を待つ。
+// 書き出しスレッドがチャンクをソース順に出力ファイルへ流し込み終われば戻る
+void par_end(void)
+{
+  double wall, parsed;
+
+  // パーサの時間は待たされていない時間すべて
+  parsed = now() - Start;
+  Parse.busy = parsed - Parse.stall;
+
+  closeparsechunk();
+  pthread_mutex_lock(&Lock);
+  Finished = 1;
+  pthread_cond_broadcast(&Workready);
+  pthread_cond_broadcast(&Chunkdone);
+  pthread_mutex_unlock(&Lock);
+  for (int i = 0; i < Nworkers; i++)
+    pthread_join(Workers[i], NULL);
+  free(Workers);
+  pthread_join(Writer, NULL);
+
+  wall = now() - Start;
+  Outfile = Realout;
+  // ステージの表はほかの計時と同じく-tか-ftime-reportのときだけ出す
+  if (O_pipeline && (O_timings || O_timereport))
+    par_report(wall);
+}
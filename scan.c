@@ -147,6 +147,12 @@ static int keyword(char *s)
 // 拒否(排出)するトークンへのポインタ
 static struct token *Rejtoken = NULL;
 
+// 新しい入力のために字句解析の状態を初期化する
+void scan_reset(void)
+{
+    Rejtoken = NULL;
+}
+
 // スキャンしたばかりのトークンを拒否
 void reject_token(struct token *t)
 {
@@ -157,7 +163,7 @@ void reject_token(struct token *t)
 
 // スキャンを行い入力ファイルから見つかった次のトークンを返す。
 // トークンが有効であれば１を、トークンが残っていなければ0を返す。
-int scan(struct token *t)
+static int scantoken(struct token *t)
 {
     int c, tokentype;
 
@@ -289,6 +295,25 @@ int scan(struct token *t)
         fatalc("解釈できない文字", c);
     }
 
+    // インクリメンタルモードでは関数のフィンガープリントに混ぜる
+    if (O_incremental)
+        inc_token(t);
+    if (O_timereport)
+        stats_count(ST_TOKENS, 1);
+
     // トークンが見つかった
     return (1);
 }
+
+// 次のトークンをスキャンする。-ftime-reportではその時間を計る
+int scan(struct token *t)
+{
+    int found;
+
+    if (!O_timereport)
+        return (scantoken(t));
+    stats_enter(PH_SCAN);
+    found = scantoken(t);
+    stats_leave();
+    return (found);
+}
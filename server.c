@@ -0,0 +1,411 @@
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// コンパイルサーバとそのクライアント
+//
+// サーバはUnixドメインソケットで待ち受け、1つの接続で
+// いくつでもリクエストを受け付ける。リクエストとレスポンスは
+// 1行のヘッダとそれに続くバイト列からなる。
+//
+//   リクエスト:   "src <長さ> [オプション ...]\n" <ソースのバイト列>
+//                 "path <長さ> [オプション ...]\n" <ファイルのパス>
+//   レスポンス:   "ok <長さ>\n" <アセンブリ>
+//                 "error <長さ>\n" <診断メッセージ>
+//
+// コンパイルはすべてサーバのプロセス内で行い、fatal()はlongjmp()で
+// リクエストの処理へ戻ってくる。シンボルテーブルはリクエストごとに空にし、
+// ASTノードのアリーナは確保済みのブロックをそのまま使い回す。
+
+#define MAXHEADER 1024 // ヘッダ行の最大長
+
+// fdからちょうどnバイト読み込む。EOFかエラーであれば-1を返す
+static int readfull(int fd, char *buf, size_t n)
+{
+  ssize_t r;
+
+  while (n > 0)
+  {
+    if ((r = read(fd, buf, n)) <= 0)
+    {
+      if (r < 0 && errno == EINTR)
+        continue;
+      return (-1);
+    }
+    buf += r;
+    n -= r;
+  }
+  return (0);
+}
+
+// fdへちょうどnバイト書き出す。エラーであれば-1を返す
+static int writefull(int fd, char *buf, size_t n)
+{
+  ssize_t r;
+
+  while (n > 0)
+  {
+    if ((r = write(fd, buf, n)) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return (-1);
+    }
+    buf += r;
+    n -= r;
+  }
+  return (0);
+}
+
+// fdから改行までの1行をbufへ読み込み、改行をNUL文字に置き換える。
+// EOFかエラー、行が長すぎるときは-1を返す
+static int readline(int fd, char *buf, int size)
+{
+  for (int i = 0; i < size; i++)
+  {
+    if (readfull(fd, &buf[i], 1) == -1)
+      return (-1);
+    if (buf[i] == '\n')
+    {
+      buf[i] = '\0';
+      return (i);
+    }
+  }
+  return (-1);
+}
+
+// ヘッダ行とそれに続くバイト列を送る
+static int sendframe(int fd, char *kind, char *flags, char *buf, size_t len)
+{
+  char header[MAXHEADER];
+  int n;
+
+  n = snprintf(header, sizeof(header), "%s %zu%s%s\n", kind, len,
+               *flags ? " " : "", flags);
+  if (n >= sizeof(header))
+    return (-1);
+  if (writefull(fd, header, n) == -1 || writefull(fd, buf, len) == -1)
+    return (-1);
+  return (0);
+}
+
+// ヘッダ行とそれに続くバイト列を受け取る。
+// headerにはヘッダの先頭の語、flagsにはその後ろのオプションを指すポインタを返す。
+// バイト列はmalloc()したバッファにNUL文字を付けて返す
+static char *recvframe(int fd, char *header, char **flags, size_t *len)
+{
+  char *p, *buf;
+
+  if (readline(fd, header, MAXHEADER) == -1)
+    return (NULL);
+  if ((p = strchr(header, ' ')) == NULL)
+    return (NULL);
+  *p++ = '\0';
+  *len = strtoul(p, &p, 10);
+  while (*p == ' ')
+    p++;
+  *flags = p;
+
+  if ((buf = malloc(*len + 1)) == NULL)
+    return (NULL);
+  if (readfull(fd, buf, *len) == -1)
+  {
+    free(buf);
+    return (NULL);
+  }
+  buf[*len] = '\0';
+  return (buf);
+}
+
+// 1つのリクエストをコンパイルする。
+// 成功すればアセンブリを、失敗すれば診断メッセージを*resultへ返す
+static int serve(char *kind, char *flags, char *payload, size_t len,
+                 char **result, size_t *rlen)
+{
+  FILE *in = NULL, *out, *err;
+  char *ebuf, *abuf, *flag;
+  size_t elen, alen;
+  jmp_buf env;
+  int ok = 0;
+
+  out = open_memstream(&abuf, &alen);
+  err = open_memstream(&ebuf, &elen);
+  if (out == NULL || err == NULL)
+    fatal("出力バッファを作成できません");
+
+  // オプションはリクエストごとに既定値から設定し直す
+  reset_options();
+  for (flag = strtok(flags, " "); flag; flag = strtok(NULL, " "))
+    if (!compile_option(flag))
+      fprintf(err, "不明なオプションです:%s\n", flag);
+
+  if (!strcmp(kind, "src"))
+  {
+    in = openbuf(payload, len);
+  }
+  else if (!strcmp(kind, "path"))
+  {
+    if ((in = fopen(payload, "r")) == NULL)
+      fprintf(err, "%s を開けません:%s\n", payload, strerror(errno));
+  }
+  else
+    fprintf(err, "不明なリクエストです:%s\n", kind);
+
+  if (in != NULL && ftell(err) == 0)
+  {
+    // 出力ファイルがないので前回の出力は使わず、ラベルの名前だけが変わる
+    if (O_incremental)
+      inc_load(NULL);
+    Errfile = err;
+    Fatalenv = &env;
+    if (setjmp(env) == 0)
+    {
+      compile(in, out);
+      ok = 1;
+    }
+    Fatalenv = NULL;
+    Errfile = stderr;
+    if (O_incremental)
+      inc_save(NULL);
+  }
+  if (in != NULL)
+    fclose(in);
+  fclose(out);
+  fclose(err);
+
+  if (ok)
+  {
+    free(ebuf);
+    *result = abuf;
+    *rlen = alen;
+  }
+  else
+  {
+    free(abuf);
+    *result = ebuf;
+    *rlen = elen;
+  }
+  return (ok);
+}
+
+// Unixドメインソケットを開く。
+// listenerがtrueであれば待ち受け用、そうでなければ接続する
+static int opensocket(char *path, int listener)
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  if (strlen(path) >= sizeof(addr.sun_path))
+    fatals("ソケットのパスが長すぎます", path);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+    fatals("ソケットを作成できません", strerror(errno));
+  if (listener)
+  {
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        listen(fd, 64) == -1)
+      fatals("ソケットで待ち受けできません", strerror(errno));
+  }
+  else if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    fatals("サーバに接続できません", strerror(errno));
+  return (fd);
+}
+
+// コンパイルサーバ。接続を1つずつ受け付けて、
+// 接続が閉じられるまでリクエストを処理する
+int server(char *path)
+{
+  char header[MAXHEADER], *flags, *payload, *result;
+  size_t len, rlen;
+  int lfd, fd, ok;
+
+  signal(SIGPIPE, SIG_IGN);
+  lfd = opensocket(path, 1);
+
+  // 関数の並列コード生成はfatal()からの戻りと両立しない
+  O_threads = 1;
+  O_pipeline = 0;
+
+  while (1)
+  {
+    if ((fd = accept(lfd, NULL, NULL)) == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      fatals("接続を受け付けられません", strerror(errno));
+    }
+
+    while ((payload = recvframe(fd, header, &flags, &len)) != NULL)
+    {
+      ok = serve(header, flags, payload, len, &result, &rlen);
+      free(payload);
+      if (sendframe(fd, ok ? "ok" : "error", "", result, rlen) == -1)
+      {
+        free(result);
+        break;
+      }
+      free(result);
+    }
+    close(fd);
+  }
+  return (0);
+}
+
+// サーバへソースを送ってコンパイルし、レスポンスを受け取る。
+// 成功すれば1、失敗すれば0を返す
+static int request(int fd, char *src, size_t len, char **result, size_t *rlen)
+{
+  char header[MAXHEADER], flags[MAXHEADER], *rflags;
+
+  compile_flags(flags, sizeof(flags));
+  if (sendframe(fd, "src", flags, src, len) == -1 ||
+      (*result = recvframe(fd, header, &rflags, rlen)) == NULL)
+    fatal("サーバとの通信に失敗しました");
+  return (!strcmp(header, "ok"));
+}
+
+// qsort()用。doubleの昇順
+static int bytime(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return ((x > y) - (x < y));
+}
+
+// 計測したn回の時間の統計を出力する
+static void latency(char *what, double *t, int n)
+{
+  double sum = 0;
+
+  qsort(t, n, sizeof(double), bytime);
+  for (int i = 0; i < n; i++)
+    sum += t[i];
+  fprintf(stderr, "%-8s  平均 %9.3f ms  中央値 %9.3f ms  最小 %9.3f ms  p90 %9.3f ms\n",
+          what, sum / n * 1000, t[n / 2] * 1000, t[0] * 1000,
+          t[n * 9 / 10] * 1000);
+}
+
+// サーバへのリクエストと、コンパイラをforkして実行する場合の
+// 1回あたりの遅延をn回ずつ計測して比べる
+static void benchmark(int fd, char *file, char *src, size_t len, int n)
+{
+  double *tserver, *tfork, t;
+  char *result, flags[MAXHEADER], *path, *argv[16], *tok;
+  size_t rlen;
+  pid_t pid;
+  int status, null, argc = 0;
+
+  tserver = malloc(n * sizeof(double));
+  tfork = malloc(n * sizeof(double));
+  if (tserver == NULL || tfork == NULL)
+    fatal("メモリが確保できませんでした。benchmark()");
+
+  // forkする側もサーバへ送るのと同じオプションでコンパイルし、
+  // 出力は捨てる。ファイル名はクライアントのカレントディレクトリで解決する
+  if ((path = realpath(file, NULL)) == NULL)
+    fatals("ファイルを開けません", file);
+  compile_flags(flags, sizeof(flags));
+  argv[argc++] = "comp1";
+  for (tok = strtok(flags, " "); tok != NULL; tok = strtok(NULL, " "))
+    argv[argc++] = tok;
+  argv[argc++] = "-o";
+  argv[argc++] = "/dev/null";
+  argv[argc++] = path;
+  argv[argc] = NULL;
+
+  for (int i = 0; i < n; i++)
+  {
+    t = now();
+    request(fd, src, len, &result, &rlen);
+    tserver[i] = now() - t;
+    free(result);
+  }
+
+  for (int i = 0; i < n; i++)
+  {
+    t = now();
+    if ((pid = fork()) == 0)
+    {
+      // 子プロセスは自分自身のバイナリでファイルをコンパイルする。
+      // -Tなどのダンプは捨てるが、エラーの出力は残す
+      null = open("/dev/null", O_WRONLY);
+      dup2(null, 1);
+      execv("/proc/self/exe", argv);
+      _exit(127);
+    }
+    if (pid == -1 || waitpid(pid, &status, 0) == -1)
+      fatals("forkできません", strerror(errno));
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      fatals("forkしたコンパイルに失敗しました", file);
+    tfork[i] = now() - t;
+  }
+
+  fprintf(stderr, "%s: %d 回\n", file, n);
+  latency("server", tserver, n);
+  latency("fork", tfork, n);
+  free(path);
+  free(tserver);
+  free(tfork);
+}
+
+// コンパイルサーバのクライアント。入力ファイルをそれぞれサーバで
+// コンパイルし、コマンドラインでのコンパイルと同じ名前で出力を書き出す。
+// benchが0でなければ、代わりに遅延の計測をbench回行う
+int client(char *path, char **files, int nfiles, int bench)
+{
+  char *src, *result, *out;
+  size_t len, rlen;
+  FILE *f;
+  pid_t pid;
+  int fd, failed = 0;
+
+  signal(SIGPIPE, SIG_IGN);
+  fd = opensocket(path, 0);
+
+  for (int i = 0; i < nfiles; i++)
+  {
+    if ((src = slurp(files[i], &len)) == NULL)
+      fatals("ファイルを開けません", files[i]);
+    if (bench)
+    {
+      benchmark(fd, files[i], src, len, bench);
+      free(src);
+      continue;
+    }
+
+    if (request(fd, src, len, &result, &rlen))
+    {
+      out = outname(files[i], nfiles);
+      if ((f = openout(out, &pid)) == NULL)
+        fatals("出力ファイルを作成できません", out);
+      fwrite(result, 1, rlen, f);
+      if (closeout(f, pid) == -1)
+      {
+        fprintf(stderr, "%sを作成できませんでした\n", out);
+        failed = 1;
+      }
+    }
+    else
+    {
+      if (nfiles > 1)
+        fprintf(stderr, "%s: ", files[i]);
+      fwrite(result, 1, rlen, stderr);
+      failed = 1;
+    }
+    free(result);
+    free(src);
+  }
+  close(fd);
+  return (failed);
+}
@@ -0,0 +1,156 @@
+#define _GNU_SOURCE
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+#include <time.h>
+
+// コンパイルの計測 (-ftime-report)
+//
+// フェーズごとの時間はスレッドごとのスタックで測り、
+// 入れ子になったフェーズの時間は外側から差し引く(排他的な時間)。
+// 出力への書き込みは、出力ファイルをfopencookie()のストリームで包んで
+// 実際に書き出すときの時間とバイト数を数える。
+// 計測していないときは呼び出し側のif (O_timereport)だけが残る。
+// コード生成スレッドからも呼ばれるので、合計はアトミックに加算する。
+
+#define MAXNEST 16 // フェーズの入れ子の最大の深さ
+
+static char *Phasename[] = {"scan", "parse", "types", "gen", "write"};
+static char *Countname[] = {"tokens", "ast_nodes", "findglob_calls",
+                            "findglob_probes", "registers", "labels",
+                            "bytes", "derefs", "derefs_independent"};
+
+static long Phasens[PH_MAX];  // フェーズごとの時間の合計(ナノ秒)
+static long Counts[ST_MAX];   // カウンタ
+static long Start;            // 計測を始めた時刻
+
+// スレッドごとのフェーズのスタック
+static _Thread_local int Stack[MAXNEST];
+static _Thread_local int Depth;
+static _Thread_local long Since; // スタックの先頭のフェーズが最後に再開した時刻
+
+// 単調増加する時計の現在時刻をナノ秒で返す
+static long nowns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000000000L + ts.tv_nsec);
+}
+
+// ここまでの時間をスタックの先頭のフェーズに加算する
+static void charge(long t)
+{
+  if (Depth > 0)
+    __atomic_fetch_add(&Phasens[Stack[Depth - 1]], t - Since, __ATOMIC_RELAXED);
+  Since = t;
+}
+
+// フェーズphに入る。外側のフェーズの時間はここで止まる
+void stats_enter(int ph)
+{
+  charge(nowns());
+  if (Depth == MAXNEST)
+    fatal("計測するフェーズの入れ子が深すぎます");
+  Stack[Depth++] = ph;
+}
+
+// 今のフェーズを抜けて外側のフェーズを再開する
+void stats_leave(void)
+{
+  charge(nowns());
+  Depth--;
+}
+
+// カウンタcにnを加える
+void stats_count(int c, long n)
+{
+  __atomic_fetch_add(&Counts[c], n, __ATOMIC_RELAXED);
+}
+
+// findglob()の呼び出しを1回と、シンボルを比べた回数を数える
+void stats_probe(int probes)
+{
+  stats_count(ST_FINDGLOB, 1);
+  stats_count(ST_PROBES, probes);
+}
+
+// 計測を始める。カウンタを0に戻す
+void stats_begin(void)
+{
+  memset(Phasens, 0, sizeof(Phasens));
+  memset(Counts, 0, sizeof(Counts));
+  Depth = 0;
+  Start = nowns();
+}
+
+// 包んだ出力ストリームへの書き込み。時間とバイト数を数える
+static ssize_t statswrite(void *cookie, const char *buf, size_t size)
+{
+  size_t n;
+
+  stats_enter(PH_WRITE);
+  n = fwrite(buf, 1, size, (FILE *)cookie);
+  stats_leave();
+  stats_count(ST_BYTES, n);
+  return (n == size ? n : -1);
+}
+
+// 包んだ出力ストリームを閉じる。元のストリームはフラッシュだけする
+static int statsclose(void *cookie)
+{
+  int err;
+
+  stats_enter(PH_WRITE);
+  err = fflush((FILE *)cookie);
+  stats_leave();
+  return (err);
+}
+
+// 出力への書き込みを数えるように出力ストリームを包む。
+// 返したストリームはfclose()すること
+FILE *stats_wrap(FILE *out)
+{
+  cookie_io_functions_t io = {NULL, statswrite, NULL, statsclose};
+  FILE *f;
+
+  if ((f = fopencookie(out, "w", io)) == NULL)
+    fatal("出力ストリームを作成できません");
+  return (f);
+}
+
+// 計測結果を出力する。jsonが0でなければ1行のJSONにする
+void stats_report(char *file, int json)
+{
+  double wall = (nowns() - Start) / 1e6, ms, sum = 0;
+  int i;
+
+  if (json)
+  {
+    fprintf(stderr, "{\"file\": \"%s\", \"wall_ms\": %.3f, \"phases_ms\": {", file, wall);
+    for (i = 0; i < PH_MAX; i++)
+      fprintf(stderr, "%s\"%s\": %.3f", i ? ", " : "", Phasename[i], Phasens[i] / 1e6);
+    fprintf(stderr, "}, \"counters\": {");
+    for (i = 0; i < ST_MAX; i++)
+      fprintf(stderr, "%s\"%s\": %ld", i ? ", " : "", Countname[i], Counts[i]);
+    fprintf(stderr, "}}\n");
+    return;
+  }
+
+  fprintf(stderr, "%-16s %10s %7s\n", "phase", "ms", "%");
+  for (i = 0; i < PH_MAX; i++)
+  {
+    ms = Phasens[i] / 1e6;
+    sum += ms;
+    fprintf(stderr, "%-16s %10.3f %6.1f%%\n", Phasename[i], ms,
+            wall > 0 ? 100 * ms / wall : 0.0);
+  }
+  fprintf(stderr, "%-16s %10.3f %6.1f%%\n", "other", wall > sum ? wall - sum : 0.0,
+          wall > sum ? 100 * (wall - sum) / wall : 0.0);
+  fprintf(stderr, "%-16s %10.3f\n", "wall", wall);
+  for (i = 0; i < ST_MAX; i++)
+    fprintf(stderr, "%-16s %10ld\n", Countname[i], Counts[i]);
+  if (Counts[ST_FINDGLOB])
+    fprintf(stderr, "%-16s %10.1f\n", "probes/lookup",
+            (double)Counts[ST_PROBES] / Counts[ST_FINDGLOB]);
+}
@@ -4,17 +4,53 @@
 
 // シンボルテーブル関数
 
+// 名前からGsymの位置を引くハッシュ表。オープンアドレス法で、
+// 各要素はGsymの位置+1を持ち、0は空きを表す。
+// 半分以上埋まらないようにシンボルテーブルの2倍の大きさにしておく
+#define GHASHSIZE (2 * NSYMBOLS)
+static int Ghash[GHASHSIZE];
+
+// 名前のハッシュ表での最初の位置
+static int ghash(char *s)
+{
+  return ((unsigned)fnv1a_str(FNV128BASIS, s) & (GHASHSIZE - 1));
+}
+
+// ハッシュ表から今のシンボルをすべて取り除く。
+// 表全体を消すより、登録した分だけ消すほうが小さな入力では速い
+void clearglobs(void)
+{
+  int h;
+
+  for (int i = 0; i < Globs; i++)
+  {
+    for (h = ghash(Gsym[i].name); Ghash[h] != i + 1; h = (h + 1) & (GHASHSIZE - 1))
+      ;
+    Ghash[h] = 0;
+  }
+  Globs = 0;
+}
+
 // シンボルsがグローバルシンボルテーブルにあるか判断する
 // 見つかればその位置、見つからなければ-1を返す
 int findglob(char *s)
 {
-  int i;
+  int h, i, probes = 1;
 
-  for (i = 0; i < Globs; i++)
+  for (h = ghash(s); Ghash[h] != 0; h = (h + 1) & (GHASHSIZE - 1), probes++)
   {
+    i = Ghash[h] - 1;
     if (*s == *Gsym[i].name && !strcmp(s, Gsym[i].name))
+    {
+      if (O_incremental)
+        inc_ref(i);
+      if (O_timereport)
+        stats_probe(probes);
       return (i);
+    }
   }
+  if (O_timereport)
+    stats_probe(probes);
   return (-1);
 }
 
@@ -33,7 +69,7 @@ static int newglob(void)
 // シンボルテーブルのスロット番号を返す
 int addglob(char *name, int type, int stype, int endlabel)
 {
-  int y;
+  int y, h;
 
   // シンボルテーブルにすでにあれば既存のスロット番号を返す
   if ((y = findglob(name)) != -1)
@@ -41,9 +77,19 @@ int addglob(char *name, int type, int stype, int endlabel)
 
   // なければ新規スロットを取得して格納し、そのスロット番号を返す
   y = newglob();
-  Gsym[y].name = strdup(name);
+  Gsym[y].name = arena_strdup(name);
   Gsym[y].type = type;
   Gsym[y].stype = stype;
   Gsym[y].endlabel = endlabel;
+  Gsym[y].posn = 0;
+  Gsym[y].pure = NULL;
+  Gsym[y].clobber = -1;
+  Gsym[y].inl = NULL;
+  Gsym[y].ir = NULL;
+
+  // ハッシュ表の空きへ登録する
+  for (h = ghash(name); Ghash[h] != 0; h = (h + 1) & (GHASHSIZE - 1))
+    ;
+  Ghash[h] = y + 1;
   return (y);
 }
@@ -0,0 +1,14 @@
+long a0;
+long a1;
+long *p;
+long one;
+
+int main()
+{
+  one = 1;
+  p = &a0 + one;
+  a1 = 5;
+  *p = 7;
+  printint(a1);
+  return (0);
+}
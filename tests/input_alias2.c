@@ -0,0 +1,20 @@
+long a0;
+long a1;
+long *p;
+long i;
+long s;
+
+int main()
+{
+  a0 = 0;
+  a1 = 5;
+  s = 0;
+  for (i = 0; i < 2; i = i + 1)
+  {
+    p = &a0 + i;
+    *p = *p + 10;
+    s = s + a1;
+  }
+  printint(s);
+  return (0);
+}
@@ -0,0 +1,49 @@
+long g1;
+long g2;
+long g3;
+long g4;
+long n;
+long a;
+long b;
+long c;
+long x;
+
+long wide()
+{
+  n = n + 1;
+  x = g1 + g2 * g3 == g4;
+  x = x + g1 * g2 < g3 + g4;
+  x = x + g4 * g3 - g2 * g1;
+  x = x + g1 + g2 * g3 < g4;
+  x = x + g3 * g4 + g1 * g2;
+  return (x);
+}
+
+long narrow()
+{
+  return (7);
+}
+
+long outer()
+{
+  return (wide(0) + 1);
+}
+
+int main()
+{
+  g1 = 1;
+  g2 = 2;
+  g3 = 3;
+  g4 = 4;
+  a = 100;
+  b = 20;
+  c = 3;
+  printint(a + b * wide(0));
+  printint(a + b * narrow(0));
+  printint(a + b * outer(0));
+  printint(a + b * c == wide(0));
+  printint(a + b * c < narrow(0));
+  printint(a + b * c == outer(0));
+  printint(n);
+  return (0);
+}
@@ -0,0 +1,60 @@
+long a;
+long b;
+long r;
+long s;
+long t;
+long u;
+
+int main()
+{
+  a = 3;
+  if (a > 2)
+  {
+    r = 10;
+  }
+  else
+  {
+    r = 20;
+  }
+  b = a * 4 - 12;
+  if (b == 0)
+  {
+    s = 1;
+  }
+  else
+  {
+    s = 2;
+  }
+  while (b > 5)
+  {
+    b = b - 1;
+    s = 77;
+  }
+  if (a < 1)
+  {
+    s = 99;
+  }
+  t = a + b;
+  if (t != 3)
+  {
+    t = 88;
+  }
+  u = 0;
+  for (b = 0; b < 3; b = b + 1)
+  {
+    if (a == 3)
+    {
+      u = u + 1;
+    }
+    else
+    {
+      u = u + 1000;
+    }
+  }
+  printint(r);
+  printint(s);
+  printint(t);
+  printint(u);
+  printint(b);
+  return (0);
+}
@@ -0,0 +1,64 @@
+long a;
+long b;
+long d;
+long i;
+long s;
+long t;
+long *p;
+
+int main()
+{
+  a = 6;
+  b = 7;
+  printint(0);
+  s = 0;
+  for (i = 0; i < 5; i = i + 1)
+  {
+    s = s + a * b + i;
+  }
+  printint(s);
+
+  p = &a;
+  i = 0;
+  while (*p > i)
+  {
+    i = i + 1;
+  }
+  printint(i);
+
+  d = 0;
+  printint(d);
+  s = 0;
+  for (i = 0; i < 3; i = i + 1)
+  {
+    if (d != 0)
+    {
+      s = s + 100 / d;
+    }
+    s = s + 1;
+  }
+  printint(s);
+
+  d = 4;
+  printint(d);
+  s = 0;
+  for (i = 0; i < 3; i = i + 1)
+  {
+    if (d != 0)
+    {
+      s = s + 100 / d;
+    }
+  }
+  printint(s);
+
+  t = 0;
+  for (i = 0; i < 3; i = i + 1)
+  {
+    s = a + b;
+    t = t + s;
+    a = a + 1;
+  }
+  printint(t);
+  printint(a);
+  return (0);
+}
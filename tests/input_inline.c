@@ -0,0 +1,72 @@
+long g;
+long i;
+long s;
+long q;
+
+long pick()
+{
+  if (g > 5)
+  {
+    return (g * 2);
+  }
+  return (g + 100);
+}
+
+long both()
+{
+  if (g == 3)
+  {
+    return (30);
+  }
+  else
+  {
+    if (g < 3)
+    {
+      return (20);
+    }
+  }
+  return (40);
+}
+
+long find()
+{
+  i = 0;
+  while (i < 10)
+  {
+    q = i * i;
+    if (q > g)
+    {
+      return (i);
+    }
+    i = i + 1;
+  }
+  return (99);
+}
+
+long twice()
+{
+  return (pick(0) + 1);
+}
+
+int main()
+{
+  g = 2;
+  printint(pick(0));
+  g = 7;
+  printint(pick(0));
+  s = 0;
+  for (g = 1; g < 6; g = g + 1)
+  {
+    s = both(0) + s;
+  }
+  printint(s);
+  g = 10;
+  printint(find(0));
+  g = 200;
+  printint(find(0));
+  g = 4;
+  printint(twice(0));
+  g = 9;
+  printint(twice(0) + 5);
+  return (0);
+}
@@ -0,0 +1,51 @@
+long a0;
+long a1;
+long a2;
+long a3;
+long a4;
+long a5;
+long i;
+long s;
+long *p;
+long *q;
+
+int main()
+{
+  for (i = 0; i < 6; i = i + 1)
+  {
+    p = &a0 + i;
+    *p = i * 10;
+  }
+  printint(a0);
+  printint(a3);
+  printint(a5);
+
+  s = 0;
+  for (i = 0; i < 6; i = i + 2)
+  {
+    p = &a0 + i;
+    s = s + *p;
+  }
+  printint(s);
+
+  q = &a1;
+  for (i = 4; i > 0; i = i - 1)
+  {
+    p = q + i;
+    *p = *p + i;
+  }
+  printint(a1);
+  printint(a2);
+  printint(a4);
+  printint(a5);
+
+  s = 0;
+  for (i = 0; i < 3; i = i + 1)
+  {
+    p = &a5 - i;
+    s = s * 10 + *p;
+  }
+  printint(s);
+  printint(i);
+  return (0);
+}
@@ -0,0 +1,79 @@
+long g;
+long h;
+long i;
+long *p;
+
+long leaf()
+{
+  return (g + h * 2);
+}
+
+long leafloop()
+{
+  h = 0;
+  for (i = 0; i < 5; i = i + 1)
+  {
+    if (i == 3)
+    {
+      h = h + 10;
+    }
+    h = h + i;
+  }
+  return (h);
+}
+
+long leafptr()
+{
+  p = &g;
+  *p = *p + 1;
+  return (g);
+}
+
+long leafdiv()
+{
+  return (h / 4);
+}
+
+void leafvoid()
+{
+  g = g + 100;
+}
+
+long caller()
+{
+  return (leaf(0) + leafptr(0));
+}
+
+long maycall()
+{
+  if (g > 1000)
+  {
+    g = leaf(0);
+  }
+  return (g + 1);
+}
+
+void callsvoid()
+{
+  leafvoid(0);
+  printint(g);
+}
+
+int main()
+{
+  g = 3;
+  h = 4;
+  printint(leaf(0));
+  printint(leafloop(0));
+  printint(leafptr(0));
+  printint(leafdiv(0));
+  leafvoid(0);
+  printint(g);
+  printint(caller(0));
+  printint(maycall(0));
+  g = 2000;
+  printint(maycall(0));
+  callsvoid(0);
+  printint(leaf(0) + leafdiv(0) * leafloop(0));
+  return (0);
+}
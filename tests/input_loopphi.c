@@ -0,0 +1,70 @@
+long i;
+long j;
+long s;
+long t;
+long m;
+
+int main()
+{
+  s = 0;
+  for (i = 1; i <= 10; i = i + 1)
+  {
+    s = s + i;
+  }
+  printint(s);
+
+  s = 0;
+  t = 1;
+  for (i = 0; i < 4; i = i + 1)
+  {
+    for (j = 0; j < 3; j = j + 1)
+    {
+      s = s + i * j;
+    }
+    t = t * 2;
+  }
+  printint(s);
+  printint(t);
+
+  m = 0;
+  s = 0;
+  i = 0;
+  while (i < 10)
+  {
+    if (i > m)
+    {
+      m = i;
+    }
+    if (i == 5)
+    {
+      s = s + 100;
+    }
+    else
+    {
+      s = s + 1;
+    }
+    i = i + 1;
+  }
+  printint(m);
+  printint(s);
+
+  s = 5;
+  t = 7;
+  for (i = 0; i < 3; i = i + 1)
+  {
+    j = s;
+    s = t;
+    t = j;
+  }
+  printint(s);
+  printint(t);
+
+  s = 42;
+  for (i = 0; i < 0; i = i + 1)
+  {
+    s = 0;
+  }
+  printint(s);
+  printint(i);
+  return (0);
+}
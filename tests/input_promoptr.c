@@ -0,0 +1,58 @@
+long g;
+long h;
+long i;
+long s;
+long *p;
+long *q;
+
+int main()
+{
+  g = 0;
+  p = &g;
+  for (i = 0; i < 5; i = i + 1)
+  {
+    g = g + 1;
+    *p = *p + 10;
+  }
+  printint(g);
+
+  g = 0;
+  h = 0;
+  q = &h;
+  for (i = 0; i < 4; i = i + 1)
+  {
+    g = g + 2;
+    *q = *q + g;
+  }
+  printint(g);
+  printint(h);
+
+  g = 1;
+  s = 0;
+  p = &g;
+  for (i = 0; i < 3; i = i + 1)
+  {
+    g = g * 3;
+    s = s + *p;
+  }
+  printint(g);
+  printint(s);
+
+  g = 100;
+  for (i = 0; i < 6; i = i + 1)
+  {
+    if (i == 2)
+    {
+      p = &g;
+    }
+    else
+    {
+      p = &h;
+    }
+    g = g + 1;
+    *p = 50;
+  }
+  printint(g);
+  printint(h);
+  return (0);
+}
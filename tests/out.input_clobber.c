@@ -0,0 +1,7 @@
+760
+240
+780
+100
+120
+100
+4
@@ -0,0 +1,5 @@
+10
+1
+3
+3
+3
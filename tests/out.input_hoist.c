@@ -0,0 +1,9 @@
+0
+220
+6
+0
+3
+4
+75
+42
+9
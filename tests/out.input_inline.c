@@ -0,0 +1,7 @@
+102
+14
+150
+4
+99
+105
+24
@@ -0,0 +1,10 @@
+0
+30
+50
+60
+10
+21
+43
+54
+5862
+3
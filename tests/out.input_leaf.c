@@ -0,0 +1,10 @@
+11
+20
+4
+5
+104
+249
+106
+2041
+2140
+2280
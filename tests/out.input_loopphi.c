@@ -0,0 +1,9 @@
+55
+18
+16
+9
+109
+7
+5
+42
+0
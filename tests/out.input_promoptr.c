@@ -0,0 +1,7 @@
+55
+8
+20
+27
+39
+53
+50
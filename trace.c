@@ -0,0 +1,237 @@
+#define _GNU_SOURCE
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// コンパイルのタイムライン (--trace)
+//
+// Chrome/Perfettoのtrace event形式のJSONを書き出す。
+// 入力ファイルのスパンの中にトップレベルの宣言ごとのスパンがあり、
+// さらにパース、genAST()、出力への書き込み(emit)のスパンが入れ子になる。
+// カウンタとしてアリーナのバイト数と、文ごとの使用中のレジスタの最大数を記録する。
+// イベントはそれを起こしたスレッドのIDで記録するので、並列コード生成では
+// ワーカーごと、-jでは入力ファイルのプロセスごとの列に分かれて表示される。
+//
+// イベントはプロセスごとにメモリへ溜めておき、入力ファイルのコンパイルが
+// 終わるたびにO_APPENDで開いたトレースファイルへ1回のwrite()で追記する。
+// ファイルの先頭はtrace_open()が、末尾は開いたプロセスの終了時に書く。
+// どのイベントも",\n"で始まるので、先頭には最初の要素まで書いておく。
+
+static int Tracefd = -1;     // トレースファイル
+static pid_t Owner;          // トレースファイルを開いたプロセス
+static char *Buf;            // 溜めているイベント
+static size_t Buflen;
+static FILE *Events;         // Bufへ書き込むストリーム
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+
+// スレッドごとの状態。fork()した子では取り直す
+static _Thread_local pid_t Tidpid; // Tidを取得したプロセス
+static _Thread_local int Tid;
+static _Thread_local int Peak;     // 前回の記録から後の使用中のレジスタの最大数
+static _Thread_local int Lastpeak; // 前回記録した値
+
+// 単調増加する時計の現在時刻をマイクロ秒で返す
+double trace_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1e6 + ts.tv_nsec / 1e3);
+}
+
+// 今のスレッドのIDを返す
+static int tid(void)
+{
+  pid_t pid = getpid();
+
+  if (Tidpid != pid)
+  {
+    Tid = syscall(SYS_gettid);
+    Tidpid = pid;
+    Peak = Lastpeak = 0;
+  }
+  return (Tid);
+}
+
+// イベントを1つ溜める。fmtはpidとtidの後ろに続くJSONのメンバー
+static void event(char *fmt, ...)
+{
+  va_list ap;
+  int t = tid();
+
+  pthread_mutex_lock(&Lock);
+  if (Events == NULL && (Events = open_memstream(&Buf, &Buflen)) == NULL)
+    fatal("トレースのバッファを作成できません");
+  fprintf(Events, ",\n{\"pid\": %d, \"tid\": %d, ", Tidpid, t);
+  va_start(ap, fmt);
+  vfprintf(Events, fmt, ap);
+  va_end(ap);
+  fputc('}', Events);
+  pthread_mutex_unlock(&Lock);
+}
+
+// 文字列をJSONの文字列の中身として書けるようにbufへ写す
+static char *escape(char *s, char *buf, int size)
+{
+  int n = 0;
+
+  for (; *s && n < size - 7; s++)
+  {
+    if (*s == '"' || *s == '\\')
+      buf[n++] = '\\';
+    if ((unsigned char)*s < ' ')
+      n += snprintf(buf + n, size - n, "\\u%04x", *s);
+    else
+      buf[n++] = *s;
+  }
+  buf[n] = '\0';
+  return (buf);
+}
+
+// startから今までのスパンを記録する。detailがNULLでなければ引数として付ける
+void trace_span(char *cat, char *name, double start, char *detail)
+{
+  char ename[TEXTLEN], edetail[TEXTLEN];
+  double t = trace_now();
+
+  if (detail)
+    event("\"ph\": \"X\", \"cat\": \"%s\", \"name\": \"%s\", \"ts\": %.3f, "
+          "\"dur\": %.3f, \"args\": {\"detail\": \"%s\"}",
+          cat, escape(name, ename, TEXTLEN), start, t - start,
+          escape(detail, edetail, TEXTLEN));
+  else
+    event("\"ph\": \"X\", \"cat\": \"%s\", \"name\": \"%s\", \"ts\": %.3f, "
+          "\"dur\": %.3f",
+          cat, escape(name, ename, TEXTLEN), start, t - start);
+}
+
+// スレッドに名前を付ける
+void trace_thread(char *name)
+{
+  event("\"ph\": \"M\", \"name\": \"thread_name\", \"args\": {\"name\": \"%s\"}",
+        name);
+}
+
+// アリーナから確保したバイト数をカウンタに記録する
+void trace_arena(void)
+{
+  event("\"ph\": \"C\", \"name\": \"arena_bytes\", \"ts\": %.3f, "
+        "\"args\": {\"bytes\": %zu}",
+        trace_now(), arena_bytes());
+}
+
+// レジスタを確保したときに使用中のレジスタの数を知らせる
+void trace_live(int live)
+{
+  tid();
+  if (live > Peak)
+    Peak = live;
+}
+
+// 文の終わりでレジスタを開放する前に、その文で使った
+// レジスタの最大数をスレッドごとのカウンタに記録する。変わらなければ記録しない
+void trace_regsample(void)
+{
+  tid();
+  if (Peak != Lastpeak)
+    event("\"ph\": \"C\", \"name\": \"live_registers\", \"id\": %d, \"ts\": %.3f, "
+          "\"args\": {\"live\": %d}",
+          Tid, trace_now(), Peak);
+  Lastpeak = Peak;
+  Peak = 0;
+}
+
+// 出力ストリームへの書き込みをemitのスパンとして記録する
+static ssize_t tracewrite(void *cookie, const char *buf, size_t size)
+{
+  double start = trace_now();
+  size_t n;
+
+  n = fwrite(buf, 1, size, (FILE *)cookie);
+  trace_span("emit", "emit", start, NULL);
+  return (n == size ? n : -1);
+}
+
+// 包んだ出力ストリームを閉じる。元のストリームはフラッシュだけする
+static int traceclose(void *cookie)
+{
+  double start = trace_now();
+  int err;
+
+  err = fflush((FILE *)cookie);
+  trace_span("emit", "emit", start, NULL);
+  return (err);
+}
+
+// 出力への書き込みを記録するように出力ストリームを包む。
+// 返したストリームはfclose()すること
+FILE *trace_wrap(FILE *out)
+{
+  cookie_io_functions_t io = {NULL, tracewrite, NULL, traceclose};
+  FILE *f;
+
+  if ((f = fopencookie(out, "w", io)) == NULL)
+    fatal("出力ストリームを作成できません");
+  return (f);
+}
+
+// 溜めたイベントをトレースファイルへ追記する。
+// fileがNULLでなければプロセスの名前にする
+void trace_flush(char *file)
+{
+  char efile[TEXTLEN];
+
+  if (file)
+  {
+    event("\"ph\": \"M\", \"name\": \"process_name\", \"args\": {\"name\": \"%s\"}",
+          escape(file, efile, TEXTLEN));
+    trace_thread("main");
+  }
+  pthread_mutex_lock(&Lock);
+  if (Events)
+  {
+    fclose(Events);
+    if (write(Tracefd, Buf, Buflen) != Buflen)
+      fprintf(stderr, "トレースファイルへ書き込めません:%s\n", strerror(errno));
+    free(Buf);
+    Events = NULL;
+  }
+  pthread_mutex_unlock(&Lock);
+}
+
+// 終了時に残りのイベントを追記し、開いたプロセスであればファイルを閉じる
+static void traceexit(void)
+{
+  trace_flush(NULL);
+  if (getpid() != Owner)
+    return;
+  if (write(Tracefd, "\n]}\n", 4) != 4)
+    fprintf(stderr, "トレースファイルへ書き込めません:%s\n", strerror(errno));
+  close(Tracefd);
+}
+
+// トレースファイルを作り、先頭を書き出す。作れなければ-1を返す
+int trace_open(char *file)
+{
+  char head[TEXTLEN];
+  int n;
+
+  if ((Tracefd = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644)) == -1)
+    return (-1);
+  Owner = getpid();
+  n = snprintf(head, sizeof(head),
+               "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n"
+               "{\"pid\": %d, \"tid\": %d, \"ph\": \"M\", \"name\": \"process_name\", "
+               "\"args\": {\"name\": \"comp1\"}}",
+               Owner, tid());
+  if (write(Tracefd, head, n) != n)
+    return (-1);
+  atexit(traceexit);
+  return (0);
+}
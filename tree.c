@@ -9,19 +9,18 @@ struct ASTnode *mkastnode(int op, int type, struct ASTnode *left, struct ASTnode
 {
   struct ASTnode *n;
 
-  // ASTノードを確保
-  n = (struct ASTnode *)malloc(sizeof(struct ASTnode));
-  if (n == NULL)
-  {
-    fatal("メモリが確保できませんでした。mkastnode()");
-  }
+  // ASTノードをアリーナから確保
+  n = (struct ASTnode *)arena_alloc(sizeof(struct ASTnode));
 
   n->op = op;
   n->type = type;
+  n->rvalue = 0;
   n->left = left;
   n->mid = mid;
   n->right = right;
   n->v.intvalue = intvalue;
+  if (O_timereport)
+    stats_count(ST_NODES, 1);
   return (n);
 }
 
@@ -78,6 +77,13 @@ void dumpAST(struct ASTnode *n, int label, int level)
     dumpAST(n->left, Lend, level + 2);
     dumpAST(n->right, NOLABEL, level + 2);
     return;
+  case A_INLINE:
+    for (int i = 0; i < level; i++)
+      fprintf(stdout, " ");
+    fprintf(stdout, "A_INLINE %s\n", Gsym[n->v.id].name);
+    if (n->mid)
+      dumpAST(n->mid, NOLABEL, level + 2);
+    return;
   }
 
   // A_GLUEであればレベルを-2にリセットする
@@ -148,6 +154,9 @@ void dumpAST(struct ASTnode *n, int label, int level)
   case A_RETURN:
     fprintf(stdout, "A_RETURN\n");
     return;
+  case A_LEAVE:
+    fprintf(stdout, "A_LEAVE\n");
+    return;
   case A_FUNCCALL:
     fprintf(stdout, "A_FUNCCALL %s\n", Gsym[n->v.id].name);
     return;
@@ -80,7 +80,7 @@ int value_at(int type)
 // ツリーが引数の型と互換性がなかった場合はNULLを返す。
 // このツリーが二項演算子の一部となるのであれば
 // AST操作は0以外になる。
-struct ASTnode *modify_type(struct ASTnode *tree, int rtype, int op)
+static struct ASTnode *modify(struct ASTnode *tree, int rtype, int op)
 {
   int ltype;
   int lsize, rsize;
@@ -106,6 +106,9 @@ struct ASTnode *modify_type(struct ASTnode *tree, int rtype, int op)
     // 右側へ拡張
     if (rsize > lsize)
       return (mkastunary(A_WIDEN, rtype, tree, 0));
+
+    // ARMのintとlongのように大きさが同じであればそのまま使える
+    return (tree);
   }
   // 左側にあるポインタの処理
   if (ptrtype(ltype))
@@ -132,3 +135,16 @@ struct ASTnode *modify_type(struct ASTnode *tree, int rtype, int op)
   // ここに到達したら型に互換性はない
   return (NULL);
 }
+
+// 型の検査と変換。-ftime-reportではその時間を計る
+struct ASTnode *modify_type(struct ASTnode *tree, int rtype, int op)
+{
+  struct ASTnode *n;
+
+  if (!O_timereport)
+    return (modify(tree, rtype, op));
+  stats_enter(PH_TYPES);
+  n = modify(tree, rtype, op);
+  stats_leave();
+  return (n);
+}